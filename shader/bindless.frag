@@ -0,0 +1,22 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec2 fTex;
+
+layout (location = 0) out vec4 oCol;
+
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+layout (push_constant) uniform DrawConstants {
+	uint textureIndex;
+	uint padding;
+	vec2 uvScale;
+	vec2 uvOffset;
+} drawConstants;
+
+void main()
+{
+	// Clamping first keeps atlased textures inside their block, as the sampler does for the rest
+	vec2 uv = clamp(fTex, 0.0, 1.0) * drawConstants.uvScale + drawConstants.uvOffset;
+	oCol = texture(textures[drawConstants.textureIndex], uv);
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#version 450
+
+layout (location = 0) in vec2 fTex;
+
+layout (location = 0) out vec4 oCol;
+
+// Layout shared with VirtualTextureCache. Each texture's header holds its size, level
+// count, id and the offset of each level's entries, which are stored in row order
+layout (set = 2, binding = 0) readonly buffer PageTable {
+	uint entries[];
+} pageTable;
+
+layout (set = 2, binding = 1) uniform sampler2D pageAtlas;
+
+layout (set = 2, binding = 2) buffer Feedback {
+	uint requests[];
+} feedback;
+
+layout (push_constant) uniform DrawConstants {
+	uint textureIndex;
+} drawConstants;
+
+const uint PageSize = 128;
+const uint PageBorder = 4;
+const uint StoredPageSize = PageSize + 2 * PageBorder;
+const uint FeedbackSize = 4096;
+const uint InvalidEntry = 0xffffffffu;
+
+// Texel coordinates within a level, kept inside its last page
+vec2 LevelTexel(vec2 uv, uvec2 size, uint level)
+{
+	vec2 extent = vec2(max(size >> level, uvec2(1)));
+	return clamp(uv * extent, vec2(0.0), extent - 0.5);
+}
+
+uvec2 LevelPages(uvec2 size, uint level)
+{
+	return (max(size >> level, uvec2(1)) + PageSize - 1) / PageSize;
+}
+
+void main()
+{
+	uint base = drawConstants.textureIndex;
+	uvec2 size = uvec2(pageTable.entries[base], pageTable.entries[base + 1]);
+	uint levels = pageTable.entries[base + 2];
+	uint id = pageTable.entries[base + 3];
+
+	// The level the sampler would pick for the texel footprint
+	vec2 dx = dFdx(fTex * vec2(size));
+	vec2 dy = dFdy(fTex * vec2(size));
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+	uint level = uint(clamp(lod, 0.0, float(levels - 1)));
+
+	uvec2 page = uvec2(LevelTexel(fTex, size, level)) / PageSize;
+	uint pagesAcross = LevelPages(size, level).x;
+
+	// Neighbouring fragments mostly want the same page, so each 4x4 block of the screen
+	// reports into one hashed slot, and the last write wins
+	uvec2 cell = uvec2(gl_FragCoord.xy) / 4u;
+	feedback.requests[(cell.x * 7919u + cell.y * 104729u) % FeedbackSize] = 1u + (id << 24 | level << 20 | page.y << 10 | page.x);
+
+	uint entry = pageTable.entries[pageTable.entries[base + 4 + level] + page.y * pagesAcross + page.x];
+
+	// Nothing is resident until the texture's last level has loaded
+	if (entry == InvalidEntry) {
+		oCol = vec4(0.5, 0.5, 0.5, 1.0);
+		return;
+	}
+
+	// The entry may point at a coarser page, found the same way the CPU picks it, so
+	// locate the fragment within that. Rounding at page edges stays inside the border
+	uvec2 physical = uvec2(entry & 0xfffu, (entry >> 12) & 0xfffu);
+	uint resident = entry >> 24;
+
+	uvec2 residentPage = page;
+	for (uint l = level + 1; l <= resident; ++l) residentPage = min(residentPage / 2u, LevelPages(size, l) - 1u);
+
+	vec2 texel = LevelTexel(fTex, size, resident);
+	vec2 inPage = clamp(texel - vec2(residentPage * PageSize), vec2(0.5 - PageBorder), vec2(PageSize + PageBorder - 0.5));
+
+	vec2 atlasTexel = vec2(physical * StoredPageSize + PageBorder) + inPage;
+	oCol = textureLod(pageAtlas, atlasTexel / vec2(textureSize(pageAtlas, 0)), 0.0);
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include <cassert>
+
+#include "arena.h"
+#include "memory.h"
+#include "types.h"
+#include "utils.h"
+
+namespace vker {
+
+constexpr size_t ArenaAlignment = 64;
+
+LinearArena::LinearArena(size_t capacity) : m_capacity{capacity}
+{
+    m_memory = static_cast<u8 *>(memory::Allocate(capacity, ArenaAlignment, memory::Tag::Frame));
+    if (!m_memory) FatalError("unable to allocate {} byte arena", capacity);
+}
+
+LinearArena::~LinearArena()
+{
+    memory::Free(m_memory);
+}
+
+LinearArena::LinearArena(LinearArena&& other) noexcept :
+    m_memory{other.m_memory}, m_capacity{other.m_capacity}, m_offset{other.m_offset}, m_peak{other.m_peak}
+{
+    other.m_memory = nullptr;
+    other.m_capacity = 0;
+    other.m_offset = 0;
+}
+
+void *LinearArena::Allocate(size_t size, size_t alignment)
+{
+    assert((alignment & (alignment - 1)) == 0);
+
+    const size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+
+    // Falling back to the heap would defeat the point, so the arena must be sized for the worst frame
+    if (offset + size > m_capacity) FatalError("arena exhausted ({} of {} bytes used, {} requested)", m_offset, m_capacity, size);
+
+    m_offset = offset + size;
+    if (m_offset > m_peak) m_peak = m_offset;
+
+    return m_memory + offset;
+}
+
+void LinearArena::Reset()
+{
+    m_offset = 0;
+}
+
+} // namespace vker
\ No newline at end of file
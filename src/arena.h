@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include "types.h"
+
+namespace vker {
+
+// Bump allocator for transient data whose lifetime ends with the frame,
+// reset wholesale instead of freeing individual allocations
+class LinearArena {
+public:
+	explicit LinearArena(size_t capacity);
+	~LinearArena();
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	LinearArena(LinearArena&& other) noexcept;
+	LinearArena& operator=(LinearArena&&) = delete;
+
+	void *Allocate(size_t size, size_t alignment);
+	void Reset();
+
+	inline size_t Capacity() const { return m_capacity; }
+	inline size_t Used() const { return m_offset; }
+	inline size_t Peak() const { return m_peak; }
+
+private:
+	u8 *m_memory;
+	size_t m_capacity;
+	size_t m_offset = 0;
+	size_t m_peak = 0;
+};
+
+template <typename T>
+struct ArenaAllocator {
+	using value_type = T;
+
+	explicit ArenaAllocator(LinearArena& arena) : m_arena{&arena} {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_arena{other.m_arena} {}
+
+	inline T *allocate(size_t n)
+	{
+		return static_cast<T *>(m_arena->Allocate(n * sizeof(T), alignof(T)));
+	}
+
+	// Memory is only reclaimed when the arena is reset
+	inline void deallocate(T *, size_t) {}
+
+	template <typename U>
+	inline bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+
+private:
+	template <typename U>
+	friend struct ArenaAllocator;
+
+	LinearArena *m_arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace vker
\ No newline at end of file
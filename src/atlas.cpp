@@ -0,0 +1,94 @@
+#include "atlas.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace vker::atlas {
+
+SkylinePacker::SkylinePacker(VkExtent2D size) : m_size{size}
+{
+    m_skyline.push_back({ 0, 0, size.width });
+}
+
+bool SkylinePacker::Pack(u32 width, u32 height, Rect& rect)
+{
+    size_t best = m_skyline.size();
+    u32 best_top = UINT32_MAX;
+    u32 best_y = 0;
+
+    for (size_t i = 0; i < m_skyline.size(); ++i) {
+        const u32 x = m_skyline[i].x;
+        if (x + width > m_size.width) break;
+
+        // The rectangle rests on the highest segment beneath it
+        u32 y = 0;
+
+        for (size_t j = i; j < m_skyline.size() && m_skyline[j].x < x + width; ++j) {
+            y = std::max(y, m_skyline[j].y);
+        }
+
+        if (y + height > m_size.height || y + height >= best_top) continue;
+
+        best = i;
+        best_top = y + height;
+        best_y = y;
+    }
+
+    if (best == m_skyline.size()) return false;
+
+    rect = { m_skyline[best].x, best_y, width, height };
+
+    // Segments now covered are trimmed or dropped in favour of the rectangle's top
+    const u32 right = rect.x + width;
+    size_t end = best;
+
+    while (end < m_skyline.size() && m_skyline[end].x < right) {
+        Segment& segment = m_skyline[end];
+        const u32 segment_right = segment.x + segment.width;
+
+        if (segment_right > right) {
+            segment.width = segment_right - right;
+            segment.x = right;
+            break;
+        }
+
+        ++end;
+    }
+
+    m_skyline.erase(m_skyline.begin() + best, m_skyline.begin() + end);
+    m_skyline.insert(m_skyline.begin() + best, { rect.x, rect.y + height, width });
+
+    // Neighbours at the same height become one segment
+    for (size_t i = 0; i + 1 < m_skyline.size();) {
+        if (m_skyline[i].y == m_skyline[i + 1].y) {
+            m_skyline[i].width += m_skyline[i + 1].width;
+            m_skyline.erase(m_skyline.begin() + i + 1);
+        } else {
+            ++i;
+        }
+    }
+
+    m_used_area += u64(width) * height;
+    return true;
+}
+
+void Blit(const u8 *rgba, VkExtent2D size, u8 *atlas, u32 atlas_width, const Rect& block, u32 gutter)
+{
+    assert(block.width >= size.width + 2 * gutter && block.height >= size.height + 2 * gutter);
+
+    const u32 right = gutter + size.width;
+
+    for (u32 row = 0; row < block.height; ++row) {
+        const u32 src_y = std::min(row > gutter ? row - gutter : 0, size.height - 1);
+
+        const u8 *src = rgba + size_t(src_y) * size.width * 4;
+        u8 *dst = atlas + (size_t(block.y + row) * atlas_width + block.x) * 4;
+
+        for (u32 column = 0; column < gutter; ++column) std::memcpy(dst + column * 4, src, 4);
+        std::memcpy(dst + gutter * 4, src, size_t(size.width) * 4);
+        for (u32 column = right; column < block.width; ++column) std::memcpy(dst + column * 4, src + (size.width - 1) * 4, 4);
+    }
+}
+
+} // namespace vker::atlas
\ No newline at end of file
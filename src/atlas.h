@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "types.h"
+
+namespace vker::atlas {
+
+struct Rect {
+	u32 x;
+	u32 y;
+	u32 width;
+	u32 height;
+};
+
+// Packs rectangles along a skyline of the tops of those already placed, putting each
+// one where its top ends up lowest. Sorting the rectangles by height first packs best
+class SkylinePacker {
+public:
+	explicit SkylinePacker(VkExtent2D size);
+
+	// Returns false, leaving the packer unchanged, when the rectangle does not fit
+	bool Pack(u32 width, u32 height, Rect& rect);
+
+	inline VkExtent2D Size() const { return m_size; }
+
+	// Fraction of the area covered by packed rectangles
+	inline float Occupancy() const { return static_cast<float>(m_used_area) / (float(m_size.width) * m_size.height); }
+
+private:
+	struct Segment {
+		u32 x;
+		u32 y;
+		u32 width;
+	};
+
+	VkExtent2D m_size;
+	std::vector<Segment> m_skyline;
+	u64 m_used_area = 0;
+};
+
+// Writes an RGBA8 image into the middle of a packed block, repeating its edge texels
+// out to the sides of the block so that filtering never reaches a neighbour
+void Blit(const u8 *rgba, VkExtent2D size, u8 *atlas, u32 atlas_width, const Rect& block, u32 gutter);
+
+} // namespace vker::atlas
\ No newline at end of file
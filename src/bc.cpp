@@ -0,0 +1,909 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VKER_BC_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bc.h"
+#include "types.h"
+
+namespace vker::bc {
+
+namespace {
+
+constexpr u8 MaskRGB[4] = { 1, 1, 1, 0 };
+constexpr u8 MaskRGBA[4] = { 1, 1, 1, 1 };
+
+constexpr u32 BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Picks the nearest palette entry for each of 16 RGBA texels, measuring only
+// the channels set in the mask, and returns the total squared error
+u32 NearestIndices(const u8 *texels, const u8 (*palette)[4], u32 palette_size, const u8 *mask, u8 *indices)
+{
+#ifdef VKER_BC_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask16 = _mm_set_epi16(
+        -mask[3], -mask[2], -mask[1], -mask[0],
+        -mask[3], -mask[2], -mask[1], -mask[0]);
+
+    __m128i total = zero;
+
+    // Four texels at a time, as 16-bit channels so that madd can square and pair them up
+    for (u32 group = 0; group < 4; ++group) {
+        const __m128i texel = _mm_loadu_si128(reinterpret_cast<const __m128i *>(texels + group * 16));
+        const __m128i lo = _mm_and_si128(_mm_unpacklo_epi8(texel, zero), mask16);
+        const __m128i hi = _mm_and_si128(_mm_unpackhi_epi8(texel, zero), mask16);
+
+        __m128i best = _mm_set1_epi32(INT32_MAX);
+        __m128i best_index = zero;
+
+        for (u32 i = 0; i < palette_size; ++i) {
+            const u8 *entry = palette[i];
+            const __m128i colour = _mm_and_si128(_mm_set_epi16(
+                entry[3], entry[2], entry[1], entry[0],
+                entry[3], entry[2], entry[1], entry[0]), mask16);
+
+            const __m128i dlo = _mm_sub_epi16(lo, colour);
+            const __m128i dhi = _mm_sub_epi16(hi, colour);
+
+            // [rg0, ba0, rg1, ba1] and [rg2, ba2, rg3, ba3]
+            const __m128i slo = _mm_madd_epi16(dlo, dlo);
+            const __m128i shi = _mm_madd_epi16(dhi, dhi);
+
+            const __m128 rg = _mm_shuffle_ps(_mm_castsi128_ps(slo), _mm_castsi128_ps(shi), _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 ba = _mm_shuffle_ps(_mm_castsi128_ps(slo), _mm_castsi128_ps(shi), _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128i distance = _mm_add_epi32(_mm_castps_si128(rg), _mm_castps_si128(ba));
+
+            const __m128i closer = _mm_cmplt_epi32(distance, best);
+            best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+            best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, best_index));
+        }
+
+        total = _mm_add_epi32(total, best);
+
+        alignas(16) u32 group_indices[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(group_indices), best_index);
+
+        for (u32 i = 0; i < 4; ++i) indices[group * 4 + i] = static_cast<u8>(group_indices[i]);
+    }
+
+    alignas(16) u32 totals[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(totals), total);
+
+    return totals[0] + totals[1] + totals[2] + totals[3];
+#else
+    u32 total = 0;
+
+    for (u32 t = 0; t < 16; ++t) {
+        const u8 *texel = texels + t * 4;
+        u32 best = UINT32_MAX;
+
+        for (u32 i = 0; i < palette_size; ++i) {
+            u32 distance = 0;
+
+            for (u32 c = 0; c < 4; ++c) {
+                const int d = (int(texel[c]) - int(palette[i][c])) * mask[c];
+                distance += d * d;
+            }
+
+            if (distance < best) {
+                best = distance;
+                indices[t] = static_cast<u8>(i);
+            }
+        }
+
+        total += best;
+    }
+
+    return total;
+#endif
+}
+
+struct Endpoints {
+    float e0[4];
+    float e1[4];
+};
+
+Endpoints BoundingBox(const u8 *texels, u32 channels, bool inset)
+{
+    Endpoints endpoints;
+
+    for (u32 c = 0; c < channels; ++c) {
+        u8 lo = 255, hi = 0;
+
+        for (u32 t = 0; t < 16; ++t) {
+            lo = std::min(lo, texels[t * 4 + c]);
+            hi = std::max(hi, texels[t * 4 + c]);
+        }
+
+        // Pulling the endpoints in slightly reduces the average error
+        const float margin = inset ? (hi - lo) / 16.0f : 0.0f;
+        endpoints.e0[c] = hi - margin;
+        endpoints.e1[c] = lo + margin;
+    }
+
+    return endpoints;
+}
+
+// Endpoints at the extremes of the texels projected onto their principal axis
+Endpoints PrincipalAxis(const u8 *texels, u32 channels)
+{
+    float mean[4] = {};
+
+    for (u32 t = 0; t < 16; ++t) {
+        for (u32 c = 0; c < channels; ++c) mean[c] += texels[t * 4 + c];
+    }
+
+    for (u32 c = 0; c < channels; ++c) mean[c] /= 16.0f;
+
+    float covariance[4][4] = {};
+
+    for (u32 t = 0; t < 16; ++t) {
+        float d[4];
+        for (u32 c = 0; c < channels; ++c) d[c] = texels[t * 4 + c] - mean[c];
+
+        for (u32 i = 0; i < channels; ++i) {
+            for (u32 j = 0; j < channels; ++j) covariance[i][j] += d[i] * d[j];
+        }
+    }
+
+    // Power iteration converges on the dominant eigenvector quickly for 4x4 blocks
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    for (u32 iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        float length = 0.0f;
+
+        for (u32 i = 0; i < channels; ++i) {
+            for (u32 j = 0; j < channels; ++j) next[i] += covariance[i][j] * axis[j];
+            length = std::max(length, std::abs(next[i]));
+        }
+
+        if (length == 0.0f) break;
+        for (u32 i = 0; i < channels; ++i) axis[i] = next[i] / length;
+    }
+
+    float lo = 0.0f, hi = 0.0f;
+
+    for (u32 t = 0; t < 16; ++t) {
+        float projection = 0.0f;
+        for (u32 c = 0; c < channels; ++c) projection += (texels[t * 4 + c] - mean[c]) * axis[c];
+
+        lo = std::min(lo, projection);
+        hi = std::max(hi, projection);
+    }
+
+    float length = 0.0f;
+    for (u32 c = 0; c < channels; ++c) length += axis[c] * axis[c];
+    if (length == 0.0f) length = 1.0f;
+
+    Endpoints endpoints;
+
+    for (u32 c = 0; c < channels; ++c) {
+        endpoints.e0[c] = std::clamp(mean[c] + axis[c] * hi / length, 0.0f, 255.0f);
+        endpoints.e1[c] = std::clamp(mean[c] + axis[c] * lo / length, 0.0f, 255.0f);
+    }
+
+    return endpoints;
+}
+
+// Solves for the endpoints which best reproduce the texels given their indices,
+// where weights[i] is how far index i lies from e0 towards e1
+bool LeastSquares(const u8 *texels, const u8 *indices, const float *weights, u32 channels, Endpoints& endpoints)
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+
+    for (u32 t = 0; t < 16; ++t) {
+        const float b = weights[indices[t]];
+        const float a = 1.0f - b;
+
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+
+        for (u32 c = 0; c < channels; ++c) {
+            ax[c] += a * texels[t * 4 + c];
+            bx[c] += b * texels[t * 4 + c];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f) return false;
+
+    for (u32 c = 0; c < channels; ++c) {
+        endpoints.e0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+        endpoints.e1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+    }
+
+    return true;
+}
+
+inline u16 Pack565(const float *colour)
+{
+    const u32 r = static_cast<u32>(colour[0] * 31.0f / 255.0f + 0.5f);
+    const u32 g = static_cast<u32>(colour[1] * 63.0f / 255.0f + 0.5f);
+    const u32 b = static_cast<u32>(colour[2] * 31.0f / 255.0f + 0.5f);
+    return static_cast<u16>((r << 11) | (g << 5) | b);
+}
+
+inline void Unpack565(u16 packed, u8 *colour)
+{
+    const u32 r = (packed >> 11) & 0x1f;
+    const u32 g = (packed >> 5) & 0x3f;
+    const u32 b = packed & 0x1f;
+
+    colour[0] = static_cast<u8>((r << 3) | (r >> 2));
+    colour[1] = static_cast<u8>((g << 2) | (g >> 4));
+    colour[2] = static_cast<u8>((b << 3) | (b >> 2));
+    colour[3] = 255;
+}
+
+void BC1Palette(u16 c0, u16 c1, bool four_colour, u8 (*palette)[4])
+{
+    Unpack565(c0, palette[0]);
+    Unpack565(c1, palette[1]);
+
+    for (u32 c = 0; c < 3; ++c) {
+        if (four_colour) {
+            palette[2][c] = static_cast<u8>((2 * palette[0][c] + palette[1][c] + 1) / 3);
+            palette[3][c] = static_cast<u8>((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+        } else {
+            palette[2][c] = static_cast<u8>((palette[0][c] + palette[1][c] + 1) / 2);
+            palette[3][c] = 0;
+        }
+    }
+
+    palette[2][3] = 255;
+    palette[3][3] = four_colour ? 255 : 0;
+}
+
+u32 EncodeBC1Endpoints(const u8 *texels, const Endpoints& endpoints, u8 *out)
+{
+    u16 c0 = Pack565(endpoints.e0);
+    u16 c1 = Pack565(endpoints.e1);
+
+    // Four colour mode requires c0 > c1, which swapping preserves
+    if (c0 < c1) std::swap(c0, c1);
+
+    u8 palette[4][4];
+    BC1Palette(c0, c1, true, palette);
+
+    u8 indices[16];
+    u32 error = 0;
+
+    if (c0 == c1) {
+        std::memset(indices, 0, sizeof(indices));
+    } else {
+        error = NearestIndices(texels, palette, 4, MaskRGB, indices);
+    }
+
+    u32 bits = 0;
+    for (u32 t = 0; t < 16; ++t) bits |= u32(indices[t]) << (t * 2);
+
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &bits, 4);
+
+    return error;
+}
+
+void EncodeBC1(const u8 *texels, Quality quality, u8 *out)
+{
+    Endpoints endpoints = quality == Quality::Fast ? BoundingBox(texels, 3, true) : PrincipalAxis(texels, 3);
+    u32 error = EncodeBC1Endpoints(texels, endpoints, out);
+
+    if (quality != Quality::High) return;
+
+    // Refine against the indices chosen for the current endpoints
+    constexpr float Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    for (u32 iteration = 0; iteration < 2 && error != 0; ++iteration) {
+        u8 indices[16];
+        u32 bits;
+        std::memcpy(&bits, out + 4, 4);
+        for (u32 t = 0; t < 16; ++t) indices[t] = (bits >> (t * 2)) & 3;
+
+        // Endpoints may have been swapped, so solve in the order they were written
+        u16 c0, c1;
+        std::memcpy(&c0, out, 2);
+        std::memcpy(&c1, out + 2, 2);
+        if (c0 == c1) break;
+
+        if (!LeastSquares(texels, indices, Weights, 3, endpoints)) break;
+
+        u8 candidate[8];
+        const u32 candidate_error = EncodeBC1Endpoints(texels, endpoints, candidate);
+        if (candidate_error >= error) break;
+
+        std::memcpy(out, candidate, 8);
+        error = candidate_error;
+    }
+}
+
+void BC4Palette(u8 e0, u8 e1, u8 *palette)
+{
+    palette[0] = e0;
+    palette[1] = e1;
+
+    if (e0 > e1) {
+        for (u32 i = 2; i < 8; ++i) palette[i] = static_cast<u8>(((8 - i) * e0 + (i - 1) * e1 + 3) / 7);
+    } else {
+        for (u32 i = 2; i < 6; ++i) palette[i] = static_cast<u8>(((6 - i) * e0 + (i - 1) * e1 + 2) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+u32 EncodeBC4Endpoints(const u8 *texels, u32 channel, u8 e0, u8 e1, u8 *out)
+{
+    u8 values[8];
+    BC4Palette(e0, e1, values);
+
+    u8 palette[8][4] = {};
+    for (u32 i = 0; i < 8; ++i) palette[i][channel] = values[i];
+
+    u8 mask[4] = {};
+    mask[channel] = 1;
+
+    u8 indices[16];
+    const u32 error = NearestIndices(texels, palette, 8, mask, indices);
+
+    u64 bits = 0;
+    for (u32 t = 0; t < 16; ++t) bits |= u64(indices[t]) << (t * 3);
+
+    out[0] = e0;
+    out[1] = e1;
+    for (u32 i = 0; i < 6; ++i) out[2 + i] = static_cast<u8>(bits >> (i * 8));
+
+    return error;
+}
+
+// A single channel of the RGBA texels
+void EncodeBC4(const u8 *texels, u32 channel, Quality quality, u8 *out)
+{
+    u8 lo = 255, hi = 0;
+
+    for (u32 t = 0; t < 16; ++t) {
+        lo = std::min(lo, texels[t * 4 + channel]);
+        hi = std::max(hi, texels[t * 4 + channel]);
+    }
+
+    const u32 error = EncodeBC4Endpoints(texels, channel, hi, lo, out);
+    if (quality != Quality::High || error == 0) return;
+
+    // Six value mode spends two palette entries on exact 0 and 255
+    u8 inner_lo = 255, inner_hi = 0;
+
+    for (u32 t = 0; t < 16; ++t) {
+        const u8 value = texels[t * 4 + channel];
+        if (value == 0 || value == 255) continue;
+
+        inner_lo = std::min(inner_lo, value);
+        inner_hi = std::max(inner_hi, value);
+    }
+
+    if (inner_lo > inner_hi) inner_lo = inner_hi = 0;
+
+    u8 candidate[8];
+    if (EncodeBC4Endpoints(texels, channel, inner_lo, inner_hi, candidate) < error) std::memcpy(out, candidate, 8);
+}
+
+class BitWriter {
+public:
+    BitWriter(u8 *out) : m_out{out} { std::memset(out, 0, 16); }
+
+    void Write(u32 value, u32 bits)
+    {
+        for (u32 i = 0; i < bits; ++i, ++m_position) {
+            if (value & (1u << i)) m_out[m_position / 8] |= static_cast<u8>(1u << (m_position % 8));
+        }
+    }
+
+private:
+    u8 *m_out;
+    u32 m_position = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const u8 *in) : m_in{in} {}
+
+    u32 Read(u32 bits)
+    {
+        u32 value = 0;
+
+        for (u32 i = 0; i < bits; ++i, ++m_position) {
+            if (m_in[m_position / 8] & (1u << (m_position % 8))) value |= 1u << i;
+        }
+
+        return value;
+    }
+
+private:
+    const u8 *m_in;
+    u32 m_position = 0;
+};
+
+struct BC7Mode6 {
+    u8 q0[4], q1[4];
+    u8 p0, p1;
+    u8 indices[16];
+};
+
+void BC7Palette(const BC7Mode6& block, u8 (*palette)[4])
+{
+    for (u32 c = 0; c < 4; ++c) {
+        const u32 v0 = (block.q0[c] << 1) | block.p0;
+        const u32 v1 = (block.q1[c] << 1) | block.p1;
+
+        for (u32 i = 0; i < 16; ++i) {
+            palette[i][c] = static_cast<u8>(((64 - BC7Weights[i]) * v0 + BC7Weights[i] * v1 + 32) >> 6);
+        }
+    }
+}
+
+// Quantises an endpoint to 7 bits per channel plus a shared low bit, returning the squared error
+float QuantiseBC7(const float *endpoint, u8 p, u8 *q)
+{
+    float error = 0.0f;
+
+    for (u32 c = 0; c < 4; ++c) {
+        const int value = static_cast<int>(std::lround((endpoint[c] - p) / 2.0f));
+        q[c] = static_cast<u8>(std::clamp(value, 0, 127));
+
+        const float d = float((q[c] << 1) | p) - endpoint[c];
+        error += d * d;
+    }
+
+    return error;
+}
+
+u32 FitBC7(const u8 *texels, const Endpoints& endpoints, bool search_pbits, BC7Mode6& block)
+{
+    u32 best_error = UINT32_MAX;
+
+    for (u8 p0 = 0; p0 < 2; ++p0) {
+        for (u8 p1 = 0; p1 < 2; ++p1) {
+            BC7Mode6 candidate;
+            candidate.p0 = p0;
+            candidate.p1 = p1;
+
+            const float e0 = QuantiseBC7(endpoints.e0, p0, candidate.q0);
+            const float e1 = QuantiseBC7(endpoints.e1, p1, candidate.q1);
+
+            if (!search_pbits) {
+                // Take the p-bits that quantise each endpoint best without evaluating the block
+                BC7Mode6 other;
+                if (QuantiseBC7(endpoints.e0, 1 - p0, other.q0) < e0 || QuantiseBC7(endpoints.e1, 1 - p1, other.q1) < e1) continue;
+            }
+
+            u8 palette[16][4];
+            BC7Palette(candidate, palette);
+
+            const u32 error = NearestIndices(texels, palette, 16, MaskRGBA, candidate.indices);
+
+            if (error < best_error) {
+                best_error = error;
+                block = candidate;
+            }
+        }
+    }
+
+    return best_error;
+}
+
+void EncodeBC7(const u8 *texels, Quality quality, u8 *out)
+{
+    Endpoints endpoints = quality == Quality::Fast ? BoundingBox(texels, 4, false) : PrincipalAxis(texels, 4);
+
+    BC7Mode6 block;
+    u32 error = FitBC7(texels, endpoints, quality == Quality::High, block);
+
+    if (quality == Quality::High && error != 0) {
+        float weights[16];
+        for (u32 i = 0; i < 16; ++i) weights[i] = BC7Weights[i] / 64.0f;
+
+        if (LeastSquares(texels, block.indices, weights, 4, endpoints)) {
+            BC7Mode6 candidate;
+            if (FitBC7(texels, endpoints, true, candidate) < error) block = candidate;
+        }
+    }
+
+    // The first index is stored with its top bit implied to be zero
+    if (block.indices[0] & 8) {
+        std::swap(block.q0, block.q1);
+        std::swap(block.p0, block.p1);
+        for (u32 t = 0; t < 16; ++t) block.indices[t] = static_cast<u8>(15 - block.indices[t]);
+    }
+
+    BitWriter writer{out};
+    writer.Write(1 << 6, 7);
+
+    for (u32 c = 0; c < 4; ++c) {
+        writer.Write(block.q0[c], 7);
+        writer.Write(block.q1[c], 7);
+    }
+
+    writer.Write(block.p0, 1);
+    writer.Write(block.p1, 1);
+
+    writer.Write(block.indices[0], 3);
+    for (u32 t = 1; t < 16; ++t) writer.Write(block.indices[t], 4);
+}
+
+void EncodeBlock(Format format, Quality quality, const u8 *texels, u8 *out)
+{
+    switch (format) {
+    case Format::BC1:
+        EncodeBC1(texels, quality, out);
+        break;
+    case Format::BC3:
+        EncodeBC4(texels, 3, quality, out);
+        EncodeBC1(texels, quality, out + 8);
+        break;
+    case Format::BC5:
+        EncodeBC4(texels, 0, quality, out);
+        EncodeBC4(texels, 1, quality, out + 8);
+        break;
+    case Format::BC7:
+        EncodeBC7(texels, quality, out);
+        break;
+    }
+}
+
+void DecodeBC1(const u8 *in, bool force_four_colour, u8 *texels)
+{
+    u16 c0, c1;
+    u32 bits;
+    std::memcpy(&c0, in, 2);
+    std::memcpy(&c1, in + 2, 2);
+    std::memcpy(&bits, in + 4, 4);
+
+    u8 palette[4][4];
+    BC1Palette(c0, c1, force_four_colour || c0 > c1, palette);
+
+    for (u32 t = 0; t < 16; ++t) {
+        const u8 *colour = palette[(bits >> (t * 2)) & 3];
+
+        texels[t * 4 + 0] = colour[0];
+        texels[t * 4 + 1] = colour[1];
+        texels[t * 4 + 2] = colour[2];
+    }
+}
+
+void DecodeBC4(const u8 *in, u32 channel, u8 *texels)
+{
+    u8 palette[8];
+    BC4Palette(in[0], in[1], palette);
+
+    u64 bits = 0;
+    for (u32 i = 0; i < 6; ++i) bits |= u64(in[2 + i]) << (i * 8);
+
+    for (u32 t = 0; t < 16; ++t) texels[t * 4 + channel] = palette[(bits >> (t * 3)) & 7];
+}
+
+// Partitions are two bits per texel, texel 0 lowest, giving the subset it belongs to
+constexpr u32 BC7Partitions2[64] = {
+    0x50505050, 0x40404040, 0x54545454, 0x54505040, 0x50404000, 0x55545450, 0x55545040, 0x54504000,
+    0x50400000, 0x55555450, 0x55544000, 0x54400000, 0x55555440, 0x55550000, 0x55555500, 0x55000000,
+    0x55150100, 0x00004054, 0x15010000, 0x00405054, 0x00004050, 0x15050100, 0x05010000, 0x40505054,
+    0x00404050, 0x05010100, 0x14141414, 0x05141450, 0x01155440, 0x00555500, 0x15014054, 0x05414150,
+    0x44444444, 0x55005500, 0x11441144, 0x05055050, 0x05500550, 0x11114444, 0x41144114, 0x44111144,
+    0x15055054, 0x01055040, 0x05041050, 0x05455150, 0x14414114, 0x50050550, 0x41411414, 0x00141400,
+    0x00041504, 0x00105410, 0x10541000, 0x04150400, 0x50410514, 0x41051450, 0x05415014, 0x14054150,
+    0x41050514, 0x41505014, 0x40011554, 0x54150140, 0x50505500, 0x00555050, 0x15151010, 0x54540404,
+};
+
+constexpr u32 BC7Partitions3[64] = {
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+    0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+    0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+    0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+    0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+    0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+
+// Texels whose index is stored one bit short, with its top bit implied to be zero. Subset 0
+// always has texel 0
+constexpr u8 BC7Anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+constexpr u8 BC7Anchors3[2][64] = {
+    {
+         3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+         3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+         8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+         3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+    },
+    {
+        15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+        15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+        15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+        15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+    },
+};
+
+struct BC7ModeInfo {
+    u8 subsets;
+    u8 partition_bits;
+    u8 rotation_bits;
+    u8 selector_bits;
+    u8 colour_bits;
+    u8 alpha_bits;
+    u8 endpoint_pbits;
+    u8 shared_pbits;
+    u8 index_bits;
+    u8 second_index_bits;
+};
+
+constexpr BC7ModeInfo BC7Modes[8] = {
+    { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+    { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+    { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+    { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+constexpr u32 BC7Weights2[4] = { 0, 21, 43, 64 };
+constexpr u32 BC7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+
+inline const u32 *BC7IndexWeights(u32 bits)
+{
+    return bits == 2 ? BC7Weights2 : bits == 3 ? BC7Weights3 : BC7Weights;
+}
+
+inline u32 BC7Subset(u32 subsets, u32 partition, u32 texel)
+{
+    if (subsets == 1) return 0;
+
+    const u32 pattern = subsets == 2 ? BC7Partitions2[partition] : BC7Partitions3[partition];
+    return (pattern >> (texel * 2)) & 3;
+}
+
+inline bool BC7Anchor(u32 subsets, u32 partition, u32 texel)
+{
+    if (texel == 0) return true;
+    if (subsets == 2) return texel == BC7Anchors2[partition];
+    if (subsets == 3) return texel == BC7Anchors3[0][partition] || texel == BC7Anchors3[1][partition];
+
+    return false;
+}
+
+// Every mode of the format, as the device would decode it
+void DecodeBC7(const u8 *in, u8 *texels)
+{
+    u32 mode = 0;
+    while (mode < 8 && !(in[0] & (1u << mode))) ++mode;
+
+    // Reserved mode bits decode to transparent black
+    if (mode == 8) {
+        std::memset(texels, 0, 64);
+        return;
+    }
+
+    const BC7ModeInfo& info = BC7Modes[mode];
+
+    BitReader reader{in};
+    reader.Read(mode + 1);
+
+    const u32 partition = reader.Read(info.partition_bits);
+    const u32 rotation = reader.Read(info.rotation_bits);
+    const u32 selector = reader.Read(info.selector_bits);
+
+    // Two endpoints per subset, channel by channel
+    u32 endpoints[6][4];
+    const u32 endpoint_count = info.subsets * 2u;
+
+    for (u32 c = 0; c < 4; ++c) {
+        const u32 bits = c < 3 ? info.colour_bits : info.alpha_bits;
+
+        for (u32 e = 0; e < endpoint_count; ++e) endpoints[e][c] = bits ? reader.Read(bits) : 255;
+    }
+
+    // The low bit is stored per endpoint or per subset, then each channel is widened to 8 bits
+    // by repeating its top bits
+    const bool pbits = info.endpoint_pbits || info.shared_pbits;
+    u32 endpoint_pbits[6] = {};
+
+    if (info.endpoint_pbits) {
+        for (u32 e = 0; e < endpoint_count; ++e) endpoint_pbits[e] = reader.Read(1);
+    } else if (info.shared_pbits) {
+        for (u32 s = 0; s < info.subsets; ++s) endpoint_pbits[s * 2] = endpoint_pbits[s * 2 + 1] = reader.Read(1);
+    }
+
+    for (u32 e = 0; e < endpoint_count; ++e) {
+        for (u32 c = 0; c < 4; ++c) {
+            u32 bits = c < 3 ? info.colour_bits : info.alpha_bits;
+            if (bits == 0) continue;
+
+            u32 value = endpoints[e][c];
+            if (pbits) {
+                value = (value << 1) | endpoint_pbits[e];
+                ++bits;
+            }
+
+            value <<= 8 - bits;
+            endpoints[e][c] = value | (value >> bits);
+        }
+    }
+
+    u8 indices[16];
+    u8 second_indices[16] = {};
+
+    for (u32 t = 0; t < 16; ++t) {
+        const bool anchor = BC7Anchor(info.subsets, partition, t);
+        indices[t] = static_cast<u8>(reader.Read(info.index_bits - anchor));
+    }
+
+    if (info.second_index_bits) {
+        for (u32 t = 0; t < 16; ++t) second_indices[t] = static_cast<u8>(reader.Read(info.second_index_bits - (t == 0)));
+    }
+
+    // With two sets of indices, colour takes the first and alpha the second unless the selector swaps them
+    const u8 *colour_indices = indices;
+    const u8 *alpha_indices = info.second_index_bits ? second_indices : indices;
+    u32 colour_index_bits = info.index_bits;
+    u32 alpha_index_bits = info.second_index_bits ? info.second_index_bits : info.index_bits;
+
+    if (selector) {
+        std::swap(colour_indices, alpha_indices);
+        std::swap(colour_index_bits, alpha_index_bits);
+    }
+
+    const u32 *colour_weights = BC7IndexWeights(colour_index_bits);
+    const u32 *alpha_weights = BC7IndexWeights(alpha_index_bits);
+
+    for (u32 t = 0; t < 16; ++t) {
+        const u32 subset = BC7Subset(info.subsets, partition, t);
+        const u32 *e0 = endpoints[subset * 2];
+        const u32 *e1 = endpoints[subset * 2 + 1];
+        u8 *texel = texels + t * 4;
+
+        for (u32 c = 0; c < 4; ++c) {
+            const u32 weight = c < 3 ? colour_weights[colour_indices[t]] : alpha_weights[alpha_indices[t]];
+            texel[c] = static_cast<u8>(((64 - weight) * e0[c] + weight * e1[c] + 32) >> 6);
+        }
+
+        // Rotation swaps alpha with one of the colour channels
+        if (rotation) std::swap(texel[3], texel[rotation - 1]);
+    }
+}
+
+void DecodeBlock(Format format, const u8 *in, u8 *texels)
+{
+    switch (format) {
+    case Format::BC1:
+        for (u32 t = 0; t < 16; ++t) texels[t * 4 + 3] = 255;
+        DecodeBC1(in, false, texels);
+        break;
+    case Format::BC3:
+        DecodeBC4(in, 3, texels);
+        DecodeBC1(in + 8, true, texels);
+        break;
+    case Format::BC5:
+        for (u32 t = 0; t < 16; ++t) {
+            texels[t * 4 + 2] = 0;
+            texels[t * 4 + 3] = 255;
+        }
+
+        DecodeBC4(in, 0, texels);
+        DecodeBC4(in + 8, 1, texels);
+        break;
+    case Format::BC7:
+        DecodeBC7(in, texels);
+        break;
+    }
+}
+
+} // namespace
+
+VkFormat VulkanFormat(Format format)
+{
+    switch (format) {
+    case Format::BC1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case Format::BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+    case Format::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case Format::BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+bool FromVulkanFormat(VkFormat vk_format, Format& format)
+{
+    switch (vk_format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK: format = Format::BC1; return true;
+    case VK_FORMAT_BC3_UNORM_BLOCK:     format = Format::BC3; return true;
+    case VK_FORMAT_BC5_UNORM_BLOCK:     format = Format::BC5; return true;
+    case VK_FORMAT_BC7_UNORM_BLOCK:     format = Format::BC7; return true;
+    default:                            return false;
+    }
+}
+
+size_t BlockSize(Format format)
+{
+    return format == Format::BC1 ? 8 : 16;
+}
+
+size_t EncodedSize(Format format, VkExtent2D size)
+{
+    return size_t((size.width + 3) / 4) * ((size.height + 3) / 4) * BlockSize(format);
+}
+
+void Encode(Format format, Quality quality, const u8 *rgba, VkExtent2D size, u8 *out)
+{
+    const u32 blocks_x = (size.width + 3) / 4;
+    const u32 blocks_y = (size.height + 3) / 4;
+    const size_t block_size = BlockSize(format);
+
+    auto encode_rows = [&](u32 first, u32 stride) {
+        u8 texels[64];
+
+        for (u32 by = first; by < blocks_y; by += stride) {
+            for (u32 bx = 0; bx < blocks_x; ++bx) {
+                // Edge blocks repeat the last row and column
+                for (u32 y = 0; y < 4; ++y) {
+                    const u32 sy = std::min(by * 4 + y, size.height - 1);
+
+                    for (u32 x = 0; x < 4; ++x) {
+                        const u32 sx = std::min(bx * 4 + x, size.width - 1);
+                        std::memcpy(texels + (y * 4 + x) * 4, rgba + (size_t(sy) * size.width + sx) * 4, 4);
+                    }
+                }
+
+                EncodeBlock(format, quality, texels, out + (size_t(by) * blocks_x + bx) * block_size);
+            }
+        }
+    };
+
+    const u32 threads = std::clamp(std::thread::hardware_concurrency(), 1u, blocks_y);
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    for (u32 i = 1; i < threads; ++i) workers.emplace_back(encode_rows, i, threads);
+    encode_rows(0, threads);
+
+    for (auto& worker : workers) worker.join();
+}
+
+void Decode(Format format, const u8 *blocks, VkExtent2D size, u8 *rgba)
+{
+    const u32 blocks_x = (size.width + 3) / 4;
+    const u32 blocks_y = (size.height + 3) / 4;
+    const size_t block_size = BlockSize(format);
+
+    u8 texels[64];
+
+    for (u32 by = 0; by < blocks_y; ++by) {
+        for (u32 bx = 0; bx < blocks_x; ++bx) {
+            DecodeBlock(format, blocks + (size_t(by) * blocks_x + bx) * block_size, texels);
+
+            for (u32 y = 0; y < 4 && by * 4 + y < size.height; ++y) {
+                for (u32 x = 0; x < 4 && bx * 4 + x < size.width; ++x) {
+                    std::memcpy(rgba + ((size_t(by) * 4 + y) * size.width + bx * 4 + x) * 4, texels + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+    }
+}
+
+} // namespace vker::bc
\ No newline at end of file
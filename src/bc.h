@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "types.h"
+
+namespace vker::bc {
+
+enum class Format {
+	BC1, // RGB, 4 bits per texel
+	BC3, // RGBA, 8 bits per texel
+	BC5, // RG, 8 bits per texel, for normal maps
+	BC7, // RGBA, 8 bits per texel, highest quality
+};
+
+enum class Quality {
+	Fast,   // Bounding box endpoints
+	Normal, // Principal axis endpoints
+	High,   // Principal axis endpoints, refined by least squares and exhaustive p-bit search
+};
+
+VkFormat VulkanFormat(Format format);
+
+// Returns false if the Vulkan format is not one of the formats above
+bool FromVulkanFormat(VkFormat vk_format, Format& format);
+
+size_t BlockSize(Format format);
+size_t EncodedSize(Format format, VkExtent2D size);
+
+// Encodes an RGBA8 image, splitting rows of blocks across all hardware threads
+void Encode(Format format, Quality quality, const u8 *rgba, VkExtent2D size, u8 *out);
+
+// Decodes to RGBA8 for devices without BC support. Every BC7 mode is
+// decoded, not only mode 6 which the encoder produces
+void Decode(Format format, const u8 *blocks, VkExtent2D size, u8 *rgba);
+
+} // namespace vker::bc
\ No newline at end of file
@@ -5,15 +5,17 @@
 #include "contrib/vk_mem_alloc.h"
 
 #include "buffer.h"
+#include "memory.h"
 #include "types.h"
 #include "utils.h"
 
 namespace vker {
 
 void Buffer::Setup(VmaAllocator allocator, VkDeviceSize size,
-    VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_properties)
+    VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_properties, memory::Tag tag)
 {
     m_allocator = allocator;
+    m_tag = tag;
 
     {
         VkBufferCreateInfo ci{};
@@ -25,7 +27,11 @@ void Buffer::Setup(VmaAllocator allocator, VkDeviceSize size,
         VmaAllocationCreateInfo alloc_ci{};
         alloc_ci.requiredFlags = mem_properties;
 
-        VK_CHECK(vmaCreateBuffer(allocator, &ci, &alloc_ci, &m_buffer, &m_allocation, nullptr));
+        VmaAllocationInfo info;
+        VK_CHECK(vmaCreateBuffer(allocator, &ci, &alloc_ci, &m_buffer, &m_allocation, &info));
+
+        m_allocation_size = info.size;
+        memory::TrackDeviceAllocation(m_tag, m_allocation_size);
     }
 
     m_init = true;
@@ -35,6 +41,7 @@ void Buffer::Destroy()
 {
     assert(m_init);
     vmaDestroyBuffer(m_allocator, m_buffer, m_allocation);
+    memory::TrackDeviceFree(m_tag, m_allocation_size);
     m_init = false;
 }
 
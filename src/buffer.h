@@ -6,6 +6,7 @@
 
 #include "contrib/vk_mem_alloc.h"
 
+#include "memory.h"
 #include "types.h"
 
 namespace vker {
@@ -14,7 +15,7 @@ class Buffer {
 public:
 	Buffer() = default;
 
-	void Setup(VmaAllocator allocator, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_properties);
+	void Setup(VmaAllocator allocator, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_properties, memory::Tag tag);
 	void Destroy();
 
 	void * Map();
@@ -34,6 +35,9 @@ private:
 
 	VkBuffer m_buffer;
 	VmaAllocation m_allocation;
+
+	memory::Tag m_tag;
+	VkDeviceSize m_allocation_size;
 };
 
 } // namespace vker
\ No newline at end of file
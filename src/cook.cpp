@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cstring>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "contrib/stb_image.h"
+
+#include "bc.h"
+#include "ktx2.h"
+#include "mipmap.h"
+#include "texture_data.h"
+#include "utils.h"
+#include "vtex.h"
+
+// Offline texture cooker: converts an image to a KTX2 file with a full,
+// optionally block compressed, mip chain for Renderer::CreateTexture,
+// or to an RGBA8 virtual texture when the output ends in .vtex
+
+using namespace vker;
+
+static void Usage()
+{
+	fmt::print(stderr,
+		"usage: vker_cook <input> <output.ktx2> [--format rgba8|bc1|bc3|bc5|bc7] [--quality fast|normal|high]\n"
+		"       vker_cook <input> <output.vtex>\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3) {
+		Usage();
+		return 1;
+	}
+
+	const char *input = argv[1];
+	const char *output = argv[2];
+
+	bool compress = true;
+	bc::Format format = bc::Format::BC7;
+	bc::Quality quality = bc::Quality::Normal;
+
+	for (int i = 3; i + 1 < argc; i += 2) {
+		const std::string_view option = argv[i];
+		const std::string_view value = argv[i + 1];
+
+		if (option == "--format") {
+			compress = value != "rgba8";
+
+			if (value == "bc1") format = bc::Format::BC1;
+			else if (value == "bc3") format = bc::Format::BC3;
+			else if (value == "bc5") format = bc::Format::BC5;
+			else if (value == "bc7") format = bc::Format::BC7;
+			else if (compress) FatalError("unknown format {}", value);
+		} else if (option == "--quality") {
+			if (value == "fast") quality = bc::Quality::Fast;
+			else if (value == "normal") quality = bc::Quality::Normal;
+			else if (value == "high") quality = bc::Quality::High;
+			else FatalError("unknown quality {}", value);
+		} else {
+			Usage();
+			return 1;
+		}
+	}
+
+	int width, height, channels;
+	stbi_uc *pixels = stbi_load(input, &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) FatalError("failed to load {}: {}", input, stbi_failure_reason());
+
+	const VkExtent2D size{ static_cast<u32>(width), static_cast<u32>(height) };
+
+	if (std::string_view{ output }.ends_with(".vtex")) {
+		vtex::Write(output, pixels, size);
+		stbi_image_free(pixels);
+
+		fmt::print("{}: {}x{}, {} levels of {}x{} pages\n", output, size.width, size.height, vtex::LevelCount(size), vtex::PageSize, vtex::PageSize);
+		return 0;
+	}
+
+	const u32 mip_levels = mipmap::LevelCount(size);
+
+	std::vector<u8> chain(mipmap::ChainSize(size, mip_levels));
+	std::memcpy(chain.data(), pixels, size_t(size.width) * size.height * 4);
+	stbi_image_free(pixels);
+
+	mipmap::GenerateRGBA8(chain.data(), size, mip_levels);
+
+	const auto start = std::chrono::steady_clock::now();
+
+	TextureData texture;
+	texture.format = compress ? bc::VulkanFormat(format) : VK_FORMAT_R8G8B8A8_UNORM;
+	texture.size = size;
+
+	for (u32 level = 0; level < mip_levels; ++level) {
+		const VkExtent2D extent = mipmap::LevelExtent(size, level);
+		const u8 *rgba = chain.data() + mipmap::LevelOffset(size, level);
+
+		const size_t offset = texture.data.size();
+		const size_t level_size = compress ? bc::EncodedSize(format, extent) : size_t(extent.width) * extent.height * 4;
+
+		texture.levels.push_back({ offset, level_size });
+		texture.data.resize(offset + level_size);
+
+		if (compress) {
+			bc::Encode(format, quality, rgba, extent, texture.data.data() + offset);
+		} else {
+			std::memcpy(texture.data.data() + offset, rgba, level_size);
+		}
+	}
+
+	const auto end = std::chrono::steady_clock::now();
+
+	ktx2::Write(output, texture);
+
+	fmt::print("{}: {}x{}, {} levels, {} -> {} bytes in {:.1f}ms\n",
+		output, size.width, size.height, mip_levels, chain.size(), texture.data.size(),
+		std::chrono::duration<double, std::milli>(end - start).count());
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "deletion_queue.h"
+
+#include <cassert>
+#include <utility>
+
+namespace vker {
+
+void DeletionQueue::Setup(u32 frames_in_flight)
+{
+    assert(!m_init);
+
+    m_deleters.resize(frames_in_flight);
+    m_init = true;
+}
+
+void DeletionQueue::Destroy()
+{
+    assert(m_init);
+
+    for (u32 frame = 0; frame < m_deleters.size(); ++frame) {
+        Flush(frame);
+    }
+
+    m_deleters.clear();
+    m_init = false;
+}
+
+void DeletionQueue::Push(u32 frame, std::function<void()> deleter)
+{
+    assert(m_init);
+    m_deleters[frame].push_back(std::move(deleter));
+}
+
+void DeletionQueue::Flush(u32 frame)
+{
+    assert(m_init);
+
+    // Deleters run in the order they were pushed
+    for (auto& deleter : m_deleters[frame]) {
+        deleter();
+    }
+
+    m_deleters[frame].clear();
+}
+
+} // namespace vker
\ No newline at end of file
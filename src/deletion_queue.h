@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "types.h"
+
+namespace vker {
+
+// Destroys objects that frames in flight may still be using. Deleters pushed for
+// a frame in flight run the next time that frame has been waited on, by which
+// point every frame submitted before it has retired too, as they share one queue
+class DeletionQueue {
+public:
+	DeletionQueue() = default;
+
+	void Setup(u32 frames_in_flight);
+
+	// Runs every remaining deleter, once the device is idle
+	void Destroy();
+
+	void Push(u32 frame, std::function<void()> deleter);
+
+	// Call once the frame has been waited on, before pushing anything new for it
+	void Flush(u32 frame);
+
+private:
+	bool m_init = false;
+
+	std::vector<std::vector<std::function<void()>>> m_deleters;
+};
+
+} // namespace vker
\ No newline at end of file
@@ -1,6 +1,12 @@
 #include "engine.h"
 
+#include <algorithm>
 #include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -10,6 +16,7 @@
 #include <tiny_obj_loader.h>
 
 #include "camera.h"
+#include "memory.h"
 #include "model.h"
 #include "utils.h"
 #include "vertex.h"
@@ -22,22 +29,92 @@ constexpr int Height = 1080;
 constexpr float CameraSpeed = 5.0f;
 constexpr float LookSpeed = 0.25f;
 
-Engine::Engine() : m_window{ Width, Height, "vker"}, m_renderer{m_window} {}
+// Frames allowed to allocate while caches and driver state warm up
+constexpr u64 FrameAllocationWarmup = 16;
+
+// Longest sleep between events while idle, in seconds
+constexpr double IdleTimeout = 1.0;
+
+struct SceneModel {
+    const char *path;
+
+    // Used as is, unless the build has cooked it into a .ktx2
+    const char *texture;
+};
+
+constexpr SceneModel SceneModels[] = {
+    { "../../../asset/model/viking_room.obj", "../../../asset/texture/viking_room.png" },
+};
+
+Engine::Engine(const EngineSettings& settings) :
+    m_settings{settings},
+    m_jobs{settings.job_workers, settings.pin_job_workers, settings.main_thread_jobs},
+    m_window{ Width, Height, "vker"},
+    m_renderer{m_window, m_jobs, settings.renderer} {}
+
+Engine::~Engine()
+{
+    // Loads talk to the renderer, which goes before the job system. Nothing draws any more,
+    // so the requests they may still be waiting on are made here instead
+    while (!m_loads.Done()) {
+        m_renderer.ProcessRequests();
+        std::this_thread::yield();
+    }
+}
 
 void Engine::Setup()
 {
+    memory::TagScope tag{memory::Tag::Loader};
+
+    // Loading carries on into the first frames, which should not count its allocations
+    memory::FrameAllocationPause pause;
+
+    Spawn(m_jobs, LoadScene(), &m_loads);
+}
+
+Task<> Engine::LoadScene()
+{
+    std::vector<Task<ModelHandle>> loads;
+
+    // Textures are requested first, so the renderer loads them while the models are parsed
+    for (const auto& model : SceneModels) {
+        // Prefer the texture cooked at build time, which is block compressed with its mips
+        std::filesystem::path texture = model.texture;
+        const auto cooked = std::filesystem::path{ VKER_BUILD_DIR } / "asset/texture" / texture.filename().replace_extension(".ktx2");
+        if (std::filesystem::exists(cooked)) texture = cooked;
+
+        loads.push_back(LoadModel(model.path, m_renderer.RequestTexture(texture)));
+    }
+
+    const std::vector<ModelHandle> models = co_await WhenAll(m_jobs, std::move(loads));
+
+    // The main thread may be asleep with nothing to draw, and has to pass the requests on
+    m_window.Wake();
+
+    for (const auto& model : models) co_await WhenReady{ m_jobs, model };
+    fmt::print("scene loaded, {} models\n", models.size());
+}
+
+Task<ModelHandle> Engine::LoadModel(std::filesystem::path path, TextureHandle texture)
+{
+    const std::vector<u8> file = co_await ReadFile(m_jobs, path);
+
+    // Parsed on the job the file was read on
+    std::istringstream stream{ std::string{ file.begin(), file.end() } };
+
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
     std::string warnings, errors;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warnings, &errors, "../../../asset/model/viking_room.obj")) {
-        FatalError("failed to load model: {}\n", errors);
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warnings, &errors, &stream)) {
+        FatalError("failed to load model {}: {}\n", path.string(), errors);
     }
 
     if (!warnings.empty()) fmt::print("object warnings: {}\n", warnings);
 
-    Model& model = m_renderer.CreateModel();
+    memory::TaggedVector<u32, memory::Tag::Models> indices;
+    memory::TaggedVector<Vertex, memory::Tag::Models> vertices;
 
     for (const auto& shape : shapes) {
         for (const auto& ind : shape.mesh.indices) {
@@ -50,18 +127,22 @@ void Engine::Setup()
             vertex.tex.x = attrib.texcoords[ind.texcoord_index * 2];
             vertex.tex.y = 1.0f - attrib.texcoords[ind.texcoord_index * 2 + 1];
 
-            model.indices.push_back(model.indices.size());
-            model.vertices.push_back(vertex);
+            indices.push_back(static_cast<u32>(indices.size()));
+            vertices.push_back(vertex);
         }
     }
 
-    model.BuildBuffers();
+    co_return m_renderer.RequestModel(std::move(indices), std::move(vertices), std::move(texture));
 }
 
 void Engine::Run()
 {
     bool mouse_focus = false;
 
+    bool report_key_down = false;
+    bool dump_key_down = false;
+    bool latency_key_down = false;
+
     auto last_second = std::chrono::high_resolution_clock::now();
     auto last_time = last_second;
 
@@ -79,11 +160,36 @@ void Engine::Run()
 
     glm::dvec2 mouse_pos{ Width / 2.0f, Height / 2.0f };
 
+    // Callbacks run on the main thread while polling, so they leave the events for the next packet
     m_window.SetResizeCallback([=](int w, int h) {
-        m_renderer.InvalidateSwapchain();
+        m_resized = true;
+    });
+
+    m_window.SetRefreshCallback([this] {
+        m_refresh = true;
     });
 
+    m_background_limiter.SetFrameRate(m_settings.background_frame_rate);
+
+    if (m_settings.render_thread) m_render_thread = std::thread{ &Engine::RenderLoop, this };
+
+    bool idle = false;
+
     while (!m_window.ShouldClose()) {
+        if (idle) {
+            m_window.WaitEvents(IdleTimeout);
+
+            // Time spent asleep would otherwise move the camera as though it were one long frame
+            last_time = std::chrono::high_resolution_clock::now();
+        } else if (!m_settings.render_thread && !m_window.Focused()) {
+            m_background_limiter.Wait();
+        }
+
+        // Input is polled once the limiter releases the frame, so it is as fresh as possible.
+        // The render thread paces the frames itself, as it also draws them without new packets
+        const auto input_time = m_settings.render_thread ? FrameLimiter::Clock::now() : m_renderer.BeginFrame();
+        m_window.Update();
+
         const auto current_time = std::chrono::high_resolution_clock::now();
         const auto frame_duration = std::chrono::duration_cast<std::chrono::microseconds>(current_time - last_time).count();
         const auto second_duration = std::chrono::duration_cast<std::chrono::microseconds>(current_time - last_second).count();
@@ -100,6 +206,9 @@ void Engine::Run()
 
         last_time = current_time;
 
+        const glm::vec3 last_pos = cam.pos;
+        const glm::vec3 last_dir = cam.dir;
+
         const glm::vec3 left = glm::normalize(glm::cross(cam.dir - cam.pos, cam.up));
 
         if (m_window.GetKeyState(GLFW_KEY_W) == GLFW_PRESS) {
@@ -123,6 +232,28 @@ void Engine::Run()
             fmt::print("camera dir. x={:.02f}, y={:.02f}, z={:.02f}\n", cam.dir.x, cam.dir.y, cam.dir.z);
         }
 
+        const bool report_key = m_window.GetKeyState(GLFW_KEY_M) == GLFW_PRESS;
+        const bool dump_key = m_window.GetKeyState(GLFW_KEY_N) == GLFW_PRESS;
+
+        if ((report_key && !report_key_down) || (dump_key && !dump_key_down)) {
+            memory::FrameAllocationPause pause;
+
+            if (report_key && !report_key_down) memory::Report();
+            if (dump_key && !dump_key_down) memory::DumpToFile("memory_report.txt");
+        }
+
+        report_key_down = report_key;
+        dump_key_down = dump_key;
+
+        const bool latency_key = m_window.GetKeyState(GLFW_KEY_L) == GLFW_PRESS;
+
+        if (latency_key && !latency_key_down) {
+            fmt::print("input to submit {:.02f} ms (average {:.02f} ms), present blocked {:.02f} ms\n",
+                m_renderer.InputToSubmitTime(), m_renderer.AverageInputToSubmitTime(), m_renderer.PresentTime());
+        }
+
+        latency_key_down = latency_key;
+
         if (m_window.GetMouseButton(GLFW_MOUSE_BUTTON_1) == GLFW_PRESS) {
             mouse_focus = true;
             m_window.SetInputMode(GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -157,12 +288,106 @@ void Engine::Run()
             cam.dir = glm::normalize(cam.dir);
         }
 
-        m_renderer.Draw(cam);
-        m_renderer.Present();
-        m_window.Update();
+        RenderPacket packet{};
+        packet.camera = cam;
+        packet.input_time = input_time;
+        packet.resized = m_resized;
+        packet.redraw = m_refresh || cam.pos != last_pos || cam.dir != last_dir;
+        packet.minimized = m_window.Minimized();
+        packet.focused = m_window.Focused();
+
+        m_resized = false;
+        m_refresh = false;
+
+        if (m_settings.render_thread) {
+            m_packets.Push(packet);
+
+            // The render thread goes on drawing by itself, so this thread only has to keep
+            // polling while the picture is changing and input could change it further
+            idle = packet.minimized || (m_settings.render_on_demand && !packet.redraw && !packet.resized &&
+                !m_render_busy.load(std::memory_order_acquire) && !m_renderer.RequestsPending());
+        } else {
+            idle = !Render(packet);
+        }
 
         frames++;
     }
+
+    if (m_render_thread.joinable()) {
+        RenderPacket quit{};
+        quit.quit = true;
+
+        m_packets.Push(quit);
+        m_render_thread.join();
+    }
+}
+
+void Engine::RenderLoop()
+{
+    RenderPacket packet{};
+    bool busy = false;
+
+    for (;;) {
+        // Only block for the next packet once the last one has nothing left to draw
+        const RenderPacket *next = busy ? m_packets.TryFront() : &m_packets.Front();
+        if (next && next->quit) return;
+
+        // Every frame drawn is paced, including the ones drawn again without a new packet. Waiting
+        // before taking the packet lets one that arrives meanwhile replace the last one
+        const auto frame_time = PaceFrame(next ? next->focused : packet.focused);
+
+        if (!next) next = m_packets.TryFront();
+
+        if (next) {
+            packet = *next;
+            m_packets.Pop();
+
+            if (packet.quit) return;
+        } else {
+            // Drawing the last packet again, whose events have already been applied
+            packet.resized = false;
+            packet.redraw = false;
+            packet.input_time = frame_time;
+        }
+
+        busy = Render(packet);
+        m_render_busy.store(busy, std::memory_order_release);
+    }
+}
+
+FrameLimiter::Clock::time_point Engine::PaceFrame(bool focused)
+{
+    if (!focused) m_background_limiter.Wait();
+    return m_renderer.BeginFrame();
+}
+
+bool Engine::Render(const RenderPacket& packet)
+{
+    if (packet.resized) m_renderer.InvalidateSwapchain();
+    if (packet.redraw) m_renderer.RequestRedraw();
+
+    // Minimized windows have nothing to present to, whether drawing on demand or not
+    if (packet.minimized) return false;
+    if (m_settings.render_on_demand && !m_renderer.NeedsRedraw()) return false;
+
+    // Counted on whichever thread draws, so the count covers the frame and the jobs it submits
+    if (m_settings.check_frame_allocations) memory::BeginFrameAllocationCount();
+
+    m_renderer.Draw(packet.camera, packet.input_time);
+    m_renderer.Present();
+
+    if (m_settings.check_frame_allocations) {
+        const u64 allocations = memory::EndFrameAllocationCount();
+
+        // Growth that is not a warmup cost has to be made under a FrameAllocationPause
+        if (m_frame_number >= FrameAllocationWarmup && allocations != 0) {
+            FatalError("frame {} made {} heap allocations after warming up", m_frame_number, allocations);
+        }
+    }
+
+    m_frame_number++;
+
+    return !m_settings.render_on_demand || m_renderer.NeedsRedraw();
 }
 
 } // namespace vker
\ No newline at end of file
@@ -1,20 +1,86 @@
 #pragma once
 
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+#include "camera.h"
+#include "frame_limiter.h"
+#include "job_system.h"
 #include "renderer.h"
+#include "resource_handle.h"
+#include "settings.h"
+#include "spsc_queue.h"
+#include "task.h"
 #include "window.h"
 
 namespace vker {
 
+// Everything the main thread hands the renderer for a frame. Packets are copied whole
+// and never change once pushed, so the next one is built while the last is drawn
+struct RenderPacket {
+	Camera camera;
+
+	// When the frame's input was sampled, which is timed until the frame is submitted
+	FrameLimiter::Clock::time_point input_time;
+
+	// Seen on the main thread since the previous packet
+	bool resized;
+	bool redraw;
+
+	bool minimized;
+	bool focused;
+	bool quit;
+};
+
 class Engine {
 public:
-	Engine();
+	Engine(const EngineSettings& settings = {});
+	~Engine();
 
+	// Starts loading the scene in the background, which appears as it becomes ready
 	void Setup();
 	void Run();
 
 private:
+	// Every model loads alongside the others, and the scene is done once the renderer has them all
+	Task<> LoadScene();
+	Task<ModelHandle> LoadModel(std::filesystem::path path, TextureHandle texture);
+
+	void RenderLoop();
+
+	// Waits for the frame limiters on the render thread, and returns when the frame was released
+	FrameLimiter::Clock::time_point PaceFrame(bool focused);
+
+	// Applies the packet's events and draws it, unless there is nothing new to show.
+	// Returns whether the renderer still has frames to draw after this one
+	bool Render(const RenderPacket& packet);
+
+	EngineSettings m_settings;
+
+	JobSystem m_jobs;
 	Window m_window;
 	Renderer m_renderer;
+
+	FrameLimiter m_background_limiter;
+
+	JobCounter m_loads;
+
+	// Window events, gathered on the main thread until the next packet
+	bool m_resized = false;
+	bool m_refresh = false;
+
+	// A single slot, which the render thread copies each packet out of and frees straight
+	// away. The main thread can then build one packet ahead of the frame being drawn, and
+	// blocks on pushing the one after that until the render thread catches up
+	std::thread m_render_thread;
+	SpscQueue<RenderPacket, 1> m_packets;
+
+	// Set by the render thread after each frame, for the main thread to decide on idling
+	std::atomic<bool> m_render_busy = false;
+
+	// Frames drawn so far, which may only allocate while warming up
+	u64 m_frame_number = 0;
 };
 
 } // namespace vker
\ No newline at end of file
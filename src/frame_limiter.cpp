@@ -0,0 +1,32 @@
+#include "frame_limiter.h"
+
+#include <thread>
+
+namespace vker {
+
+// Wakeups can be late by about a scheduler tick, so stop sleeping this early
+constexpr auto SpinDuration = std::chrono::microseconds{1500};
+
+void FrameLimiter::SetFrameRate(u32 frames_per_second)
+{
+    m_frame_time = frames_per_second != 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::seconds{1}) / frames_per_second : Clock::duration{};
+    m_deadline = Clock::now();
+}
+
+FrameLimiter::Clock::time_point FrameLimiter::Wait()
+{
+    if (!Enabled()) return Clock::now();
+
+    if (m_deadline - Clock::now() > SpinDuration) std::this_thread::sleep_until(m_deadline - SpinDuration);
+    while (Clock::now() < m_deadline) std::this_thread::yield();
+
+    // Deadlines advance by whole frames so the rate does not drift, unless a frame
+    // ran so long that catching up would mean a burst of unpaced frames
+    const auto now = Clock::now();
+    m_deadline += m_frame_time;
+    if (m_deadline < now) m_deadline = now + m_frame_time;
+
+    return now;
+}
+
+} // namespace vker
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <chrono>
+
+#include "types.h"
+
+namespace vker {
+
+// Paces frames to a fixed rate. Sleeping is only accurate to the scheduler's
+// granularity, so the last part of each wait spins on the clock instead
+class FrameLimiter {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// A rate of zero disables the limiter
+	void SetFrameRate(u32 frames_per_second);
+
+	// Blocks until the next frame is due and returns the time it started
+	Clock::time_point Wait();
+
+	inline bool Enabled() const { return m_frame_time.count() != 0; }
+
+private:
+	Clock::duration m_frame_time{};
+	Clock::time_point m_deadline{};
+};
+
+} // namespace vker
\ No newline at end of file
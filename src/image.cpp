@@ -5,15 +5,42 @@
 #include "contrib/vk_mem_alloc.h"
 
 #include "image.h"
+#include "memory.h"
+#include "mipmap.h"
+#include "sync.h"
 #include "types.h"
 #include "utils.h"
 
 namespace vker {
 
-void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFormat format, bool depth)
+// Transitions mip levels [base_level, base_level + level_count) of a color image
+static void LayoutBarrier(VkCommandBuffer cmd, VkImage image, u32 base_level, u32 level_count,
+    VkImageLayout old_layout, VkImageLayout new_layout,
+    VkAccessFlags2 src_access, VkAccessFlags2 dst_access,
+    VkPipelineStageFlags2 src_stage, VkPipelineStageFlags2 dst_stage)
+{
+    sync::ImageBarrier barrier{};
+    barrier.image = image;
+    barrier.base_level = base_level;
+    barrier.level_count = level_count;
+    barrier.old_layout = old_layout;
+    barrier.new_layout = new_layout;
+    barrier.src_stage = src_stage;
+    barrier.src_access = src_access;
+    barrier.dst_stage = dst_stage;
+    barrier.dst_access = dst_access;
+
+    sync::RecordImageBarrier(cmd, barrier);
+}
+
+void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFormat format, u32 mip_levels, bool depth)
 {
     m_device = device;
     m_allocator = allocator;
+    m_extent = size;
+    m_format = format;
+    m_mip_levels = mip_levels;
+    m_tag = depth ? memory::Tag::RenderTargets : memory::Tag::Textures;
 
     {
         VkImageCreateInfo ci{};
@@ -21,7 +48,7 @@ void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFo
         ci.imageType = VK_IMAGE_TYPE_2D;
         ci.format = format;
         ci.extent = { size.width, size.height, 1 };
-        ci.mipLevels = 1;
+        ci.mipLevels = mip_levels;
         ci.arrayLayers = 1;
         ci.samples = VK_SAMPLE_COUNT_1_BIT;
 
@@ -29,6 +56,9 @@ void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFo
             ci.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
         } else {
             ci.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+            // Lower levels may be generated by blitting from the level above
+            if (mip_levels > 1) ci.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
         }
 
         ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -37,7 +67,11 @@ void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFo
         VmaAllocationCreateInfo alloc_ci{};
         alloc_ci.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-        VK_CHECK(vmaCreateImage(allocator, &ci, &alloc_ci, &m_image, &m_allocation, nullptr));
+        VmaAllocationInfo info;
+        VK_CHECK(vmaCreateImage(allocator, &ci, &alloc_ci, &m_image, &m_allocation, &info));
+
+        m_allocation_size = info.size;
+        memory::TrackDeviceAllocation(m_tag, m_allocation_size);
     }
 
     {
@@ -48,11 +82,11 @@ void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFo
         ci.format = format;
         ci.subresourceRange.aspectMask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
         ci.subresourceRange.baseMipLevel = 0;
-        ci.subresourceRange.levelCount = 1;
+        ci.subresourceRange.levelCount = mip_levels;
         ci.subresourceRange.baseArrayLayer = 0;
         ci.subresourceRange.layerCount = 1;
 
-        VK_CHECK(vkCreateImageView(device, &ci, nullptr, &m_image_view));
+        VK_CHECK(vkCreateImageView(device, &ci, memory::HostCallbacks(m_tag), &m_image_view));
     }
 
     {
@@ -64,16 +98,16 @@ void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFo
         ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
         ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
         ci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-        ci.mipLodBias = 1.0f;
+        ci.mipLodBias = 0.0f;
         ci.anisotropyEnable = VK_FALSE;
         ci.maxAnisotropy = 1.0f;
         ci.compareEnable = VK_FALSE;
-        ci.minLod = 1.0f;
-        ci.maxLod = 1.0f;
+        ci.minLod = 0.0f;
+        ci.maxLod = static_cast<float>(mip_levels);
         ci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
         ci.unnormalizedCoordinates = VK_FALSE;
 
-        VK_CHECK(vkCreateSampler(device, &ci, nullptr, &m_sampler));
+        VK_CHECK(vkCreateSampler(device, &ci, memory::HostCallbacks(m_tag), &m_sampler));
     }
 
     m_init = true;
@@ -82,10 +116,91 @@ void Image::Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFo
 void Image::Destroy()
 {
     assert(m_init);
-    vkDestroySampler(m_device, m_sampler, nullptr);
-    vkDestroyImageView(m_device, m_image_view, nullptr);
+    vkDestroySampler(m_device, m_sampler, memory::HostCallbacks(m_tag));
+    vkDestroyImageView(m_device, m_image_view, memory::HostCallbacks(m_tag));
     vmaDestroyImage(m_allocator, m_image, m_allocation);
+    memory::TrackDeviceFree(m_tag, m_allocation_size);
     m_init = false;
 }
 
+void Image::RecordUpload(VkCommandBuffer cmd, VkBuffer staging, std::span<const TextureData::Level> levels)
+{
+    assert(m_init);
+
+    const VkImage handle = m_image;
+    const VkExtent2D size = m_extent;
+    const u32 mip_levels = m_mip_levels;
+    const u32 copy_levels = static_cast<u32>(levels.size());
+
+    // Fresh contents need no source stage, only the copies and blits that follow wait
+    LayoutBarrier(cmd, handle, 0, mip_levels,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_NONE, VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT);
+
+    for (u32 level = 0; level < copy_levels; ++level) {
+        const VkExtent2D extent = mipmap::LevelExtent(size, level);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = levels[level].offset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageSubresource.mipLevel = level;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { extent.width, extent.height, 1 };
+
+        vkCmdCopyBufferToImage(cmd, staging, handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+
+    if (copy_levels == mip_levels) {
+        LayoutBarrier(cmd, handle, 0, mip_levels,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_PIPELINE_STAGE_2_COPY_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+
+        return;
+    }
+
+    // Copied levels other than the last are finished with straight away
+    if (copy_levels > 1) {
+        LayoutBarrier(cmd, handle, 0, copy_levels - 1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_PIPELINE_STAGE_2_COPY_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+    }
+
+    // Each level is read back as the source of the next, then finished with
+    for (u32 level = copy_levels; level < mip_levels; ++level) {
+        const VkExtent2D src_extent = mipmap::LevelExtent(size, level - 1);
+        const VkExtent2D dst_extent = mipmap::LevelExtent(size, level);
+
+        LayoutBarrier(cmd, handle, level - 1, 1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+            VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT, VK_PIPELINE_STAGE_2_BLIT_BIT);
+
+        VkImageBlit blit{};
+        blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+        blit.srcOffsets[1] = { static_cast<int32_t>(src_extent.width), static_cast<int32_t>(src_extent.height), 1 };
+        blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+        blit.dstOffsets[1] = { static_cast<int32_t>(dst_extent.width), static_cast<int32_t>(dst_extent.height), 1 };
+
+        vkCmdBlitImage(cmd, handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        // A read only has to finish before the layout changes, there is nothing to make available
+        LayoutBarrier(cmd, handle, level - 1, 1,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_2_NONE, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_PIPELINE_STAGE_2_BLIT_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+    }
+
+    LayoutBarrier(cmd, handle, mip_levels - 1, 1,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+        VK_PIPELINE_STAGE_2_BLIT_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+}
+
 } // namespace vker
\ No newline at end of file
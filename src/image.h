@@ -1,11 +1,14 @@
 #pragma once
 
 #include <cassert>
+#include <span>
 
 #include <vulkan/vulkan.h>
 
 #include "contrib/vk_mem_alloc.h"
 
+#include "memory.h"
+#include "texture_data.h"
 #include "types.h"
 
 namespace vker {
@@ -14,9 +17,13 @@ class Image {
 public:
 	Image() = default;
 
-	void Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFormat format, bool depth);
+	void Setup(VkDevice device, VmaAllocator allocator, VkExtent2D size, VkFormat format, u32 mip_levels, bool depth);
 	void Destroy();
 
+	// Copies the given levels from a staging buffer, then blits the remaining levels
+	// down from the last of them, leaving every level ready for fragment shader reads
+	void RecordUpload(VkCommandBuffer cmd, VkBuffer staging, std::span<const TextureData::Level> levels);
+
 	inline VkImage Handle()
 	{
 		assert(m_init);
@@ -35,16 +42,27 @@ public:
 		return m_sampler;
 	}
 
+	inline VkExtent2D Extent() const { return m_extent; }
+	inline VkFormat Format() const { return m_format; }
+	inline u32 MipLevels() const { return m_mip_levels; }
+
 private:
 	bool m_init = false;
 
 	VkDevice m_device;
 	VmaAllocator m_allocator;
 
+	VkExtent2D m_extent;
+	VkFormat m_format;
+	u32 m_mip_levels;
+
 	VkImage m_image;
 	VkImageView m_image_view;
 	VkSampler m_sampler;
 	VmaAllocation m_allocation;
+
+	memory::Tag m_tag;
+	VkDeviceSize m_allocation_size;
 };
 
 } // namespace vker
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "job_system.h"
+
+#include <array>
+#include <cassert>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "memory.h"
+
+namespace vker {
+
+// Only the owning thread pushes and pops at the bottom, any thread may steal from the top.
+// Full deques turn jobs away, which then go through the shared queue instead
+class JobSystem::Deque {
+public:
+    bool Push(Job *job)
+    {
+        const i64 bottom = m_bottom.load(std::memory_order_relaxed);
+        const i64 top = m_top.load(std::memory_order_acquire);
+
+        if (bottom - top >= static_cast<i64>(Capacity)) return false;
+
+        m_jobs[bottom & Mask].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    Job *Pop()
+    {
+        const i64 bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        i64 top = m_top.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job *job = m_jobs[bottom & Mask].load(std::memory_order_relaxed);
+
+        // The last job may be stolen at the same time, whoever moves the top first has it
+        if (top == bottom) {
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        return job;
+    }
+
+    // Fails spuriously when another thread takes the top job first, which sets contended
+    Job *Steal(bool& contended)
+    {
+        i64 top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const i64 bottom = m_bottom.load(std::memory_order_acquire);
+
+        if (top >= bottom) return nullptr;
+
+        Job *job = m_jobs[top & Mask].load(std::memory_order_relaxed);
+
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            contended = true;
+            return nullptr;
+        }
+
+        return job;
+    }
+
+private:
+    using i64 = std::int64_t;
+
+    static constexpr u32 Capacity = 4096;
+    static constexpr i64 Mask = Capacity - 1;
+
+    alignas(64) std::atomic<i64> m_top = 0;
+    alignas(64) std::atomic<i64> m_bottom = 0;
+    std::array<std::atomic<Job *>, Capacity> m_jobs{};
+};
+
+// Deque owned by the calling thread, in the system that owns it
+static thread_local const JobSystem *t_system = nullptr;
+static thread_local u32 t_slot;
+
+static void PinThread(u32 core)
+{
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+}
+
+JobSystem::JobSystem(u32 worker_count, bool pin_threads, bool main_thread_participates) :
+    m_main_thread{ std::this_thread::get_id() }, m_main_thread_participates{ main_thread_participates }
+{
+    // hardware_concurrency may report zero when it is unknown
+    const u32 cores = std::max(std::thread::hardware_concurrency(), 1u);
+    if (worker_count == 0) worker_count = std::max(cores - 1, 1u);
+
+    m_deques.reserve(worker_count + 1);
+    for (u32 i = 0; i <= worker_count; ++i) m_deques.push_back(std::make_unique<Deque>());
+
+    if (m_main_thread_participates) {
+        t_system = this;
+        t_slot = 0;
+    }
+
+    m_threads.reserve(worker_count);
+    for (u32 i = 1; i <= worker_count; ++i) m_threads.emplace_back(&JobSystem::WorkerLoop, this, i, pin_threads && i < cores);
+}
+
+JobSystem::~JobSystem()
+{
+    WaitIdle();
+
+    m_stopping.store(true, std::memory_order_release);
+    Signal();
+
+    for (auto& thread : m_threads) thread.join();
+
+    if (t_system == this) t_system = nullptr;
+}
+
+JobSystem::Job *JobSystem::AllocateJob()
+{
+    std::lock_guard lock{ m_free_mutex };
+
+    if (!m_free_jobs) {
+        // Growing the pool is a one-off, however busy the frame that needs it
+        memory::FrameAllocationPause pause;
+
+        auto& block = m_job_blocks.emplace_back(std::make_unique<Job[]>(JobBlockSize));
+
+        for (u32 i = 0; i < JobBlockSize; ++i) {
+            block[i].next = m_free_jobs;
+            m_free_jobs = &block[i];
+        }
+    }
+
+    Job *job = m_free_jobs;
+    m_free_jobs = job->next;
+
+    return job;
+}
+
+void JobSystem::FreeJob(Job *job)
+{
+    std::lock_guard lock{ m_free_mutex };
+
+    job->next = m_free_jobs;
+    m_free_jobs = job;
+}
+
+void JobSystem::Enqueue(Job *job, JobCounter *counter)
+{
+    if (counter) counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    m_all.m_pending.fetch_add(1, std::memory_order_relaxed);
+
+    job->counter = counter;
+    job->tag = memory::CurrentTag();
+    job->frame_allocations = memory::FrameAllocationsCounted();
+    job->next = nullptr;
+
+    Push(job);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    const u32 slot = CurrentSlot();
+
+    for (;;) {
+        // Read first, so a job finishing or being submitted after the checks still wakes the thread
+        const u32 epoch = m_epoch.load(std::memory_order_acquire);
+        if (counter.Done()) return;
+
+        if (slot != NoSlot) {
+            if (Job *job = FindJob(slot)) {
+                Run(job);
+                continue;
+            }
+        }
+
+        m_epoch.wait(epoch, std::memory_order_acquire);
+    }
+}
+
+void JobSystem::WaitIdle()
+{
+    Wait(m_all);
+}
+
+void JobSystem::Retain(JobCounter& counter)
+{
+    counter.m_pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobSystem::Release(JobCounter& counter)
+{
+    if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) Signal();
+}
+
+u32 JobSystem::ThreadIndex() const
+{
+    if (t_system == this) return t_slot;
+    return std::this_thread::get_id() == m_main_thread ? 0 : NoThread;
+}
+
+u32 JobSystem::CurrentSlot() const
+{
+    return t_system == this ? t_slot : NoSlot;
+}
+
+void JobSystem::WorkerLoop(u32 slot, bool pin)
+{
+    t_system = this;
+    t_slot = slot;
+
+    if (pin) PinThread(slot);
+
+    for (;;) {
+        const u32 epoch = m_epoch.load(std::memory_order_acquire);
+
+        if (Job *job = FindJob(slot)) {
+            Run(job);
+            continue;
+        }
+
+        if (m_stopping.load(std::memory_order_acquire)) return;
+        m_epoch.wait(epoch, std::memory_order_acquire);
+    }
+}
+
+void JobSystem::Push(Job *job)
+{
+    const u32 slot = CurrentSlot();
+
+    if (slot == NoSlot || !m_deques[slot]->Push(job)) {
+        std::lock_guard lock{ m_shared_mutex };
+
+        if (m_shared_tail) {
+            m_shared_tail->next = job;
+        } else {
+            m_shared_head = job;
+        }
+
+        m_shared_tail = job;
+        m_shared_count.fetch_add(1, std::memory_order_release);
+    }
+
+    Signal();
+}
+
+void JobSystem::Run(Job *job)
+{
+    {
+        memory::FrameAllocationScope frame{ job->frame_allocations };
+        memory::TagScope scope{ job->tag };
+
+        // Captures are released under the same tag and count as the job itself
+        job->invoke(job->storage);
+        job->destroy(job->storage);
+    }
+
+    JobCounter *counter = job->counter;
+    FreeJob(job);
+
+    // Counters may be gone as soon as they reach zero, so only the system is touched after
+    bool finished = counter && counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    finished |= m_all.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+
+    if (finished) Signal();
+}
+
+JobSystem::Job *JobSystem::FindJob(u32 slot)
+{
+    if (Job *job = m_deques[slot]->Pop()) return job;
+
+    if (m_shared_count.load(std::memory_order_acquire) != 0) {
+        std::lock_guard lock{ m_shared_mutex };
+
+        if (Job *job = m_shared_head) {
+            m_shared_head = job->next;
+            if (!m_shared_head) m_shared_tail = nullptr;
+            m_shared_count.fetch_sub(1, std::memory_order_relaxed);
+
+            return job;
+        }
+    }
+
+    // Starting from the next slot spreads thieves across the deques. Losing a race for a job means
+    // there may be more behind it, so the deques are walked again until none was contended
+    const u32 count = static_cast<u32>(m_deques.size());
+    bool contended = true;
+
+    while (contended) {
+        contended = false;
+
+        for (u32 i = 1; i < count; ++i) {
+            if (Job *job = m_deques[(slot + i) % count]->Steal(contended)) return job;
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::Signal()
+{
+    m_epoch.fetch_add(1, std::memory_order_release);
+    m_epoch.notify_all();
+}
+
+} // namespace vker
\ No newline at end of file
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+#include "types.h"
+
+namespace vker {
+
+// Jobs submitted against a counter hold it above zero until they have all finished
+class JobCounter {
+public:
+	JobCounter() = default;
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	inline bool Done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<u32> m_pending = 0;
+};
+
+// Worker threads that each own a Chase-Lev deque, pushing and popping their own jobs at
+// the bottom while idle workers steal from the top of the others'. The thread that creates
+// the system can own a deque as well, and runs jobs whenever it waits. Jobs submitted from
+// any other thread go through a shared queue. Jobs run with the memory tag that was current
+// on the thread that submitted them, and are counted against the frame only if it was
+class JobSystem {
+public:
+	// Zero workers starts one for every core besides the creating thread's. Pinned workers
+	// each stay on their own core, counting up from the core after the first
+	explicit JobSystem(u32 worker_count = 0, bool pin_threads = false, bool main_thread_participates = true);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Callables that fit in a job are stored in it, and jobs are recycled, so submitting stays
+	// off the heap once the pool has grown to the most jobs ever pending. Larger callables are boxed
+	template <typename F>
+	void Submit(F&& function, JobCounter *counter = nullptr)
+	{
+		using Function = std::decay_t<F>;
+
+		if constexpr (sizeof(Function) <= JobStorage && alignof(Function) <= alignof(std::max_align_t)) {
+			Job *job = AllocateJob();
+			new (job->storage) Function(std::forward<F>(function));
+			job->invoke = [](void *storage) { (*static_cast<Function *>(storage))(); };
+			job->destroy = [](void *storage) { static_cast<Function *>(storage)->~Function(); };
+
+			Enqueue(job, counter);
+		} else {
+			Submit([boxed = std::make_unique<Function>(std::forward<F>(function))] { (*boxed)(); }, counter);
+		}
+	}
+
+	// Blocks until the counter reaches zero. Threads that own a deque run jobs in the
+	// meantime, so jobs may submit more jobs and wait on them in turn
+	void Wait(JobCounter& counter);
+
+	// Blocks until every job submitted so far has finished
+	void WaitIdle();
+
+	// Holds the counter above zero for work that runs across several jobs without being one,
+	// such as a coroutine suspended between them, until the matching Release
+	void Retain(JobCounter& counter);
+	void Release(JobCounter& counter);
+
+	// Calls body(begin, end) over [0, count) in batches of at least min_batch items,
+	// with the first batch on the calling thread, and returns once every batch has run
+	template <typename F>
+	void ParallelFor(u32 count, u32 min_batch, F&& body)
+	{
+		if (count == 0) return;
+
+		// A few batches per thread evens out batches that take longer than others
+		const u32 batches = (WorkerCount() + 1) * 4;
+		const u32 batch = std::max({ min_batch, (count + batches - 1) / batches, 1u });
+
+		JobCounter counter;
+
+		for (u32 begin = batch; begin < count; begin += batch) {
+			const u32 end = std::min(begin + batch, count);
+			Submit([&body, begin, end] { body(begin, end); }, &counter);
+		}
+
+		body(0u, std::min(batch, count));
+		Wait(counter);
+	}
+
+	inline u32 WorkerCount() const { return static_cast<u32>(m_threads.size()); }
+
+	// Threads that can run jobs, which includes the creating thread, participating or not
+	inline u32 ThreadCount() const { return WorkerCount() + 1; }
+
+	// Zero on the creating thread and one onwards on the workers, so jobs can keep state per
+	// thread in ThreadCount() slots. Any other thread has no index
+	static constexpr u32 NoThread = UINT32_MAX;
+	u32 ThreadIndex() const;
+
+private:
+	// Enough for a handful of captured pointers and indices
+	static constexpr size_t JobStorage = 48;
+
+	// Jobs are allocated this many at a time, and every block lives as long as the system
+	static constexpr u32 JobBlockSize = 64;
+
+	struct Job {
+		alignas(std::max_align_t) std::byte storage[JobStorage];
+		void (*invoke)(void *storage);
+		void (*destroy)(void *storage);
+
+		JobCounter *counter;
+		memory::Tag tag;
+		bool frame_allocations;
+
+		// Links jobs in the free list and in the shared queue
+		Job *next;
+	};
+
+	class Deque;
+
+	// Deque slot of threads that do not own one
+	static constexpr u32 NoSlot = UINT32_MAX;
+
+	u32 CurrentSlot() const;
+
+	Job *AllocateJob();
+	void FreeJob(Job *job);
+
+	void Enqueue(Job *job, JobCounter *counter);
+
+	void WorkerLoop(u32 slot, bool pin);
+	void Push(Job *job);
+	void Run(Job *job);
+
+	// The thread's own deque first, then the shared queue, then the other deques
+	Job *FindJob(u32 slot);
+
+	// Wakes every thread sleeping on the epoch, to look for jobs or check their counters
+	void Signal();
+
+	// Slot zero belongs to the creating thread, and stays empty unless it participates
+	std::vector<std::unique_ptr<Deque>> m_deques;
+	std::vector<std::thread> m_threads;
+	std::thread::id m_main_thread;
+	bool m_main_thread_participates;
+
+	// Jobs from threads without a deque, first in first out
+	std::mutex m_shared_mutex;
+	Job *m_shared_head = nullptr;
+	Job *m_shared_tail = nullptr;
+	std::atomic<u32> m_shared_count = 0;
+
+	std::mutex m_free_mutex;
+	Job *m_free_jobs = nullptr;
+	std::vector<std::unique_ptr<Job[]>> m_job_blocks;
+
+	std::atomic<u32> m_epoch = 0;
+	std::atomic<bool> m_stopping = false;
+
+	// Every job that has not finished yet
+	JobCounter m_all;
+};
+
+} // namespace vker
\ No newline at end of file
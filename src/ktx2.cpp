@@ -0,0 +1,291 @@
+#include "ktx2.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "bc.h"
+#include "mipmap.h"
+#include "utils.h"
+
+namespace vker::ktx2 {
+
+namespace {
+
+constexpr u8 Identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+// All fields are little endian, which is assumed to match the host
+struct Header {
+    u8 identifier[12];
+    u32 vk_format;
+    u32 type_size;
+    u32 pixel_width;
+    u32 pixel_height;
+    u32 pixel_depth;
+    u32 layer_count;
+    u32 face_count;
+    u32 level_count;
+    u32 supercompression_scheme;
+
+    u32 dfd_byte_offset;
+    u32 dfd_byte_length;
+    u32 kvd_byte_offset;
+    u32 kvd_byte_length;
+    u64 sgd_byte_offset;
+    u64 sgd_byte_length;
+};
+
+static_assert(sizeof(Header) == 80);
+
+struct LevelIndex {
+    u64 byte_offset;
+    u64 byte_length;
+    u64 uncompressed_byte_length;
+};
+
+static_assert(sizeof(LevelIndex) == 24);
+
+// Khronos data format colour models
+constexpr u8 ModelRGBSDA = 1;
+constexpr u8 ModelBC1A = 128;
+constexpr u8 ModelBC3 = 130;
+constexpr u8 ModelBC5 = 132;
+constexpr u8 ModelBC7 = 134;
+
+constexpr u8 ChannelRed = 0;
+constexpr u8 ChannelGreen = 1;
+constexpr u8 ChannelBlue = 2;
+constexpr u8 ChannelAlpha = 15;
+
+struct Sample {
+    u16 bit_offset;
+    u8 bit_length;
+    u8 channel;
+    u32 upper;
+};
+
+// Bytes per texel for RGBA8, or per 4x4 block
+size_t BlockSize(VkFormat format)
+{
+    bc::Format bc_format;
+    return bc::FromVulkanFormat(format, bc_format) ? bc::BlockSize(bc_format) : 4;
+}
+
+size_t LevelSize(VkFormat format, VkExtent2D size)
+{
+    bc::Format bc_format;
+    if (bc::FromVulkanFormat(format, bc_format)) return bc::EncodedSize(bc_format, size);
+
+    return size_t(size.width) * size.height * 4;
+}
+
+void Put(std::vector<u8>& out, const void *data, size_t size)
+{
+    const u8 *bytes = static_cast<const u8 *>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+std::vector<u8> DataFormatDescriptor(VkFormat format)
+{
+    std::vector<Sample> samples;
+    u8 model;
+    u8 block_dimension;
+
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        model = ModelRGBSDA;
+        block_dimension = 0;
+        samples = { { 0, 7, ChannelRed, 255 }, { 8, 7, ChannelGreen, 255 }, { 16, 7, ChannelBlue, 255 }, { 24, 7, ChannelAlpha, 255 } };
+        break;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        model = ModelBC1A;
+        block_dimension = 3;
+        samples = { { 0, 63, ChannelRed, UINT32_MAX } };
+        break;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+        model = ModelBC3;
+        block_dimension = 3;
+        samples = { { 0, 63, ChannelAlpha, UINT32_MAX }, { 64, 63, ChannelRed, UINT32_MAX } };
+        break;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        model = ModelBC5;
+        block_dimension = 3;
+        samples = { { 0, 63, ChannelRed, UINT32_MAX }, { 64, 63, ChannelGreen, UINT32_MAX } };
+        break;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+        model = ModelBC7;
+        block_dimension = 3;
+        samples = { { 0, 127, ChannelRed, UINT32_MAX } };
+        break;
+    default:
+        FatalError("unsupported KTX2 format {}", static_cast<u32>(format));
+    }
+
+    const u32 block_size = 24 + 16 * static_cast<u32>(samples.size());
+    const u32 total_size = 4 + block_size;
+
+    // Vendor Khronos, type basic, version 1.3
+    const u32 vendor_type = 0;
+    const u32 version_size = 2 | (block_size << 16);
+
+    // BT.709 primaries, linear transfer, straight alpha
+    const u8 model_info[4] = { model, 1, 1, 0 };
+    const u8 dimensions[4] = { block_dimension, block_dimension, 0, 0 };
+    const u8 bytes_plane[8] = { static_cast<u8>(BlockSize(format)) };
+
+    std::vector<u8> dfd;
+    dfd.reserve(total_size);
+
+    Put(dfd, &total_size, 4);
+    Put(dfd, &vendor_type, 4);
+    Put(dfd, &version_size, 4);
+    Put(dfd, model_info, 4);
+    Put(dfd, dimensions, 4);
+    Put(dfd, bytes_plane, 8);
+
+    for (const auto& sample : samples) {
+        const u8 position[4] = {};
+        const u32 lower = 0;
+
+        Put(dfd, &sample.bit_offset, 2);
+        Put(dfd, &sample.bit_length, 1);
+        Put(dfd, &sample.channel, 1);
+        Put(dfd, position, 4);
+        Put(dfd, &lower, 4);
+        Put(dfd, &sample.upper, 4);
+    }
+
+    return dfd;
+}
+
+} // namespace
+
+TextureData ReadInfo(const std::filesystem::path& path)
+{
+    std::ifstream file{ path, std::ios::binary | std::ios::ate };
+    if (!file) FatalError("failed to open {}", path.string());
+
+    const size_t file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    Header header;
+    if (file_size < sizeof(header)) FatalError("{} is not a KTX2 file", path.string());
+
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (std::memcmp(header.identifier, Identifier, sizeof(Identifier)) != 0) FatalError("{} is not a KTX2 file", path.string());
+
+    TextureData texture;
+    texture.format = static_cast<VkFormat>(header.vk_format);
+    texture.size = { header.pixel_width, header.pixel_height };
+
+    bc::Format bc_format;
+    if (texture.format != VK_FORMAT_R8G8B8A8_UNORM && !bc::FromVulkanFormat(texture.format, bc_format)) {
+        FatalError("{} has unsupported format {}", path.string(), header.vk_format);
+    }
+
+    if (header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth != 0 || header.layer_count > 1 || header.face_count != 1) {
+        FatalError("{} is not a 2D texture", path.string());
+    }
+
+    if (header.supercompression_scheme != 0) FatalError("{} is supercompressed", path.string());
+
+    // A level count of zero asks for the chain to be generated, but only the base level is stored
+    const u32 level_count = std::max(header.level_count, 1u);
+    if (level_count > mipmap::LevelCount(texture.size)) FatalError("{} has too many levels", path.string());
+
+    if (file_size < sizeof(header) + level_count * sizeof(LevelIndex)) FatalError("{} is truncated", path.string());
+
+    std::vector<LevelIndex> index(level_count);
+    file.read(reinterpret_cast<char *>(index.data()), index.size() * sizeof(LevelIndex));
+
+    for (u32 level = 0; level < level_count; ++level) {
+        const size_t size = LevelSize(texture.format, mipmap::LevelExtent(texture.size, level));
+
+        if (index[level].byte_length != size || index[level].byte_offset > file_size || file_size - index[level].byte_offset < size) {
+            FatalError("{} level {} is malformed", path.string(), level);
+        }
+
+        texture.levels.push_back({ static_cast<size_t>(index[level].byte_offset), size });
+    }
+
+    return texture;
+}
+
+TextureData Read(const std::filesystem::path& path)
+{
+    TextureData texture = ReadInfo(path);
+
+    std::ifstream file{ path, std::ios::binary };
+    if (!file) FatalError("failed to open {}", path.string());
+
+    // Repack the levels one after another
+    for (auto& level : texture.levels) {
+        const size_t offset = texture.data.size();
+        texture.data.resize(offset + level.size);
+
+        file.seekg(level.offset);
+        file.read(reinterpret_cast<char *>(texture.data.data() + offset), level.size);
+        if (!file) FatalError("failed to read {}", path.string());
+
+        level.offset = offset;
+    }
+
+    return texture;
+}
+
+void ReadRange(const std::filesystem::path& path, size_t offset, size_t size, u8 *out)
+{
+    std::ifstream file{ path, std::ios::binary };
+    file.seekg(offset);
+    file.read(reinterpret_cast<char *>(out), size);
+
+    if (!file) FatalError("failed to read {}", path.string());
+}
+
+void Write(const std::filesystem::path& path, const TextureData& texture)
+{
+    const u32 level_count = texture.MipLevels();
+    const std::vector<u8> dfd = DataFormatDescriptor(texture.format);
+
+    Header header{};
+    std::memcpy(header.identifier, Identifier, sizeof(Identifier));
+    header.vk_format = texture.format;
+    header.type_size = 1;
+    header.pixel_width = texture.size.width;
+    header.pixel_height = texture.size.height;
+    header.face_count = 1;
+    header.level_count = level_count;
+    header.dfd_byte_offset = static_cast<u32>(sizeof(header) + level_count * sizeof(LevelIndex));
+    header.dfd_byte_length = static_cast<u32>(dfd.size());
+
+    // Levels are stored smallest first, each aligned to the block size (and at least 4)
+    const size_t alignment = std::max<size_t>(BlockSize(texture.format), 4);
+
+    std::vector<LevelIndex> index(level_count);
+    size_t offset = header.dfd_byte_offset + dfd.size();
+
+    for (u32 level = level_count; level-- > 0;) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+
+        const size_t size = texture.levels[level].size;
+        index[level] = { offset, size, size };
+        offset += size;
+    }
+
+    std::vector<u8> bytes(offset);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + sizeof(header), index.data(), index.size() * sizeof(LevelIndex));
+    std::memcpy(bytes.data() + header.dfd_byte_offset, dfd.data(), dfd.size());
+
+    for (u32 level = 0; level < level_count; ++level) {
+        std::memcpy(bytes.data() + index[level].byte_offset, texture.LevelData(level), texture.levels[level].size);
+    }
+
+    std::ofstream file{ path, std::ios::binary };
+    if (!file) FatalError("failed to open {} for writing", path.string());
+
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    if (!file) FatalError("failed to write {}", path.string());
+}
+
+} // namespace vker::ktx2
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <filesystem>
+
+#include "texture_data.h"
+
+namespace vker::ktx2 {
+
+// Only 2D textures without supercompression are supported, in RGBA8 or one of
+// the bc::Format block formats. Malformed or unsupported files are fatal errors
+TextureData Read(const std::filesystem::path& path);
+
+// Reads only the header and level index, leaving data empty and each
+// level's offset pointing into the file instead
+TextureData ReadInfo(const std::filesystem::path& path);
+
+// Reads part of a level located by ReadInfo straight into out
+void ReadRange(const std::filesystem::path& path, size_t offset, size_t size, u8 *out);
+void Write(const std::filesystem::path& path, const TextureData& texture);
+
+} // namespace vker::ktx2
\ No newline at end of file
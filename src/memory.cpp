@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <string>
+
+#include <fmt/core.h>
+
+#include <vulkan/vulkan.h>
+
+#include "contrib/vk_mem_alloc.h"
+
+#include "memory.h"
+#include "types.h"
+
+namespace vker::memory {
+
+namespace {
+
+constexpr size_t TagCount = static_cast<size_t>(Tag::Count);
+
+struct Counters {
+    std::atomic<u64> host_current;
+    std::atomic<u64> host_peak;
+    std::atomic<u64> host_allocations;
+    std::atomic<u64> host_allocated;
+
+    std::atomic<u64> device_current;
+    std::atomic<u64> device_peak;
+};
+
+std::array<Counters, TagCount> g_counters;
+std::array<std::atomic<u64>, VK_MAX_MEMORY_TYPES> g_device_memory_types;
+
+thread_local Tag t_current_tag = Tag::Untagged;
+
+std::atomic<u64> g_frame_allocations;
+thread_local bool t_frame_counting = false;
+thread_local u32 t_frame_pause_depth = 0;
+
+inline void CountFrameAllocation()
+{
+    if (t_frame_counting && t_frame_pause_depth == 0) {
+        g_frame_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Stored immediately before every tracked allocation
+struct AllocationHeader {
+    void *base;
+    size_t size;
+    Tag tag;
+};
+
+inline void UpdatePeak(std::atomic<u64>& peak, u64 value)
+{
+    u64 current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+inline AllocationHeader *HeaderOf(void *ptr)
+{
+    return reinterpret_cast<AllocationHeader *>(static_cast<u8 *>(ptr) - sizeof(AllocationHeader));
+}
+
+void * VKAPI_CALL VkAllocate(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+    return Allocate(size, alignment, static_cast<Tag>(reinterpret_cast<uintptr_t>(user_data)));
+}
+
+void * VKAPI_CALL VkReallocate(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    if (!original) return VkAllocate(user_data, size, alignment, scope);
+
+    if (size == 0) {
+        Free(original);
+        return nullptr;
+    }
+
+    void *ptr = VkAllocate(user_data, size, alignment, scope);
+    if (!ptr) return nullptr;
+
+    std::memcpy(ptr, original, std::min(size, HeaderOf(original)->size));
+    Free(original);
+
+    return ptr;
+}
+
+void VKAPI_CALL VkFree(void *, void *ptr)
+{
+    Free(ptr);
+}
+
+// Memory the driver allocates itself and only tells us about
+void VKAPI_CALL VkInternalAllocation(void *, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+    Counters& counters = g_counters[static_cast<size_t>(Tag::Driver)];
+
+    const u64 current = counters.host_current.fetch_add(size, std::memory_order_relaxed) + size;
+    counters.host_allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.host_allocated.fetch_add(size, std::memory_order_relaxed);
+    UpdatePeak(counters.host_peak, current);
+}
+
+void VKAPI_CALL VkInternalFree(void *, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+    g_counters[static_cast<size_t>(Tag::Driver)].host_current.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void VKAPI_CALL VmaAllocateDeviceMemory(VmaAllocator, u32 memory_type, VkDeviceMemory, VkDeviceSize size)
+{
+    g_device_memory_types[memory_type].fetch_add(size, std::memory_order_relaxed);
+}
+
+void VKAPI_CALL VmaFreeDeviceMemory(VmaAllocator, u32 memory_type, VkDeviceMemory, VkDeviceSize size)
+{
+    g_device_memory_types[memory_type].fetch_sub(size, std::memory_order_relaxed);
+}
+
+struct Snapshot {
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    std::array<u64, TagCount> allocations{};
+    std::array<u64, TagCount> allocated{};
+};
+
+Snapshot g_last_report;
+
+std::string FormatBytes(u64 bytes)
+{
+    if (bytes >= 1024 * 1024) return fmt::format("{:.2f} MiB", bytes / (1024.0 * 1024.0));
+    if (bytes >= 1024) return fmt::format("{:.2f} KiB", bytes / 1024.0);
+    return fmt::format("{} B", bytes);
+}
+
+} // namespace
+
+const char *TagName(Tag tag)
+{
+    switch (tag) {
+    case Tag::Untagged:      return "untagged";
+    case Tag::Loader:        return "loader";
+    case Tag::Models:        return "models";
+    case Tag::Textures:      return "textures";
+    case Tag::RenderTargets: return "render targets";
+    case Tag::Pipelines:     return "pipelines";
+    case Tag::Renderer:      return "renderer";
+    case Tag::Frame:         return "frame arenas";
+    case Tag::Allocator:     return "allocator";
+    case Tag::Driver:        return "driver";
+    default:                 return "unknown";
+    }
+}
+
+TagScope::TagScope(Tag tag) : m_previous{t_current_tag}
+{
+    t_current_tag = tag;
+}
+
+TagScope::~TagScope()
+{
+    t_current_tag = m_previous;
+}
+
+Tag CurrentTag()
+{
+    return t_current_tag;
+}
+
+void *Allocate(size_t size, size_t alignment, Tag tag)
+{
+    alignment = std::max(alignment, alignof(std::max_align_t));
+
+    // Over-allocate so that the header always fits in front of the aligned block
+    void *base = std::malloc(size + sizeof(AllocationHeader) + alignment);
+    if (!base) return nullptr;
+
+    const uintptr_t start = reinterpret_cast<uintptr_t>(base) + sizeof(AllocationHeader);
+    void *ptr = reinterpret_cast<void *>((start + alignment - 1) & ~(uintptr_t(alignment) - 1));
+
+    AllocationHeader *header = HeaderOf(ptr);
+    header->base = base;
+    header->size = size;
+    header->tag = tag;
+
+    Counters& counters = g_counters[static_cast<size_t>(tag)];
+
+    const u64 current = counters.host_current.fetch_add(size, std::memory_order_relaxed) + size;
+    counters.host_allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.host_allocated.fetch_add(size, std::memory_order_relaxed);
+    UpdatePeak(counters.host_peak, current);
+
+    return ptr;
+}
+
+void Free(void *ptr)
+{
+    if (!ptr) return;
+
+    const AllocationHeader *header = HeaderOf(ptr);
+    g_counters[static_cast<size_t>(header->tag)].host_current.fetch_sub(header->size, std::memory_order_relaxed);
+
+    std::free(header->base);
+}
+
+void BeginFrameAllocationCount()
+{
+    g_frame_allocations.store(0, std::memory_order_relaxed);
+    t_frame_counting = true;
+}
+
+u64 EndFrameAllocationCount()
+{
+    t_frame_counting = false;
+    return g_frame_allocations.load(std::memory_order_relaxed);
+}
+
+FrameAllocationPause::FrameAllocationPause()
+{
+    t_frame_pause_depth++;
+}
+
+FrameAllocationPause::~FrameAllocationPause()
+{
+    t_frame_pause_depth--;
+}
+
+bool FrameAllocationsCounted()
+{
+    return t_frame_counting && t_frame_pause_depth == 0;
+}
+
+FrameAllocationScope::FrameAllocationScope(bool counted) : m_previous_counting{t_frame_counting}, m_previous_pause_depth{t_frame_pause_depth}
+{
+    t_frame_counting = counted;
+    t_frame_pause_depth = 0;
+}
+
+FrameAllocationScope::~FrameAllocationScope()
+{
+    t_frame_counting = m_previous_counting;
+    t_frame_pause_depth = m_previous_pause_depth;
+}
+
+const VkAllocationCallbacks *HostCallbacks(Tag tag)
+{
+    static const auto callbacks = [] {
+        std::array<VkAllocationCallbacks, TagCount> callbacks{};
+
+        for (size_t i = 0; i < TagCount; ++i) {
+            callbacks[i].pUserData = reinterpret_cast<void *>(i);
+            callbacks[i].pfnAllocation = &VkAllocate;
+            callbacks[i].pfnReallocation = &VkReallocate;
+            callbacks[i].pfnFree = &VkFree;
+            callbacks[i].pfnInternalAllocation = &VkInternalAllocation;
+            callbacks[i].pfnInternalFree = &VkInternalFree;
+        }
+
+        return callbacks;
+    }();
+
+    return &callbacks[static_cast<size_t>(tag)];
+}
+
+const VmaDeviceMemoryCallbacks *DeviceCallbacks()
+{
+    static const VmaDeviceMemoryCallbacks callbacks = { &VmaAllocateDeviceMemory, &VmaFreeDeviceMemory };
+    return &callbacks;
+}
+
+void TrackDeviceAllocation(Tag tag, VkDeviceSize size)
+{
+    Counters& counters = g_counters[static_cast<size_t>(tag)];
+
+    const u64 current = counters.device_current.fetch_add(size, std::memory_order_relaxed) + size;
+    UpdatePeak(counters.device_peak, current);
+}
+
+void TrackDeviceFree(Tag tag, VkDeviceSize size)
+{
+    g_counters[static_cast<size_t>(tag)].device_current.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void Report(std::FILE *file)
+{
+    Snapshot snapshot;
+
+    const double seconds = std::chrono::duration<double>(snapshot.time - g_last_report.time).count();
+
+    fmt::print(file, "{:<16}{:>14}{:>14}{:>14}{:>14}{:>12}{:>14}\n",
+        "tag", "host", "host peak", "device", "device peak", "allocs/s", "bytes/s");
+
+    for (size_t i = 0; i < TagCount; ++i) {
+        const Counters& counters = g_counters[i];
+
+        snapshot.allocations[i] = counters.host_allocations.load(std::memory_order_relaxed);
+        snapshot.allocated[i] = counters.host_allocated.load(std::memory_order_relaxed);
+
+        const double allocation_rate = (snapshot.allocations[i] - g_last_report.allocations[i]) / seconds;
+        const double byte_rate = (snapshot.allocated[i] - g_last_report.allocated[i]) / seconds;
+
+        fmt::print(file, "{:<16}{:>14}{:>14}{:>14}{:>14}{:>12.1f}{:>14}\n",
+            TagName(static_cast<Tag>(i)),
+            FormatBytes(counters.host_current.load(std::memory_order_relaxed)),
+            FormatBytes(counters.host_peak.load(std::memory_order_relaxed)),
+            FormatBytes(counters.device_current.load(std::memory_order_relaxed)),
+            FormatBytes(counters.device_peak.load(std::memory_order_relaxed)),
+            allocation_rate,
+            FormatBytes(static_cast<u64>(byte_rate)));
+    }
+
+    // Whole VkDeviceMemory blocks, which VMA sub-allocates resources from
+    for (u32 i = 0; i < VK_MAX_MEMORY_TYPES; ++i) {
+        const u64 bytes = g_device_memory_types[i].load(std::memory_order_relaxed);
+        if (bytes != 0) fmt::print(file, "memory type {}: {} in device memory blocks\n", i, FormatBytes(bytes));
+    }
+
+    g_last_report = snapshot;
+}
+
+bool DumpToFile(const std::filesystem::path& path)
+{
+    std::FILE *file = std::fopen(path.string().c_str(), "w");
+
+    if (!file) {
+        fmt::print(stderr, "unable to open memory report {}\n", path.string());
+        return false;
+    }
+
+    Report(file);
+    std::fclose(file);
+
+    fmt::print("memory report written to {}\n", path.string());
+    return true;
+}
+
+} // namespace vker::memory
+
+// Every global heap allocation is attributed to the calling thread's current tag
+
+namespace vker::memory {
+
+inline void *GlobalNew(size_t size, size_t alignment)
+{
+    CountFrameAllocation();
+    return Allocate(size, alignment, CurrentTag());
+}
+
+} // namespace vker::memory
+
+using vker::memory::Free;
+using vker::memory::GlobalNew;
+
+void *operator new(std::size_t size)
+{
+    void *ptr = GlobalNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    if (!ptr) throw std::bad_alloc{};
+    return ptr;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    void *ptr = GlobalNew(size, static_cast<std::size_t>(alignment));
+    if (!ptr) throw std::bad_alloc{};
+    return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return GlobalNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return GlobalNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return GlobalNew(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return GlobalNew(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept { Free(ptr); }
+void operator delete[](void *ptr) noexcept { Free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { Free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { Free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { Free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { Free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { Free(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { Free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t&) noexcept { Free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept { Free(ptr); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t&) noexcept { Free(ptr); }
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t&) noexcept { Free(ptr); }
\ No newline at end of file
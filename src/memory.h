@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <new>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "contrib/vk_mem_alloc.h"
+
+#include "types.h"
+
+namespace vker::memory {
+
+enum class Tag : u32 {
+	Untagged,
+	Loader,
+	Models,
+	Textures,
+	RenderTargets,
+	Pipelines,
+	Renderer,
+	Frame,
+	Allocator,
+	Driver,
+	Count
+};
+
+const char *TagName(Tag tag);
+
+// Attributes global heap allocations made by the calling thread to a
+// tag for as long as the scope is alive
+class TagScope {
+public:
+	explicit TagScope(Tag tag);
+	~TagScope();
+
+	TagScope(const TagScope&) = delete;
+	TagScope& operator=(const TagScope&) = delete;
+
+private:
+	Tag m_previous;
+};
+
+Tag CurrentTag();
+
+void *Allocate(size_t size, size_t alignment, Tag tag);
+void Free(void *ptr);
+
+// Counts global operator new calls made by the calling thread between Begin and End, and by
+// jobs it submits in between, so that the frame loop can verify it stays off the heap
+void BeginFrameAllocationCount();
+u64 EndFrameAllocationCount();
+
+// Excludes the calling thread's allocations from the frame count
+class FrameAllocationPause {
+public:
+	FrameAllocationPause();
+	~FrameAllocationPause();
+
+	FrameAllocationPause(const FrameAllocationPause&) = delete;
+	FrameAllocationPause& operator=(const FrameAllocationPause&) = delete;
+};
+
+// Whether the calling thread's allocations are currently counted against the frame
+bool FrameAllocationsCounted();
+
+// Counts the calling thread's allocations against the frame or not, whatever it did
+// before, until destroyed. Jobs run inside one for the thread that submitted them
+class FrameAllocationScope {
+public:
+	explicit FrameAllocationScope(bool counted);
+	~FrameAllocationScope();
+
+	FrameAllocationScope(const FrameAllocationScope&) = delete;
+	FrameAllocationScope& operator=(const FrameAllocationScope&) = delete;
+
+private:
+	bool m_previous_counting;
+	u32 m_previous_pause_depth;
+};
+
+// Vulkan objects must be destroyed with the same callbacks they were created with
+const VkAllocationCallbacks *HostCallbacks(Tag tag);
+const VmaDeviceMemoryCallbacks *DeviceCallbacks();
+
+void TrackDeviceAllocation(Tag tag, VkDeviceSize size);
+void TrackDeviceFree(Tag tag, VkDeviceSize size);
+
+// Prints current usage, peak usage and the allocation rate since the previous report
+void Report(std::FILE *file = stdout);
+bool DumpToFile(const std::filesystem::path& path);
+
+template <typename T, Tag tag>
+struct TaggedAllocator {
+	using value_type = T;
+
+	template <typename U>
+	struct rebind {
+		using other = TaggedAllocator<U, tag>;
+	};
+
+	TaggedAllocator() = default;
+
+	template <typename U>
+	TaggedAllocator(const TaggedAllocator<U, tag>&) {}
+
+	inline T *allocate(size_t n)
+	{
+		return static_cast<T *>(Allocate(n * sizeof(T), alignof(T), tag));
+	}
+
+	inline void deallocate(T *ptr, size_t) { Free(ptr); }
+
+	template <typename U>
+	inline bool operator==(const TaggedAllocator<U, tag>&) const { return true; }
+};
+
+template <typename T, Tag tag>
+using TaggedVector = std::vector<T, TaggedAllocator<T, tag>>;
+
+} // namespace vker::memory
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+#include <vulkan/vulkan.h>
+
+#include "mipmap.h"
+#include "types.h"
+
+namespace vker::mipmap {
+
+u32 LevelCount(VkExtent2D size)
+{
+    return std::bit_width(std::max(size.width, size.height));
+}
+
+VkExtent2D LevelExtent(VkExtent2D size, u32 level)
+{
+    return { std::max(size.width >> level, 1u), std::max(size.height >> level, 1u) };
+}
+
+size_t ChainSize(VkExtent2D size, u32 levels)
+{
+    return LevelOffset(size, levels);
+}
+
+size_t LevelOffset(VkExtent2D size, u32 level)
+{
+    size_t offset = 0;
+
+    for (u32 i = 0; i < level; ++i) {
+        const VkExtent2D extent = LevelExtent(size, i);
+        offset += size_t(extent.width) * extent.height * 4;
+    }
+
+    return offset;
+}
+
+void GenerateRGBA8(u8 *chain, VkExtent2D size, u32 levels)
+{
+    assert(levels <= LevelCount(size));
+
+    for (u32 level = 1; level < levels; ++level) {
+        const VkExtent2D src_extent = LevelExtent(size, level - 1);
+        const VkExtent2D dst_extent = LevelExtent(size, level);
+
+        const u8 *src = chain + LevelOffset(size, level - 1);
+        u8 *dst = chain + LevelOffset(size, level);
+
+        // A dimension which is already 1 texel wide is not halved, so reuse the same texel
+        const u32 step_x = src_extent.width > 1 ? 1 : 0;
+        const u32 step_y = src_extent.height > 1 ? 1 : 0;
+
+        for (u32 y = 0; y < dst_extent.height; ++y) {
+            const u8 *row0 = src + size_t(y * 2) * src_extent.width * 4;
+            const u8 *row1 = row0 + size_t(step_y) * src_extent.width * 4;
+
+            for (u32 x = 0; x < dst_extent.width; ++x) {
+                const u32 x0 = x * 2 * 4;
+                const u32 x1 = x0 + step_x * 4;
+
+                for (u32 c = 0; c < 4; ++c) {
+                    const u32 sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                    dst[(size_t(y) * dst_extent.width + x) * 4 + c] = static_cast<u8>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+} // namespace vker::mipmap
\ No newline at end of file
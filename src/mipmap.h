@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "types.h"
+
+namespace vker::mipmap {
+
+// Number of levels in a full chain, down to and including 1x1
+u32 LevelCount(VkExtent2D size);
+VkExtent2D LevelExtent(VkExtent2D size, u32 level);
+
+// Bytes needed for levels [0, levels) of an RGBA8 image packed one after another
+size_t ChainSize(VkExtent2D size, u32 levels);
+size_t LevelOffset(VkExtent2D size, u32 level);
+
+// Box filters levels [1, levels) of a packed RGBA8 chain, level 0 must already be filled in
+void GenerateRGBA8(u8 *chain, VkExtent2D size, u32 levels);
+
+} // namespace vker::mipmap
\ No newline at end of file
@@ -1,7 +1,12 @@
+#include <algorithm>
 #include <cassert>
+#include <limits>
+
+#include <glm/geometric.hpp>
 
 #include "contrib/vk_mem_alloc.h"
 
+#include "memory.h"
 #include "model.h"
 
 namespace vker {
@@ -19,19 +24,35 @@ Model::~Model()
 void Model::BuildBuffers()
 {
     const size_t indices_size = indices.size() * sizeof(indices[0]);
-    m_index_buffer.Setup(m_allocator, indices_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_index_buffer.Setup(m_allocator, indices_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Models);
 
     void* address = m_index_buffer.Map();
     std::memcpy(address, indices.data(), indices_size);
     m_index_buffer.Unmap();
 
     const size_t vertices_size = vertices.size() * sizeof(vertices[0]);
-    m_vertex_buffer.Setup(m_allocator, vertices_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_vertex_buffer.Setup(m_allocator, vertices_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Models);
 
     address = m_vertex_buffer.Map();
     std::memcpy(address, vertices.data(), vertices_size);
     m_vertex_buffer.Unmap();
 
+    // Centred on the bounding box, which is loose but cheap
+    glm::vec3 min{ std::numeric_limits<float>::max() };
+    glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+    for (const auto& vertex : vertices) {
+        min = glm::min(min, vertex.pos);
+        max = glm::max(max, vertex.pos);
+    }
+
+    m_bounds_center = vertices.empty() ? glm::vec3{} : (min + max) * 0.5f;
+    m_bounds_radius = 0.0f;
+
+    for (const auto& vertex : vertices) {
+        m_bounds_radius = std::max(m_bounds_radius, glm::distance(m_bounds_center, vertex.pos));
+    }
+
     m_buffers_built = true;
 }
 
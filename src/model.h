@@ -2,12 +2,14 @@
 
 #include <vector>
 
+#include <glm/vec3.hpp>
+
 #include <vulkan/vulkan.h>
 
 #include "contrib/vk_mem_alloc.h"
 
 #include "buffer.h"
-#include "image.h"
+#include "memory.h"
 #include "types.h"
 #include "vertex.h"
 
@@ -24,8 +26,15 @@ public:
 
     void Draw(VkCommandBuffer cmd) const;
 
-    std::vector<u32> indices;
-    std::vector<Vertex> vertices;
+    // Sphere around the vertices, valid once the buffers are built
+    inline glm::vec3 BoundsCenter() const { return m_bounds_center; }
+    inline float BoundsRadius() const { return m_bounds_radius; }
+
+    memory::TaggedVector<u32, memory::Tag::Models> indices;
+    memory::TaggedVector<Vertex, memory::Tag::Models> vertices;
+
+    // Texture returned by Renderer::CreateTexture, zero is plain white
+    u32 texture_id = 0;
 
 private:
     VmaAllocator m_allocator = VK_NULL_HANDLE;
@@ -33,7 +42,9 @@ private:
     bool m_buffers_built = false;
     Buffer m_index_buffer;
     Buffer m_vertex_buffer;
-    Image m_texture;
+
+    glm::vec3 m_bounds_center{};
+    float m_bounds_radius = 0.0f;
 };
 
 } // namespace vker
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace vker {
+
+// Unbounded queue from any number of producer threads to one consumer thread, without locks.
+// Items are linked in as nodes, where a push is a single exchange on the head, and the consumer
+// unlinks from the tail. The node last popped stays behind as the tail until the next pop
+template <typename T>
+class MpscQueue {
+public:
+	MpscQueue() = default;
+
+	~MpscQueue()
+	{
+		while (TryPop()) {}
+		if (m_tail != &m_stub) delete m_tail;
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	// Any thread, never blocks
+	void Push(T item)
+	{
+		Node *node = new Node{ std::move(item) };
+
+		// Until the previous head links to it, the consumer sees the queue end before this node
+		Node *previous = m_head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+
+	// Consumer only. Items pushed but not linked in yet are left for the next call
+	std::optional<T> TryPop()
+	{
+		Node *tail = m_tail;
+		Node *next = tail->next.load(std::memory_order_acquire);
+
+		if (!next) return std::nullopt;
+
+		std::optional<T> item{ std::move(next->item) };
+		next->item.reset();
+
+		m_tail = next;
+		if (tail != &m_stub) delete tail;
+
+		return item;
+	}
+
+private:
+	struct Node {
+		std::optional<T> item;
+		std::atomic<Node *> next = nullptr;
+	};
+
+	Node m_stub;
+	alignas(64) std::atomic<Node *> m_head = &m_stub;
+	alignas(64) Node *m_tail = &m_stub;
+};
+
+} // namespace vker
\ No newline at end of file
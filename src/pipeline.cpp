@@ -1,5 +1,8 @@
+#include <algorithm>
+
 #include <vulkan/vulkan.h>
 
+#include "memory.h"
 #include "pipeline.h"
 #include "types.h"
 #include "utils.h"
@@ -62,6 +65,17 @@ void PipelineBuilder::AddScissor(VkRect2D scissor)
     m_scissors.push_back(scissor);
 }
 
+void PipelineBuilder::AddDynamicState(VkDynamicState state)
+{
+    m_dynamic_states.push_back(state);
+}
+
+void PipelineBuilder::SetAttachmentFormats(VkFormat color, VkFormat depth)
+{
+    m_color_format = color;
+    m_depth_format = depth;
+}
+
 VkPipeline PipelineBuilder::Build(VkDevice device, VkPipelineLayout layout, VkRenderPass pass)
 {
     VkPipelineVertexInputStateCreateInfo vertex_input{};
@@ -74,10 +88,22 @@ VkPipeline PipelineBuilder::Build(VkDevice device, VkPipelineLayout layout, VkRe
     VkPipelineViewportStateCreateInfo viewport{};
     viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 
-    viewport.viewportCount = static_cast<u32>(m_viewports.size());
-    viewport.pViewports = m_viewports.data();
-    viewport.scissorCount = static_cast<u32>(m_scissors.size());
-    viewport.pScissors = m_scissors.data();
+    const auto dynamic = [&](VkDynamicState state) {
+        return std::find(m_dynamic_states.begin(), m_dynamic_states.end(), state) != m_dynamic_states.end();
+    };
+
+    const bool dynamic_viewport = dynamic(VK_DYNAMIC_STATE_VIEWPORT);
+    const bool dynamic_scissor = dynamic(VK_DYNAMIC_STATE_SCISSOR);
+
+    viewport.viewportCount = std::max(static_cast<u32>(m_viewports.size()), dynamic_viewport ? 1u : 0u);
+    viewport.pViewports = dynamic_viewport ? nullptr : m_viewports.data();
+    viewport.scissorCount = std::max(static_cast<u32>(m_scissors.size()), dynamic_scissor ? 1u : 0u);
+    viewport.pScissors = dynamic_scissor ? nullptr : m_scissors.data();
+
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = static_cast<u32>(m_dynamic_states.size());
+    dynamic_state.pDynamicStates = m_dynamic_states.data();
 
     // TODO
     VkPipelineRasterizationStateCreateInfo rasterization{};
@@ -151,8 +177,15 @@ VkPipeline PipelineBuilder::Build(VkDevice device, VkPipelineLayout layout, VkRe
     color_blend.blendConstants[2] = 0.0f;
     color_blend.blendConstants[3] = 0.0f;
 
+    VkPipelineRenderingCreateInfo rendering{};
+    rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    rendering.colorAttachmentCount = m_color_format != VK_FORMAT_UNDEFINED ? 1 : 0;
+    rendering.pColorAttachmentFormats = &m_color_format;
+    rendering.depthAttachmentFormat = m_depth_format;
+
     VkGraphicsPipelineCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    create_info.pNext = pass == VK_NULL_HANDLE ? &rendering : nullptr;
     create_info.stageCount = static_cast<u32>(m_shaders.size());
     create_info.pStages = m_shaders.data();
     create_info.pVertexInputState = &vertex_input;
@@ -163,7 +196,7 @@ VkPipeline PipelineBuilder::Build(VkDevice device, VkPipelineLayout layout, VkRe
     create_info.pMultisampleState = &multisample;
     create_info.pDepthStencilState = &depth_stencil;
     create_info.pColorBlendState = &color_blend;
-    create_info.pDynamicState = nullptr;
+    create_info.pDynamicState = m_dynamic_states.empty() ? nullptr : &dynamic_state;
     create_info.layout = layout;
     create_info.renderPass = pass;
     create_info.subpass = 0;
@@ -171,7 +204,7 @@ VkPipeline PipelineBuilder::Build(VkDevice device, VkPipelineLayout layout, VkRe
     create_info.basePipelineIndex = 0;
 
     VkPipeline pipeline;
-    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &create_info, nullptr, &pipeline));
+    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &create_info, memory::HostCallbacks(memory::Tag::Pipelines), &pipeline));
 
     return pipeline;
 }
@@ -201,7 +234,7 @@ VkPipelineLayout PipelineLayoutBuilder::Build(VkDevice device)
     create_info.pPushConstantRanges = m_push_constants.data();
 
     VkPipelineLayout layout;
-    VK_CHECK(vkCreatePipelineLayout(device, &create_info, nullptr, &layout));
+    VK_CHECK(vkCreatePipelineLayout(device, &create_info, memory::HostCallbacks(memory::Tag::Pipelines), &layout));
 
     return layout;
 }
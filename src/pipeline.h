@@ -22,6 +22,14 @@ public:
     void AddViewport(VkViewport viewport);
     void AddScissor(VkRect2D scissor);
 
+    // Dynamic viewports and scissors are set when recording, one of each unless
+    // more were added, so the pipeline does not depend on the render size
+    void AddDynamicState(VkDynamicState state);
+
+    // Only used when building without a render pass, for dynamic rendering
+    void SetAttachmentFormats(VkFormat color, VkFormat depth);
+
+	// A null render pass builds the pipeline for dynamic rendering to the attachment formats
 	VkPipeline Build(VkDevice device, VkPipelineLayout layout, VkRenderPass pass);
 
 private:
@@ -35,6 +43,11 @@ private:
     std::vector<VkViewport> m_viewports;
     std::vector<VkRect2D> m_scissors;
 
+    std::vector<VkDynamicState> m_dynamic_states;
+
+    VkFormat m_color_format = VK_FORMAT_UNDEFINED;
+    VkFormat m_depth_format = VK_FORMAT_UNDEFINED;
+
     std::vector<VkDescriptorSetLayout> m_descriptor_sets;
     std::vector<VkPushConstantRange> m_push_constant_ranges;
 };
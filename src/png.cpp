@@ -0,0 +1,667 @@
+#include "png.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// VKER_PNG_NO_SIMD forces the scalar unfilters, so tests can cover them on any target
+#if !defined(VKER_PNG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VKER_PNG_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace vker::png {
+
+namespace {
+
+constexpr u8 Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+enum ColourType : u8 {
+    Grey = 0,
+    RGB = 2,
+    Palette = 3,
+    GreyAlpha = 4,
+    RGBA = 6,
+};
+
+inline u32 ReadBE32(const u8 *data)
+{
+    return (u32(data[0]) << 24) | (u32(data[1]) << 16) | (u32(data[2]) << 8) | data[3];
+}
+
+inline bool ChunkIs(const u8 *type, const char *name)
+{
+    return std::memcmp(type, name, 4) == 0;
+}
+
+// Least significant bit first, as deflate packs its bit stream
+class BitReader {
+public:
+    explicit BitReader(std::span<const u8> data) : m_data{data} {}
+
+    inline void Refill()
+    {
+        if (m_position + 8 <= m_data.size()) {
+            // Whole word load: bytes past the count are re-read identically on the next refill
+            u64 word;
+            std::memcpy(&word, m_data.data() + m_position, 8);
+
+            m_bits |= word << m_count;
+            m_position += (63 - m_count) >> 3;
+            m_count |= 56;
+            return;
+        }
+
+        while (m_count <= 56) {
+            // Zeros are fed past the end and caught by Overrun
+            if (m_position < m_data.size()) m_bits |= u64(m_data[m_position]) << m_count;
+
+            ++m_position;
+            m_count += 8;
+        }
+    }
+
+    inline u32 Peek(u32 bits) const { return static_cast<u32>(m_bits & ((u64(1) << bits) - 1)); }
+
+    inline void Consume(u32 bits)
+    {
+        m_bits >>= bits;
+        m_count -= bits;
+    }
+
+    inline u32 Read(u32 bits)
+    {
+        if (m_count < bits) Refill();
+
+        const u32 value = Peek(bits);
+        Consume(bits);
+        return value;
+    }
+
+    inline void AlignToByte() { Consume(m_count & 7); }
+
+    inline bool Overrun() const { return m_position - m_count / 8 > m_data.size(); }
+
+    inline u32 Count() const { return m_count; }
+    inline u64 Bits() const { return m_bits; }
+
+private:
+    std::span<const u8> m_data;
+    size_t m_position = 0;
+
+    u64 m_bits = 0;
+    u32 m_count = 0;
+};
+
+constexpr u32 FastBits = 10;
+constexpr u32 MaxCodeLength = 15;
+
+class Huffman {
+public:
+    bool Build(const u8 *lengths, u32 count)
+    {
+        u16 counts[MaxCodeLength + 1] = {};
+        for (u32 i = 0; i < count; ++i) ++counts[lengths[i]];
+        counts[0] = 0;
+
+        // Over-subscribed code sets are corrupt, incomplete ones are allowed
+        int left = 1;
+
+        for (u32 length = 1; length <= MaxCodeLength; ++length) {
+            left = (left << 1) - counts[length];
+            if (left < 0) return false;
+        }
+
+        u16 offsets[MaxCodeLength + 2] = {};
+        for (u32 length = 1; length <= MaxCodeLength; ++length) offsets[length + 1] = offsets[length] + counts[length];
+
+        std::memcpy(m_counts, counts, sizeof(counts));
+        std::memset(m_fast, 0, sizeof(m_fast));
+
+        u32 code = 0;
+        u32 next_code[MaxCodeLength + 1] = {};
+
+        for (u32 length = 1; length <= MaxCodeLength; ++length) {
+            code = (code + counts[length - 1]) << 1;
+            next_code[length] = code;
+        }
+
+        for (u32 symbol = 0; symbol < count; ++symbol) {
+            const u32 length = lengths[symbol];
+            if (length == 0) continue;
+
+            m_symbols[offsets[length]++] = static_cast<u16>(symbol);
+
+            const u32 symbol_code = next_code[length]++;
+            if (length > FastBits) continue;
+
+            // Codes are stored most significant bit first but read least significant first
+            u32 reversed = 0;
+            for (u32 i = 0; i < length; ++i) reversed |= ((symbol_code >> i) & 1) << (length - 1 - i);
+
+            for (u32 i = reversed; i < (1u << FastBits); i += 1u << length) {
+                m_fast[i] = static_cast<u16>((symbol << 4) | length);
+            }
+        }
+
+        return true;
+    }
+
+    // Returns -1 for codes that are not in the table
+    inline int Decode(BitReader& reader) const
+    {
+        if (reader.Count() < MaxCodeLength) reader.Refill();
+
+        const u16 entry = m_fast[reader.Peek(FastBits)];
+
+        if (entry != 0) {
+            reader.Consume(entry & 15);
+            return entry >> 4;
+        }
+
+        // Longer codes are walked one bit at a time in canonical order
+        const u64 bits = reader.Bits();
+        int code = 0, first = 0, index = 0;
+
+        for (u32 length = 1; length <= MaxCodeLength; ++length) {
+            code |= static_cast<int>((bits >> (length - 1)) & 1);
+
+            const int count = m_counts[length];
+
+            if (code - first < count) {
+                reader.Consume(length);
+                return m_symbols[index + code - first];
+            }
+
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+
+        return -1;
+    }
+
+private:
+    // Symbol << 4 | code length, zero for codes longer than FastBits
+    u16 m_fast[1 << FastBits];
+
+    u16 m_counts[MaxCodeLength + 1];
+    u16 m_symbols[288];
+};
+
+constexpr u16 LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr u8 LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+constexpr u16 DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr u8 DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+constexpr u8 CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+bool InflateBlock(BitReader& reader, const Huffman& literals, const Huffman& distances, u8 *out, size_t out_size, size_t& position)
+{
+    for (;;) {
+        const int symbol = literals.Decode(reader);
+        if (symbol < 0) return false;
+
+        if (symbol < 256) {
+            if (position == out_size) return false;
+            out[position++] = static_cast<u8>(symbol);
+            continue;
+        }
+
+        if (symbol == 256) return true;
+        if (symbol > 285) return false;
+
+        const u32 length = LengthBase[symbol - 257] + reader.Read(LengthExtra[symbol - 257]);
+
+        const int distance_symbol = distances.Decode(reader);
+        if (distance_symbol < 0 || distance_symbol > 29) return false;
+
+        const u32 distance = DistanceBase[distance_symbol] + reader.Read(DistanceExtra[distance_symbol]);
+
+        if (distance > position || length > out_size - position) return false;
+
+        u8 *dst = out + position;
+        const u8 *src = dst - distance;
+
+        if (distance >= length) {
+            std::memcpy(dst, src, length);
+        } else if (distance >= 8) {
+            // Overlapping, but each 8 byte step only reads bytes already written
+            u32 i = 0;
+            for (; i + 8 <= length; i += 8) std::memcpy(dst + i, src + i, 8);
+            for (; i < length; ++i) dst[i] = src[i];
+        } else {
+            for (u32 i = 0; i < length; ++i) dst[i] = src[i];
+        }
+
+        position += length;
+    }
+}
+
+// Inflates a zlib stream, which must fill out exactly
+bool Inflate(std::span<const u8> data, u8 *out, size_t out_size)
+{
+    if (data.size() < 2) return false;
+
+    const u32 cmf = data[0], flags = data[1];
+    if ((cmf & 15) != 8 || ((cmf << 8) | flags) % 31 != 0 || (flags & 32) != 0) return false;
+
+    BitReader reader{ data.subspan(2) };
+    size_t position = 0;
+
+    Huffman literals, distances;
+    bool final = false;
+
+    while (!final) {
+        final = reader.Read(1) != 0;
+        const u32 type = reader.Read(2);
+
+        if (type == 0) {
+            reader.AlignToByte();
+
+            const u32 length = reader.Read(16);
+            const u32 inverse = reader.Read(16);
+            if ((length ^ 0xffff) != inverse || length > out_size - position) return false;
+
+            for (u32 i = 0; i < length; ++i) out[position++] = static_cast<u8>(reader.Read(8));
+        } else if (type == 1) {
+            u8 lengths[288 + 32];
+            std::fill(lengths, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+            std::fill(lengths + 288, lengths + 320, 5);
+
+            literals.Build(lengths, 288);
+            distances.Build(lengths + 288, 32);
+
+            if (!InflateBlock(reader, literals, distances, out, out_size, position)) return false;
+        } else if (type == 2) {
+            const u32 literal_count = reader.Read(5) + 257;
+            const u32 distance_count = reader.Read(5) + 1;
+            const u32 code_length_count = reader.Read(4) + 4;
+
+            u8 code_lengths[19] = {};
+            for (u32 i = 0; i < code_length_count; ++i) code_lengths[CodeLengthOrder[i]] = static_cast<u8>(reader.Read(3));
+
+            Huffman code_length_codes;
+            if (!code_length_codes.Build(code_lengths, 19)) return false;
+
+            u8 lengths[288 + 32];
+            u32 count = 0;
+
+            while (count < literal_count + distance_count) {
+                const int symbol = code_length_codes.Decode(reader);
+                if (symbol < 0) return false;
+
+                if (symbol < 16) {
+                    lengths[count++] = static_cast<u8>(symbol);
+                    continue;
+                }
+
+                u8 value = 0;
+                u32 repeat;
+
+                if (symbol == 16) {
+                    if (count == 0) return false;
+                    value = lengths[count - 1];
+                    repeat = 3 + reader.Read(2);
+                } else if (symbol == 17) {
+                    repeat = 3 + reader.Read(3);
+                } else {
+                    repeat = 11 + reader.Read(7);
+                }
+
+                if (count + repeat > literal_count + distance_count) return false;
+
+                std::fill(lengths + count, lengths + count + repeat, value);
+                count += repeat;
+            }
+
+            if (!literals.Build(lengths, literal_count)) return false;
+            if (!distances.Build(lengths + literal_count, distance_count)) return false;
+
+            if (!InflateBlock(reader, literals, distances, out, out_size, position)) return false;
+        } else {
+            return false;
+        }
+
+        if (reader.Overrun()) return false;
+    }
+
+    return position == out_size;
+}
+
+inline u8 Paeth(int a, int b, int c)
+{
+    const int pa = std::abs(b - c);
+    const int pb = std::abs(a - c);
+    const int pc = std::abs(a + b - 2 * c);
+
+    if (pa <= pb && pa <= pc) return static_cast<u8>(a);
+    if (pb <= pc) return static_cast<u8>(b);
+    return static_cast<u8>(c);
+}
+
+void UnfilterScalar(u8 filter, u8 *row, const u8 *prev, size_t length, u32 bpp)
+{
+    switch (filter) {
+    case 1:
+        for (size_t i = bpp; i < length; ++i) row[i] += row[i - bpp];
+        break;
+    case 2:
+        for (size_t i = 0; i < length; ++i) row[i] += prev[i];
+        break;
+    case 3:
+        for (size_t i = 0; i < bpp; ++i) row[i] += prev[i] >> 1;
+        for (size_t i = bpp; i < length; ++i) row[i] += static_cast<u8>((row[i - bpp] + prev[i]) >> 1);
+        break;
+    case 4:
+        for (size_t i = 0; i < bpp; ++i) row[i] += prev[i];
+        for (size_t i = bpp; i < length; ++i) row[i] += Paeth(row[i - bpp], prev[i], prev[i - bpp]);
+        break;
+    }
+}
+
+#ifdef VKER_PNG_SSE2
+// Whole texels are loaded through a 32-bit lane, 3 byte texels leave the top byte zero.
+// They are assembled in registers, as a partial copy through the stack stalls store forwarding
+template <u32 Bpp>
+inline __m128i LoadTexel(const u8 *p)
+{
+    u32 value;
+
+    if constexpr (Bpp == 3) {
+        u16 low;
+        std::memcpy(&low, p, 2);
+        value = low | (u32(p[2]) << 16);
+    } else {
+        std::memcpy(&value, p, 4);
+    }
+
+    return _mm_cvtsi32_si128(static_cast<int>(value));
+}
+
+template <u32 Bpp>
+inline void StoreTexel(u8 *p, __m128i texel)
+{
+    const u32 value = static_cast<u32>(_mm_cvtsi128_si32(texel));
+
+    if constexpr (Bpp == 3) {
+        const u16 low = static_cast<u16>(value);
+        std::memcpy(p, &low, 2);
+        p[2] = static_cast<u8>(value >> 16);
+    } else {
+        std::memcpy(p, &value, 4);
+    }
+}
+
+inline __m128i Abs16(__m128i x)
+{
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Sub, Average and Paeth depend on the texel to the left, so the SIMD lanes
+// run across the channels of one texel rather than along the row
+template <u32 Bpp>
+void UnfilterSSE2(u8 filter, u8 *row, const u8 *prev, size_t length)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    switch (filter) {
+    case 1: {
+        __m128i a = zero;
+
+        for (size_t i = 0; i < length; i += Bpp) {
+            a = _mm_add_epi8(a, LoadTexel<Bpp>(row + i));
+            StoreTexel<Bpp>(row + i, a);
+        }
+
+        break;
+    }
+    case 2: {
+        size_t i = 0;
+
+        for (; i + 16 <= length; i += 16) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(row + i), _mm_add_epi8(x, b));
+        }
+
+        for (; i < length; ++i) row[i] += prev[i];
+        break;
+    }
+    case 3: {
+        const __m128i one = _mm_set1_epi8(1);
+        __m128i a = zero;
+
+        for (size_t i = 0; i < length; i += Bpp) {
+            const __m128i b = LoadTexel<Bpp>(prev + i);
+
+            // avg_epu8 rounds up, the filter rounds down
+            __m128i average = _mm_avg_epu8(a, b);
+            average = _mm_sub_epi8(average, _mm_and_si128(_mm_xor_si128(a, b), one));
+
+            a = _mm_add_epi8(average, LoadTexel<Bpp>(row + i));
+            StoreTexel<Bpp>(row + i, a);
+        }
+
+        break;
+    }
+    case 4: {
+        __m128i a = zero, c = zero;
+
+        for (size_t i = 0; i < length; i += Bpp) {
+            const __m128i b = _mm_unpacklo_epi8(LoadTexel<Bpp>(prev + i), zero);
+            const __m128i x = _mm_unpacklo_epi8(LoadTexel<Bpp>(row + i), zero);
+
+            const __m128i pa = Abs16(_mm_sub_epi16(b, c));
+            const __m128i pb = Abs16(_mm_sub_epi16(a, c));
+            const __m128i pc = Abs16(_mm_add_epi16(_mm_sub_epi16(b, c), _mm_sub_epi16(a, c)));
+
+            const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            const __m128i predictor = Select(_mm_cmpeq_epi16(smallest, pa), a, Select(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+            // Both halves are below 256, so a byte add wraps exactly like the filter
+            a = _mm_add_epi8(predictor, x);
+            c = b;
+
+            StoreTexel<Bpp>(row + i, _mm_packus_epi16(a, a));
+        }
+
+        break;
+    }
+    }
+}
+#endif
+
+void Unfilter(u8 filter, u8 *row, const u8 *prev, size_t length, u32 bpp)
+{
+#ifdef VKER_PNG_SSE2
+    switch (bpp) {
+    case 3:
+        UnfilterSSE2<3>(filter, row, prev, length);
+        return;
+    case 4:
+        UnfilterSSE2<4>(filter, row, prev, length);
+        return;
+    }
+#endif
+
+    UnfilterScalar(filter, row, prev, length, bpp);
+}
+
+struct Header {
+    u32 width;
+    u32 height;
+    u8 bit_depth;
+    u8 colour_type;
+    u8 interlace;
+};
+
+bool ReadHeader(std::span<const u8> file, Header& header)
+{
+    // Signature, then IHDR must be the first chunk
+    if (file.size() < 8 + 8 + 13 || std::memcmp(file.data(), Signature, 8) != 0) return false;
+    if (ReadBE32(file.data() + 8) != 13 || !ChunkIs(file.data() + 12, "IHDR")) return false;
+
+    const u8 *ihdr = file.data() + 16;
+    header.width = ReadBE32(ihdr);
+    header.height = ReadBE32(ihdr + 4);
+    header.bit_depth = ihdr[8];
+    header.colour_type = ihdr[9];
+    header.interlace = ihdr[12];
+
+    return header.width != 0 && header.height != 0;
+}
+
+u32 Channels(u8 colour_type)
+{
+    switch (colour_type) {
+    case Grey:      return 1;
+    case RGB:       return 3;
+    case Palette:   return 1;
+    case GreyAlpha: return 2;
+    case RGBA:      return 4;
+    default:        return 0;
+    }
+}
+
+} // namespace
+
+bool ReadInfo(std::span<const u8> file, VkExtent2D& size)
+{
+    Header header;
+    if (!ReadHeader(file, header)) return false;
+
+    size = { header.width, header.height };
+    return true;
+}
+
+bool DecodeRGBA8(std::span<const u8> file, u8 *out)
+{
+    Header header;
+    if (!ReadHeader(file, header)) return false;
+
+    const u32 channels = Channels(header.colour_type);
+    if (channels == 0 || header.bit_depth != 8 || header.interlace != 0) return false;
+
+    u8 palette[256][4];
+    u32 palette_size = 0;
+
+    for (u32 i = 0; i < 256; ++i) palette[i][0] = palette[i][1] = palette[i][2] = 0, palette[i][3] = 255;
+
+    // Grey and RGB transparency keys, compared against the unexpanded samples
+    bool has_key = false;
+    u8 key[3] = {};
+
+    // Most encoders split the zlib stream across many IDAT chunks
+    std::vector<u8> idat;
+    std::span<const u8> stream;
+    u32 idat_chunks = 0;
+
+    for (size_t offset = 8; offset + 12 <= file.size();) {
+        const u32 length = ReadBE32(file.data() + offset);
+        const u8 *type = file.data() + offset + 4;
+        const u8 *data = file.data() + offset + 8;
+
+        if (length > file.size() - offset - 12) return false;
+
+        if (ChunkIs(type, "PLTE")) {
+            if (length % 3 != 0 || length / 3 > 256) return false;
+
+            palette_size = length / 3;
+            for (u32 i = 0; i < palette_size; ++i) std::memcpy(palette[i], data + i * 3, 3);
+        } else if (ChunkIs(type, "tRNS")) {
+            if (header.colour_type == Palette) {
+                for (u32 i = 0; i < std::min(length, 256u); ++i) palette[i][3] = data[i];
+            } else if (header.colour_type == Grey && length == 2) {
+                has_key = true;
+                key[0] = data[1];
+            } else if (header.colour_type == RGB && length == 6) {
+                has_key = true;
+                key[0] = data[1];
+                key[1] = data[3];
+                key[2] = data[5];
+            }
+        } else if (ChunkIs(type, "IDAT")) {
+            if (idat_chunks++ == 0) {
+                stream = { data, length };
+            } else {
+                if (idat_chunks == 2) idat.assign(stream.begin(), stream.end());
+                idat.insert(idat.end(), data, data + length);
+                stream = idat;
+            }
+        } else if (ChunkIs(type, "IEND")) {
+            break;
+        }
+
+        offset += 12 + size_t(length);
+    }
+
+    if (idat_chunks == 0 || (header.colour_type == Palette && palette_size == 0)) return false;
+
+    const size_t width = header.width;
+    const size_t stride = width * channels;
+
+    std::vector<u8> filtered(header.height * (stride + 1));
+    if (!Inflate(stream, filtered.data(), filtered.size())) return false;
+
+    const std::vector<u8> zero_row(stride, 0);
+
+    for (size_t y = 0; y < header.height; ++y) {
+        const u8 filter = filtered[y * (stride + 1)];
+        u8 *src = filtered.data() + y * (stride + 1) + 1;
+
+        if (filter > 4) return false;
+
+        // RGBA rows are unfiltered in place in the output, the rest in place in the scratch buffer
+        u8 *row = header.colour_type == RGBA ? out + y * stride : src;
+        const u8 *prev = y == 0 ? zero_row.data() : row - (header.colour_type == RGBA ? stride : stride + 1);
+
+        if (row != src) std::memcpy(row, src, stride);
+        Unfilter(filter, row, prev, stride, channels);
+
+        if (header.colour_type == RGBA) continue;
+
+        u8 *dst = out + y * width * 4;
+
+        switch (header.colour_type) {
+        case Grey:
+            for (size_t x = 0; x < width; ++x) {
+                dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = row[x];
+                dst[x * 4 + 3] = has_key && row[x] == key[0] ? 0 : 255;
+            }
+
+            break;
+        case RGB:
+            for (size_t x = 0; x < width; ++x) {
+                const u8 *texel = row + x * 3;
+                std::memcpy(dst + x * 4, texel, 3);
+                dst[x * 4 + 3] = has_key && std::memcmp(texel, key, 3) == 0 ? 0 : 255;
+            }
+
+            break;
+        case Palette:
+            for (size_t x = 0; x < width; ++x) std::memcpy(dst + x * 4, palette[row[x]], 4);
+            break;
+        case GreyAlpha:
+            for (size_t x = 0; x < width; ++x) {
+                dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = row[x * 2];
+                dst[x * 4 + 3] = row[x * 2 + 1];
+            }
+
+            break;
+        }
+    }
+
+    return true;
+}
+
+} // namespace vker::png
\ No newline at end of file
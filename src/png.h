@@ -0,0 +1,19 @@
+#pragma once
+
+#include <span>
+
+#include <vulkan/vulkan.h>
+
+#include "types.h"
+
+namespace vker::png {
+
+// Reads the image size from the header, returns false if the data is not a PNG
+bool ReadInfo(std::span<const u8> file, VkExtent2D& size);
+
+// Decodes a non-interlaced 8-bit PNG of any colour type straight into RGBA8
+// rows at out, which must hold width * height * 4 bytes. Returns false for
+// anything else or corrupt data, leaving the caller to fall back to stb_image
+bool DecodeRGBA8(std::span<const u8> file, u8 *out);
+
+} // namespace vker::png
\ No newline at end of file
@@ -0,0 +1,500 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <span>
+#include <utility>
+
+#include "memory.h"
+#include "utils.h"
+
+namespace vker {
+
+namespace {
+
+const VkAllocationCallbacks *const Callbacks = memory::HostCallbacks(memory::Tag::RenderTargets);
+
+// How a pass touches an image, and which of its accesses are writes
+struct AccessInfo {
+    VkImageLayout layout;
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    VkAccessFlags2 write_access;
+};
+
+AccessInfo Info(RenderGraph::Access access)
+{
+    switch (access) {
+    case RenderGraph::Access::ColorAttachment:
+        return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT };
+    case RenderGraph::Access::DepthAttachment:
+        return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+    case RenderGraph::Access::SampledRead:
+        return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_ACCESS_2_NONE };
+    case RenderGraph::Access::TransferRead:
+        return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_ACCESS_2_NONE };
+    case RenderGraph::Access::TransferWrite:
+        return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+    }
+
+    FatalError("unknown render graph access {}", static_cast<u32>(access));
+}
+
+// What the next barrier on an image has to wait for. Stages that read since the last
+// write already had it made visible to them, and only need an execution dependency
+struct State {
+    VkImageLayout layout;
+    VkPipelineStageFlags2 write_stage;
+    VkAccessFlags2 write_access;
+    VkPipelineStageFlags2 read_stages;
+};
+
+VkPipelineStageFlags2 SrcStage(const State& state)
+{
+    return state.write_stage | state.read_stages;
+}
+
+VkAccessFlags2 SrcAccess(const State& state)
+{
+    return state.read_stages != 0 ? VK_ACCESS_2_NONE : state.write_access;
+}
+
+void FreeTransients(VkDevice device, VmaAllocator allocator, const std::vector<VkImage>& images,
+    const std::vector<VkImageView>& views, const std::vector<VmaAllocation>& allocations, VkDeviceSize size)
+{
+    for (size_t i = 0; i < images.size(); ++i) {
+        vkDestroyImageView(device, views[i], Callbacks);
+        vkDestroyImage(device, images[i], Callbacks);
+    }
+
+    for (const VmaAllocation allocation : allocations) {
+        vmaFreeMemory(allocator, allocation);
+    }
+
+    memory::TrackDeviceFree(memory::Tag::RenderTargets, size);
+}
+
+} // namespace
+
+void RenderGraph::Setup(VkDevice device, VmaAllocator allocator, u32 instances)
+{
+    assert(!m_init && instances != 0);
+
+    m_device = device;
+    m_allocator = allocator;
+    m_instances = instances;
+    m_init = true;
+}
+
+void RenderGraph::Destroy()
+{
+    assert(m_init);
+
+    std::vector<VmaAllocation> allocations;
+    VkDeviceSize size = 0;
+
+    for (const auto& allocation : m_allocations) {
+        allocations.push_back(allocation.allocation);
+        size += allocation.size;
+    }
+
+    FreeTransients(m_device, m_allocator, m_transient_images, m_transient_views, allocations, size);
+
+    m_transient_images.clear();
+    m_transient_views.clear();
+    m_allocations.clear();
+
+    Reset();
+    m_init = false;
+}
+
+void RenderGraph::Reset()
+{
+    m_resources.clear();
+    m_passes.clear();
+    m_barriers.clear();
+    m_barrier_resources.clear();
+    m_compiled = false;
+}
+
+u32 RenderGraph::ImportImage(std::string name, VkImageAspectFlags aspect, ResourceState initial, ResourceState final)
+{
+    assert(!m_compiled);
+
+    Resource& resource = m_resources.emplace_back();
+    resource.name = std::move(name);
+    resource.imported = true;
+    resource.aspect = aspect;
+    resource.initial = initial;
+    resource.final = final;
+
+    return static_cast<u32>(m_resources.size() - 1);
+}
+
+u32 RenderGraph::CreateImage(std::string name, const ImageDesc& desc)
+{
+    assert(!m_compiled);
+
+    Resource& resource = m_resources.emplace_back();
+    resource.name = std::move(name);
+    resource.imported = false;
+    resource.aspect = desc.aspect;
+    resource.desc = desc;
+
+    return static_cast<u32>(m_resources.size() - 1);
+}
+
+void RenderGraph::AddPass(std::string name, std::initializer_list<Use> uses, RecordFn record)
+{
+    assert(!m_compiled);
+
+    Pass& pass = m_passes.emplace_back();
+    pass.name = std::move(name);
+    pass.uses = uses;
+    pass.record = std::move(record);
+}
+
+void RenderGraph::Compile(DeletionQueue& deletion_queue, u32 frame)
+{
+    assert(m_init && !m_compiled);
+
+    // Frames in flight may still render to the previous transients
+    if (!m_transient_images.empty()) {
+        std::vector<VmaAllocation> allocations;
+        VkDeviceSize size = 0;
+
+        for (const auto& allocation : m_allocations) {
+            allocations.push_back(allocation.allocation);
+            size += allocation.size;
+        }
+
+        deletion_queue.Push(frame, [device = m_device, allocator = m_allocator,
+            images = std::move(m_transient_images),
+            views = std::move(m_transient_views),
+            allocations = std::move(allocations), size] {
+            FreeTransients(device, allocator, images, views, allocations, size);
+        });
+
+        m_transient_images.clear();
+        m_transient_views.clear();
+        m_allocations.clear();
+    }
+
+    Cull();
+    AllocateTransients();
+    PlanBarriers();
+
+    m_compiled = true;
+}
+
+void RenderGraph::Cull()
+{
+    // Walking backwards, a pass is live if it writes something that is imported or read by a live pass after it
+    std::vector<bool> needed(m_resources.size());
+
+    for (size_t i = 0; i < m_resources.size(); ++i) {
+        needed[i] = m_resources[i].imported;
+    }
+
+    m_culled_passes = 0;
+
+    for (size_t i = m_passes.size(); i-- > 0;) {
+        Pass& pass = m_passes[i];
+        pass.culled = true;
+
+        for (const Use& use : pass.uses) {
+            if (Info(use.access).write_access != VK_ACCESS_2_NONE && needed[use.resource]) pass.culled = false;
+        }
+
+        if (pass.culled) {
+            ++m_culled_passes;
+            continue;
+        }
+
+        for (const Use& use : pass.uses) {
+            needed[use.resource] = true;
+        }
+    }
+
+    for (u32 i = 0; i < m_passes.size(); ++i) {
+        if (m_passes[i].culled) continue;
+
+        for (const Use& use : m_passes[i].uses) {
+            Resource& resource = m_resources[use.resource];
+            resource.first_pass = std::min(resource.first_pass, i);
+            resource.last_pass = std::max(resource.last_pass, i);
+        }
+    }
+}
+
+void RenderGraph::AllocateTransients()
+{
+    std::vector<u32> transients;
+    std::vector<VkMemoryRequirements> requirements(m_resources.size());
+
+    for (u32 i = 0; i < m_resources.size(); ++i) {
+        Resource& resource = m_resources[i];
+
+        // Transients that only culled passes used are never created
+        if (resource.imported || resource.first_pass == UINT32_MAX) continue;
+
+        VkImageCreateInfo ci{};
+        ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        ci.imageType = VK_IMAGE_TYPE_2D;
+        ci.format = resource.desc.format;
+        ci.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+        ci.mipLevels = 1;
+        ci.arrayLayers = 1;
+        ci.samples = VK_SAMPLE_COUNT_1_BIT;
+        ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+        ci.usage = resource.desc.usage;
+        ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        // Instances are created alike, so the first stands in for all of them when planning memory
+        resource.images.resize(m_instances);
+        for (auto& image : resource.images) VK_CHECK(vkCreateImage(m_device, &ci, Callbacks, &image));
+
+        vkGetImageMemoryRequirements(m_device, resource.images[0], &requirements[i]);
+
+        transients.push_back(i);
+    }
+
+    // Largest first, each transient shares the first block whose occupants are all dead by the time it
+    // is first used, or born after it is last used. Blocks grow to fit the largest image they hold
+    std::sort(transients.begin(), transients.end(), [&](u32 a, u32 b) {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    struct Block {
+        VkMemoryRequirements requirements;
+        std::vector<u32> occupants;
+    };
+
+    std::vector<Block> blocks;
+
+    for (const u32 i : transients) {
+        const Resource& resource = m_resources[i];
+        const VkMemoryRequirements& reqs = requirements[i];
+
+        const auto fits = [&](const Block& block) {
+            if ((block.requirements.memoryTypeBits & reqs.memoryTypeBits) == 0) return false;
+
+            return std::none_of(block.occupants.begin(), block.occupants.end(), [&](u32 occupant) {
+                const Resource& other = m_resources[occupant];
+                return resource.first_pass <= other.last_pass && other.first_pass <= resource.last_pass;
+            });
+        };
+
+        auto block = std::find_if(blocks.begin(), blocks.end(), fits);
+
+        if (block == blocks.end()) {
+            blocks.push_back({ reqs, { i } });
+            continue;
+        }
+
+        block->requirements.size = std::max(block->requirements.size, reqs.size);
+        block->requirements.alignment = std::max(block->requirements.alignment, reqs.alignment);
+        block->requirements.memoryTypeBits &= reqs.memoryTypeBits;
+        block->occupants.push_back(i);
+    }
+
+    // Each instance gets blocks of its own, so transients only ever alias within a frame
+    for (u32 instance = 0; instance < m_instances; ++instance) {
+        for (u32 b = 0; b < blocks.size(); ++b) {
+            const Block& block = blocks[b];
+
+            VmaAllocationCreateInfo alloc_ci{};
+            alloc_ci.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            Allocation allocation;
+            VmaAllocationInfo info;
+            VK_CHECK(vmaAllocateMemory(m_allocator, &block.requirements, &alloc_ci, &allocation.allocation, &info));
+
+            allocation.size = info.size;
+            memory::TrackDeviceAllocation(memory::Tag::RenderTargets, allocation.size);
+
+            for (const u32 occupant : block.occupants) {
+                VK_CHECK(vmaBindImageMemory(m_allocator, allocation.allocation, m_resources[occupant].images[instance]));
+                m_resources[occupant].allocation = b;
+            }
+
+            m_allocations.push_back(allocation);
+        }
+    }
+
+    for (const u32 i : transients) {
+        Resource& resource = m_resources[i];
+        resource.views.resize(m_instances);
+
+        for (u32 instance = 0; instance < m_instances; ++instance) {
+            VkImageViewCreateInfo ci{};
+            ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            ci.image = resource.images[instance];
+            ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            ci.format = resource.desc.format;
+            ci.subresourceRange.aspectMask = resource.aspect;
+            ci.subresourceRange.baseMipLevel = 0;
+            ci.subresourceRange.levelCount = 1;
+            ci.subresourceRange.baseArrayLayer = 0;
+            ci.subresourceRange.layerCount = 1;
+
+            VK_CHECK(vkCreateImageView(m_device, &ci, Callbacks, &resource.views[instance]));
+
+            m_transient_images.push_back(resource.images[instance]);
+            m_transient_views.push_back(resource.views[instance]);
+        }
+    }
+}
+
+void RenderGraph::PlanBarriers()
+{
+    std::vector<State> states(m_resources.size());
+    std::vector<u32> first_barriers(m_resources.size(), UINT32_MAX);
+
+    for (size_t i = 0; i < m_resources.size(); ++i) {
+        const Resource& resource = m_resources[i];
+
+        if (resource.imported) {
+            states[i] = { resource.initial.layout, resource.initial.stage, resource.initial.access, 0 };
+        } else {
+            states[i] = { VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_ACCESS_2_NONE, 0 };
+        }
+    }
+
+    const auto add = [&](u32 resource, VkImageLayout new_layout,
+        VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access,
+        VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access) {
+        sync::ImageBarrier barrier{};
+        barrier.image = m_resources[resource].image;
+        barrier.aspect = m_resources[resource].aspect;
+        barrier.old_layout = states[resource].layout;
+        barrier.new_layout = new_layout;
+        barrier.src_stage = src_stage;
+        barrier.src_access = src_access;
+        barrier.dst_stage = dst_stage;
+        barrier.dst_access = dst_access;
+
+        m_barriers.push_back(barrier);
+        m_barrier_resources.push_back(resource);
+    };
+
+    for (auto& pass : m_passes) {
+        pass.first_barrier = static_cast<u32>(m_barriers.size());
+        pass.barrier_count = 0;
+
+        if (pass.culled) continue;
+
+        for (const Use& use : pass.uses) {
+            const AccessInfo info = Info(use.access);
+            State& state = states[use.resource];
+
+            const bool write = info.write_access != VK_ACCESS_2_NONE;
+            const bool transition = state.layout != info.layout;
+
+            if (!m_resources[use.resource].imported && first_barriers[use.resource] == UINT32_MAX) {
+                // The source is whatever last used the memory, filled in once every transient is planned
+                first_barriers[use.resource] = static_cast<u32>(m_barriers.size());
+                add(use.resource, info.layout, 0, VK_ACCESS_2_NONE, info.stage, info.access);
+            } else if (write || transition) {
+                add(use.resource, info.layout, SrcStage(state), SrcAccess(state), info.stage, info.access);
+            } else if (state.write_stage != 0 && (state.read_stages & info.stage) != info.stage) {
+                // Reads in the same layout only wait for the last write, if it is not yet visible to them
+                add(use.resource, info.layout, state.write_stage, state.write_access, info.stage, info.access);
+            }
+
+            if (write) {
+                state = { info.layout, info.stage, info.write_access, 0 };
+            } else if (transition) {
+                // The transition is a write of its own, which later reads have to chain onto
+                state = { info.layout, info.stage, VK_ACCESS_2_NONE, info.stage };
+            } else {
+                state.read_stages |= info.stage;
+            }
+        }
+
+        pass.barrier_count = static_cast<u32>(m_barriers.size()) - pass.first_barrier;
+    }
+
+    m_final_barrier = static_cast<u32>(m_barriers.size());
+
+    for (u32 i = 0; i < m_resources.size(); ++i) {
+        const Resource& resource = m_resources[i];
+        if (!resource.imported) continue;
+
+        if (states[i].layout != resource.final.layout || resource.final.stage != 0) {
+            add(i, resource.final.layout, SrcStage(states[i]), SrcAccess(states[i]), resource.final.stage, resource.final.access);
+        }
+    }
+
+    // A transient's first barrier waits for the previous occupant of its memory. The first
+    // occupant of a single instance waits for the last one of the previous frame, which may be
+    // the transient itself. With several instances the previous frame used other memory, and
+    // the last frame to use this instance has retired, so there is nothing for it to wait on
+    for (u32 i = 0; i < m_resources.size(); ++i) {
+        const Resource& resource = m_resources[i];
+        if (first_barriers[i] == UINT32_MAX) continue;
+
+        u32 previous = UINT32_MAX;
+        u32 last = i;
+
+        for (u32 j = 0; j < m_resources.size(); ++j) {
+            const Resource& other = m_resources[j];
+            if (other.imported || other.allocation != resource.allocation) continue;
+
+            if (other.last_pass < resource.first_pass && (previous == UINT32_MAX || other.last_pass > m_resources[previous].last_pass)) previous = j;
+            if (other.last_pass > m_resources[last].last_pass) last = j;
+        }
+
+        sync::ImageBarrier& barrier = m_barriers[first_barriers[i]];
+        barrier.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (previous == UINT32_MAX && m_instances > 1) {
+            barrier.src_stage = 0;
+            barrier.src_access = VK_ACCESS_2_NONE;
+            continue;
+        }
+
+        const State& source = states[previous != UINT32_MAX ? previous : last];
+        barrier.src_stage = SrcStage(source);
+        barrier.src_access = SrcAccess(source);
+    }
+}
+
+void RenderGraph::SetImage(u32 resource, VkImage image)
+{
+    assert(m_resources[resource].imported);
+    m_resources[resource].image = image;
+}
+
+VkImageView RenderGraph::View(u32 resource, u32 instance) const
+{
+    assert(m_compiled && !m_resources[resource].imported && instance < m_instances);
+    return m_resources[resource].views[instance];
+}
+
+void RenderGraph::Execute(VkCommandBuffer cmd, u32 instance)
+{
+    assert(m_compiled && instance < m_instances);
+
+    // Imported images can change every frame, and transients with the instance
+    for (size_t i = 0; i < m_barriers.size(); ++i) {
+        const Resource& resource = m_resources[m_barrier_resources[i]];
+        m_barriers[i].image = resource.imported ? resource.image : resource.images[instance];
+    }
+
+    const std::span<const sync::ImageBarrier> barriers{ m_barriers };
+
+    for (const auto& pass : m_passes) {
+        if (pass.culled) continue;
+
+        if (pass.barrier_count != 0) sync::RecordImageBarriers(cmd, barriers.subspan(pass.first_barrier, pass.barrier_count));
+        pass.record(cmd);
+    }
+
+    if (m_final_barrier != m_barriers.size()) sync::RecordImageBarriers(cmd, barriers.subspan(m_final_barrier));
+}
+
+} // namespace vker
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "contrib/vk_mem_alloc.h"
+
+#include "deletion_queue.h"
+#include "sync.h"
+#include "types.h"
+
+namespace vker {
+
+// Frame passes declare the images they use and how, and the graph works out the barriers
+// and layout transitions between them. Passes that nothing imported depends on are culled,
+// and transient images whose lifetimes never overlap share memory. Compiling is done once,
+// after the passes are declared, and the result is executed every frame until they change.
+// Transients are created once per instance, so that frames in flight never share them
+class RenderGraph {
+public:
+	enum class Access {
+		ColorAttachment,
+		DepthAttachment,
+		SampledRead,
+		TransferRead,
+		TransferWrite
+	};
+
+	// Where an imported image comes from at the start of the frame, or is left for at the end
+	struct ResourceState {
+		VkImageLayout layout;
+		VkPipelineStageFlags2 stage;
+		VkAccessFlags2 access;
+	};
+
+	struct ImageDesc {
+		VkFormat format;
+		VkExtent2D extent;
+		VkImageUsageFlags usage;
+		VkImageAspectFlags aspect;
+	};
+
+	struct Use {
+		u32 resource;
+		Access access;
+	};
+
+	using RecordFn = std::function<void(VkCommandBuffer)>;
+
+	RenderGraph() = default;
+
+	// Each instance may only be executed again once the frame that last executed it has retired
+	void Setup(VkDevice device, VmaAllocator allocator, u32 instances = 1);
+
+	// Frees the transient images straight away, once the device is idle
+	void Destroy();
+
+	// Forgets every declared pass and resource. Compiled transients live on until the next Compile
+	void Reset();
+
+	// Images owned elsewhere, such as the swapchain's, set with SetImage before each Execute
+	u32 ImportImage(std::string name, VkImageAspectFlags aspect, ResourceState initial, ResourceState final);
+
+	// Images owned by the graph, whose contents only live within a frame
+	u32 CreateImage(std::string name, const ImageDesc& desc);
+
+	void AddPass(std::string name, std::initializer_list<Use> uses, RecordFn record);
+
+	// Transients from the previous compile are freed once the given frame in flight retires
+	void Compile(DeletionQueue& deletion_queue, u32 frame);
+
+	void SetImage(u32 resource, VkImage image);
+	VkImageView View(u32 resource, u32 instance) const;
+
+	// Records every live pass in order, with the barriers before it, and the final transitions
+	void Execute(VkCommandBuffer cmd, u32 instance);
+
+	inline u32 CulledPasses() const { return m_culled_passes; }
+	inline size_t BarrierCount() const { return m_barriers.size(); }
+
+private:
+	struct Resource {
+		std::string name;
+		bool imported;
+		VkImageAspectFlags aspect;
+
+		ResourceState initial;
+		ResourceState final;
+		ImageDesc desc;
+
+		// Imported images are set each frame, transients have one image and view per instance
+		VkImage image = VK_NULL_HANDLE;
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+
+		// Live passes that first and last use the resource, and the memory block it is bound to
+		u32 first_pass = UINT32_MAX;
+		u32 last_pass = 0;
+		u32 allocation = UINT32_MAX;
+	};
+
+	struct Pass {
+		std::string name;
+		std::vector<Use> uses;
+		RecordFn record;
+
+		bool culled;
+		u32 first_barrier;
+		u32 barrier_count;
+	};
+
+	struct Allocation {
+		VmaAllocation allocation;
+		VkDeviceSize size;
+	};
+
+	void Cull();
+	void AllocateTransients();
+	void PlanBarriers();
+
+	bool m_init = false;
+	bool m_compiled = false;
+
+	VkDevice m_device;
+	VmaAllocator m_allocator;
+	u32 m_instances;
+
+	std::vector<Resource> m_resources;
+	std::vector<Pass> m_passes;
+
+	// Every barrier the graph records, grouped by pass, with the final transitions last.
+	// Barriers are patched with the frame's imported image, or the instance's transient, before recording
+	std::vector<sync::ImageBarrier> m_barriers;
+	std::vector<u32> m_barrier_resources;
+	u32 m_final_barrier;
+
+	u32 m_culled_passes = 0;
+
+	// Compiled transients, which outlive the declarations that made them
+	std::vector<VkImage> m_transient_images;
+	std::vector<VkImageView> m_transient_views;
+	std::vector<Allocation> m_allocations;
+};
+
+} // namespace vker
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <stdexcept>
 #include <vector>
 
@@ -10,6 +14,8 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/matrix.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
 #define VMA_IMPLEMENTATION
@@ -18,18 +24,148 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "contrib/stb_image.h"
 
+#include "atlas.h"
+#include "bc.h"
 #include "buffer.h"
 #include "camera.h"
+#include "ktx2.h"
+#include "memory.h"
+#include "mipmap.h"
 #include "pipeline.h"
+#include "png.h"
 #include "renderer.h"
 #include "shader.h"
+#include "sync.h"
 #include "window.h"
 #include "utils.h"
 #include "vertex.h"
 
 namespace vker {
 
-Renderer::Renderer(const Window &window) : m_swapchain{}
+// Upper bound on the bindless texture table, further limited by the device
+constexpr u32 MaxBindlessTextures = 16384;
+
+// Without descriptor indexing every texture owns a descriptor set
+constexpr u32 MaxLegacyTextures = 256;
+
+// Images up to this size that are loaded together get packed into shared atlases
+constexpr u32 AtlasMaxTextureSize = 256;
+constexpr u32 AtlasMinSize = 256;
+constexpr u32 AtlasMaxSize = 2048;
+
+// Blocks are aligned to, and surrounded by, 2^(levels - 1) texels so box filtered
+// levels never mix neighbouring textures and the last level keeps a texel of gutter
+constexpr u32 AtlasMipLevels = 5;
+constexpr u32 AtlasGutter = 1 << (AtlasMipLevels - 1);
+
+// Matches DrawConstants in shader/bindless.frag, atlased textures sample a sub-rectangle
+struct DrawConstants {
+    u32 texture;
+    u32 padding;
+    glm::vec2 uv_scale;
+    glm::vec2 uv_offset;
+};
+
+// Longest an acquire holds the swapchain when it might be waiting on a queued present, in nanoseconds
+constexpr u64 AcquireTimeout = 1000 * 1000;
+
+// Swapchain rebuilds in one frame before it gives up on an out of date surface
+constexpr u32 MaxAcquireAttempts = 4;
+
+// Fewer draws than this cost more to hand to another thread than to record in place
+constexpr u32 DrawsPerChunk = 128;
+
+// Transient CPU memory available to each frame in flight
+constexpr size_t FrameArenaSize = 1024 * 1024;
+
+// Staging offsets suit every texel block size and the optimal copy alignment of most devices
+constexpr size_t StagingAlignment = 16;
+
+// Largest piece of a stored mip level read from disk by one loader task
+constexpr size_t TextureBandSize = 1024 * 1024;
+
+// Host memory the driver allocates for our objects, attributed by subsystem
+const VkAllocationCallbacks *const DriverCallbacks = memory::HostCallbacks(memory::Tag::Driver);
+const VkAllocationCallbacks *const RendererCallbacks = memory::HostCallbacks(memory::Tag::Renderer);
+const VkAllocationCallbacks *const PipelineCallbacks = memory::HostCallbacks(memory::Tag::Pipelines);
+const VkAllocationCallbacks *const RenderTargetCallbacks = memory::HostCallbacks(memory::Tag::RenderTargets);
+
+// Layout transitions of a depth buffer with stencil have to cover both aspects
+static bool HasStencil(VkFormat format)
+{
+    return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
+static const char *PresentModeName(VkPresentModeKHR mode)
+{
+    switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+    default: return "unknown";
+    }
+}
+
+// Textures loaded together, from their file headers to the staging buffer they upload from.
+// Loading can run on any thread, while recording the upload and adding them is left to the one that draws
+struct Renderer::TextureBatch {
+    struct PendingTexture {
+        // From the file header, with KTX2 level offsets pointing into the file
+        TextureData info;
+        bool ktx2;
+
+        // Other formats are read whole, and decoded natively when they are simple PNGs
+        std::vector<u8> file;
+        bool native_png;
+
+        // Block compressed data the device cannot sample is decoded to RGBA8
+        bool decode;
+
+        VkFormat format;
+        u32 mip_levels;
+
+        // Streamed textures start with only their tail levels, [first_level, MipLevels())
+        bool stream;
+        u32 first_level;
+
+        // Levels written to the staging buffer, the rest are blitted on the GPU
+        std::vector<TextureData::Level> staged;
+
+        // Small images are copied into a block of a shared atlas instead
+        u32 atlas = UINT32_MAX;
+        atlas::Rect block;
+
+        Texture texture{};
+    };
+
+    struct PendingAtlas {
+        VkExtent2D size;
+        u32 count;
+        u64 texels;
+
+        std::vector<TextureData::Level> staged;
+        Texture texture{};
+    };
+
+    std::vector<std::filesystem::path> paths;
+    std::vector<PendingTexture> pending;
+    std::vector<PendingAtlas> atlases;
+
+    Buffer staging_buffer;
+
+    // Requested batches load on a job, then upload on a command buffer of their own
+    std::vector<TextureHandle> handles;
+    JobCounter loaded;
+
+    // The fence is only made without timeline semaphores
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    u64 timeline_value = 0;
+    bool submitted = false;
+};
+
+Renderer::Renderer(const Window &window, JobSystem& jobs, const RendererSettings& settings) : m_jobs{jobs}, m_settings{settings}, m_swapchain{}
 {
 	CreateInstance(window);
     window.CreateSurface(m_instance, &m_surface);
@@ -42,97 +178,267 @@ Renderer::Renderer(const Window &window) : m_swapchain{}
     SelectPhysicalDevice();
     CreateDevice();
     CreateAllocator();
+
+    m_depth_format = SelectOptimalDepthFormat();
+
+    // The swapchain is sized for the frames that may be waiting to present
+    m_frames_in_flight = std::max(m_settings.frames_in_flight, 1u);
+
     CreateSwapchain();
-    CreateRenderPass();
+    if (!m_dynamic_rendering) CreateRenderPass();
+
+    fmt::print("present mode {}\n", PresentModeName(m_swapchain.present_mode));
+
+    if (m_settings.latency_mode == LatencyMode::Capped) m_frame_limiter.SetFrameRate(m_settings.frame_rate_cap);
+
+    // The virtual texture set is part of the pipeline layout
+    if (m_virtual_textures) m_virtual_cache.Setup(m_device, m_allocator, m_jobs, m_frames_in_flight);
+
     CreatePipeline();
-    CreateDepthBuffers();
-    CreateFramebuffers();
-    CreateCommandPool();
+    m_static_commands = m_settings.static_command_buffers;
+    m_parallel_recording = m_settings.parallel_recording;
+    m_secondary_draws = m_static_commands || m_parallel_recording;
+
+    CreateCommandPools();
     CreateCommandBuffers();
+    if (m_secondary_draws) CreateRecordingPools();
+    CreateSemaphores();
+    CreateFences();
+    CreateFrameArenas();
+
+    m_deletion_queue.Setup(m_frames_in_flight);
+
+    m_render_graph.Setup(m_device, m_allocator, m_frames_in_flight);
+    BuildRenderGraph();
+    if (!m_dynamic_rendering) CreateFramebuffers();
 
     CreateUniformBuffer();
-    CreateTexture();
     CreateDescriptorPool();
 
-    CreateSemaphores();
-    CreateFences();
+    // Texture zero is plain white, used by models without a texture
+    const u8 white[4] = { 0xff, 0xff, 0xff, 0xff };
+    CreateTexture(white, { 1, 1 });
+
+    m_streaming = m_bindless && m_settings.texture_streaming;
+
+    if (m_streaming) {
+        m_streamer.Setup(m_device, m_allocator, m_queue, m_queue_mutex, m_queue_family, m_texture_table, m_jobs,
+            m_settings.texture_streaming_budget, m_frames_in_flight);
+    }
+
+    m_threaded_submission = m_settings.submission_thread;
+    if (m_threaded_submission) m_submission_thread = std::thread{ [this] { SubmissionLoop(); } };
 }
 
 Renderer::~Renderer()
 {
+    if (m_threaded_submission) {
+        FramePacket quit{};
+        quit.quit = true;
+
+        m_frame_packets.Push(quit);
+        m_submission_thread.join();
+    }
+
     vkDeviceWaitIdle(m_device);
 
-    m_texture.Destroy();
-    m_models.clear();
+    m_deletion_queue.Destroy();
+
+    if (m_streaming) m_streamer.Destroy();
+    if (m_virtual_textures) m_virtual_cache.Destroy();
+
+    for (auto& texture : m_textures) {
+        if (texture.stream_id == UINT32_MAX && !texture.virtual_texture && !texture.atlased) texture.image.Destroy();
+    }
+
+    // Requests still under way are dropped, once the jobs working on them have finished
+    for (auto& batch : m_texture_batches) {
+        m_jobs.Wait(batch->loaded);
+
+        batch->staging_buffer.Destroy();
+
+        for (auto& atlas : batch->atlases) atlas.texture.image.Destroy();
+
+        for (auto& texture : batch->pending) {
+            if (texture.atlas == UINT32_MAX) texture.texture.image.Destroy();
+        }
 
-    for (auto& depth_buffer : m_depth_buffers) {
-        depth_buffer.Destroy();
+        if (batch->fence != VK_NULL_HANDLE) vkDestroyFence(m_device, batch->fence, RendererCallbacks);
     }
 
+    for (auto& build : m_model_builds) m_jobs.Wait(build->built);
+
+    for (auto& build : m_buffer_builds) {
+        m_jobs.Wait(build->built);
+        build->buffer.Destroy();
+    }
+
+    for (auto& buffer : m_buffers) buffer.Destroy();
+
+    m_texture_batches.clear();
+    m_model_builds.clear();
+    m_buffer_builds.clear();
+    m_models.clear();
+
+    m_render_graph.Destroy();
+
     m_uniform_buffer.Unmap();
     m_uniform_buffer.Destroy();
 
     for (size_t i = 0; i < m_fences.size(); ++i) {
-        vkDestroyFence(m_device, m_fences[i], nullptr);
+        vkDestroyFence(m_device, m_fences[i], RendererCallbacks);
     }
 
     for (size_t i = 0; i < m_image_available_semaphores.size(); ++i) {
-        vkDestroySemaphore(m_device, m_image_available_semaphores[i], nullptr);
+        vkDestroySemaphore(m_device, m_image_available_semaphores[i], RendererCallbacks);
+    }
+
+    if (m_timeline) vkDestroySemaphore(m_device, m_queue_timeline, RendererCallbacks);
+
+    for (size_t i = 0; i < m_swapchain.render_finished_semaphores.size(); ++i) {
+        vkDestroySemaphore(m_device, m_swapchain.render_finished_semaphores[i], RendererCallbacks);
+    }
+
+    for (size_t i = 0; i < m_command_pools.size(); ++i) {
+        vkDestroyCommandPool(m_device, m_command_pools[i], RendererCallbacks);
     }
 
-    for (size_t i = 0; i < m_render_finished_semaphores.size(); ++i) {
-        vkDestroySemaphore(m_device, m_render_finished_semaphores[i], nullptr);
+    vkDestroyCommandPool(m_device, m_upload_pool, RendererCallbacks);
+    vkDestroyCommandPool(m_device, m_immediate_pool, RendererCallbacks);
+
+    for (auto& pools : m_recording_pools) {
+        for (auto& pool : pools) vkDestroyCommandPool(m_device, pool.pool, RendererCallbacks);
     }
 
-    vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptor_set_layout, RendererCallbacks);
+    vkDestroyDescriptorPool(m_device, m_descriptor_pool, RendererCallbacks);
 
-    vkDestroyDescriptorSetLayout(m_device, m_descriptor_set_layout, nullptr);
-    vkDestroyDescriptorPool(m_device, m_descriptor_pool, nullptr);
+    if (m_bindless) m_texture_table.Destroy();
 
-    vkDestroyPipeline(m_device, m_pipeline, nullptr);
-    vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
+    vkDestroyPipeline(m_device, m_pipeline, PipelineCallbacks);
+    if (m_virtual_textures) vkDestroyPipeline(m_device, m_virtual_pipeline, PipelineCallbacks);
+    vkDestroyPipelineLayout(m_device, m_pipeline_layout, PipelineCallbacks);
 
-    vkDestroyRenderPass(m_device, m_render_pass, nullptr);
+    if (!m_dynamic_rendering) vkDestroyRenderPass(m_device, m_render_pass, PipelineCallbacks);
 
-    for (auto& framebuffer : m_swapchain.framebuffers) vkDestroyFramebuffer(m_device, framebuffer, nullptr);
-    for (auto& image_view : m_swapchain.image_views) vkDestroyImageView(m_device, image_view, nullptr);
+    for (auto& framebuffer : m_swapchain.framebuffers) vkDestroyFramebuffer(m_device, framebuffer, RenderTargetCallbacks);
+    for (auto& image_view : m_swapchain.image_views) vkDestroyImageView(m_device, image_view, RenderTargetCallbacks);
 
-    vkDestroySwapchainKHR(m_device, m_swapchain.swapchain, nullptr);
+    vkDestroySwapchainKHR(m_device, m_swapchain.swapchain, RenderTargetCallbacks);
 
     vmaDestroyAllocator(m_allocator);
-    vkDestroyDevice(m_device, nullptr);
+    vkDestroyDevice(m_device, DriverCallbacks);
 
 #ifndef NDEBUG
     DestroyDebugMessenger();
 #endif // NDEBUG
 
+    // The surface was created by GLFW, without allocation callbacks
     vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 
-    vkDestroyInstance(m_instance, nullptr);
+    vkDestroyInstance(m_instance, DriverCallbacks);
+}
+
+bool Renderer::NeedsRedraw() const
+{
+    return m_redraw_frames != 0 || TexturesLoading() || RequestsPending();
+}
+
+bool Renderer::TexturesLoading() const
+{
+    return (m_streaming && m_streamer.Busy()) || (m_virtual_textures && m_virtual_cache.Busy());
+}
+
+FrameLimiter::Clock::time_point Renderer::BeginFrame()
+{
+    return m_frame_limiter.Wait();
 }
 
-void Renderer::Draw(const Camera& cam)
+void Renderer::Draw(const Camera& cam, FrameLimiter::Clock::time_point input_time)
 {   
-    if (!m_swapchain.valid) {
-        vkDeviceWaitIdle(m_device);
+    UpdateRequests();
+
+    // Only the frame that last used this slot has to be finished, not the one just submitted
+    WaitForFrame(m_frame_index);
+    m_deletion_queue.Flush(m_frame_index);
+
+    if (m_present_out_of_date.exchange(false, std::memory_order_relaxed)) InvalidateSwapchain();
+    if (!m_swapchain.valid) RecreateSwapchain();
+
+    // Textures landing during this frame need frames after it to request the levels below them
+    if (TexturesLoading()) RequestRedraw();
+    if (m_redraw_frames != 0) --m_redraw_frames;
+
+    // A failed acquire leaves the semaphore unsignalled, so it can be used again straight away.
+    // Without enough spare images an acquire can wait on a present still queued on the submission
+    // thread, so it waits in short steps and lets go of the swapchain in between
+    const VkSemaphore image_available_sema = m_image_available_semaphores[m_frame_index];
+    const auto acquire = [&] {
+        const u64 timeout = m_swapchain.blocking_acquire ? UINT64_MAX : AcquireTimeout;
+
+        for (;;) {
+            std::lock_guard lock{m_swapchain_mutex};
+            const VkResult result = vkAcquireNextImageKHR(m_device, m_swapchain.swapchain, timeout, image_available_sema, VK_NULL_HANDLE, &m_image_index);
+            if (result != VK_TIMEOUT && result != VK_NOT_READY) return result;
+        }
+    };
+
+    VkResult result = acquire();
 
-        VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physical_device, m_surface, &m_gpu.surface_caps));
+    // The surface can change again while a resize is still going on, so the swapchain is rebuilt
+    // until an acquire gets through. Once a rebuild no longer changes the extent, another will not help
+    for (u32 attempt = 1; result == VK_ERROR_OUT_OF_DATE_KHR && attempt < MaxAcquireAttempts; ++attempt) {
+        const VkExtent2D extent = m_swapchain.extent;
+        RecreateSwapchain();
+        result = acquire();
 
-        CreateSwapchain();
-        CreateFramebuffers();
+        if (attempt > 1 && m_swapchain.extent.width == extent.width && m_swapchain.extent.height == extent.height) break;
+    }
+
+    // Nothing has been recorded or reset for this frame yet, so it is dropped and the swapchain
+    // is rebuilt by the next one
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        InvalidateSwapchain();
+        RequestRedraw();
+        return;
+    }
 
-        m_swapchain.valid = true;
+    // Suboptimal images can still be presented, the swapchain is replaced next frame
+    if (result == VK_SUBOPTIMAL_KHR) {
+        InvalidateSwapchain();
+    } else {
+        VK_CHECK(result);
     }
 
-    const VkSemaphore image_available_sema = m_image_available_semaphores[m_semaphores_index];
-    const VkSemaphore render_finished_sema = m_render_finished_semaphores[m_semaphores_index];
+    // Images can come back out of order, or while another frame in flight still renders to them
+    u32& image_frame = m_swapchain.image_frames[m_image_index];
+    if (image_frame != UINT32_MAX && image_frame != m_frame_index) WaitForFrame(image_frame);
+    image_frame = m_frame_index;
+
+    const VkSemaphore render_finished_sema = m_swapchain.render_finished_semaphores[m_image_index];
+    const VkFence fence = m_timeline ? VK_NULL_HANDLE : m_fences[m_frame_index];
 
-    VK_CHECK(vkAcquireNextImageKHR(m_device, m_swapchain.swapchain, UINT64_MAX, image_available_sema, VK_NULL_HANDLE, &m_frame_index));
+    if (!m_timeline) VK_CHECK(vkResetFences(m_device, 1, &fence));
+    VK_CHECK(vkResetCommandPool(m_device, m_command_pools[m_frame_index], 0));
 
-    const VkFence fence = m_fences[m_frame_index];
+    if (m_streaming) {
+        m_streamer.Update();
+        RequestTextureLevels(cam);
+    }
+
+    m_frame_arenas[m_frame_index].Reset();
+
+    if (m_streaming && m_streamer.SlotVersion() != m_streamer_slot_version) {
+        m_streamer_slot_version = m_streamer.SlotVersion();
+        ++m_scene_version;
+    }
 
-    VK_CHECK(vkWaitForFences(m_device, 1, &fence, VK_TRUE, UINT64_MAX));
-    VK_CHECK(vkResetFences(m_device, 1, &fence));
+    // Static draws are only gathered when they have to be recorded again
+    if (!m_secondary_draws) {
+        BuildDrawList();
+    } else if (!m_static_commands || m_secondary_versions[m_frame_index] != m_scene_version) {
+        RecordSecondaries();
+    }
 
     VkCommandBuffer buffer = m_command_buffers[m_frame_index];
 
@@ -142,65 +448,449 @@ void Renderer::Draw(const Camera& cam)
 
     vkBeginCommandBuffer(buffer, &begin_info);
 
+    // Page uploads have to be recorded outside the render pass
+    if (m_virtual_textures) m_virtual_cache.Update(m_frame_index, buffer);
+
+    const u32 uniform_offset = m_frame_index * m_uniform_stride;
+
+    const glm::mat4 mvp = cam.GetProjectionMatrix() * cam.GetViewMatrix() * glm::mat4(1.0f);
+    std::memcpy(static_cast<u8 *>(m_uniform_buffer_addr) + uniform_offset, &mvp, sizeof(mvp));
+
+    m_render_graph.SetImage(m_backbuffer, m_swapchain.images[m_image_index]);
+    m_render_graph.Execute(buffer, m_frame_index);
+
+    if (m_virtual_textures) m_virtual_cache.RecordFeedbackBarrier(buffer);
+
+    vkEndCommandBuffer(buffer);
+
+    m_frame_packet = {};
+
+    // The upload goes to the queue first, so it takes its timeline value before the frame does
+    if (m_recorded_upload) {
+        m_recorded_upload->timeline_value = NextTimelineValue();
+        m_recorded_upload->submitted = true;
+
+        m_frame_packet.upload_cmd = m_recorded_upload->cmd;
+        m_frame_packet.upload_fence = m_recorded_upload->fence;
+        m_frame_packet.upload_timeline_value = m_recorded_upload->timeline_value;
+        m_recorded_upload = nullptr;
+    }
+
+    m_frame_packet.cmd = buffer;
+    m_frame_packet.image_available = image_available_sema;
+    m_frame_packet.render_finished = render_finished_sema;
+    m_frame_packet.fence = fence;
+    m_frame_packet.timeline_value = NextTimelineValue();
+    m_frame_packet.swapchain = m_swapchain.swapchain;
+    m_frame_packet.image_index = m_image_index;
+
+    m_frame_timeline_values[m_frame_index] = m_frame_packet.timeline_value;
+
+    const auto submit_time = FrameLimiter::Clock::now();
+    const float input_to_submit = std::chrono::duration<float, std::milli>(submit_time - input_time).count();
+    const float average = m_input_to_submit_average.load(std::memory_order_relaxed);
+
+    m_input_to_submit.store(input_to_submit, std::memory_order_relaxed);
+    m_input_to_submit_average.store(average + (input_to_submit - average) * 0.05f, std::memory_order_relaxed);
+}
+
+void Renderer::RecordForwardPass(VkCommandBuffer cmd)
+{
+    BeginRendering(cmd, m_secondary_draws);
+
+    if (m_secondary_draws) {
+        const auto& secondaries = m_frame_secondaries[m_frame_index];
+        vkCmdExecuteCommands(cmd, static_cast<u32>(secondaries.size()), secondaries.data());
+    } else {
+        RecordDraws(cmd, m_draw_list);
+    }
+
+    EndRendering(cmd);
+}
+
+void Renderer::BuildDrawList()
+{
+    LinearArena& arena = m_frame_arenas[m_frame_index];
+
+    // Sorting by texture lets consecutive draws skip redundant binds
+    ArenaVector<const Model *> draw_list{ArenaAllocator<const Model *>{arena}};
+    draw_list.reserve(m_models.size());
+
+    for (const auto& model : m_models) {
+        draw_list.push_back(model.get());
+    }
+
+    std::sort(draw_list.begin(), draw_list.end(), [](const Model *a, const Model *b) {
+        return a->texture_id < b->texture_id;
+    });
+
+    // Arena memory outlives the vector, until the frame's arena is reset
+    m_draw_list = draw_list;
+}
+
+void Renderer::RecordDraws(VkCommandBuffer cmd, std::span<const Model *const> draws)
+{
+    const u32 uniform_offset = m_frame_index * m_uniform_stride;
+
+    // Every pipeline leaves these dynamic, so they stay set across pipeline binds
+    VkViewport viewport;
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(m_swapchain.extent.width);
+    viewport.height = static_cast<float>(m_swapchain.extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor;
+    scissor.offset = { 0, 0 };
+    scissor.extent = m_swapchain.extent;
+
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+    VkPipeline bound_pipeline = m_pipeline;
+
+    if (m_bindless) {
+        const VkDescriptorSet sets[3] = { m_uniform_descriptor_set, m_texture_table.Set(), m_virtual_textures ? m_virtual_cache.Set(m_frame_index) : VK_NULL_HANDLE };
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, m_virtual_textures ? 3 : 2, sets, 1, &uniform_offset);
+    }
+
+    u32 bound_texture = UINT32_MAX;
+
+    for (const Model *model : draws) {
+        if (model->texture_id != bound_texture) {
+            const Texture& texture = m_textures[model->texture_id];
+
+            const VkPipeline pipeline = texture.virtual_texture ? m_virtual_pipeline : m_pipeline;
+
+            if (pipeline != bound_pipeline) {
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                bound_pipeline = pipeline;
+            }
+
+            if (m_bindless) {
+                DrawConstants constants{};
+                constants.texture = texture.stream_id != UINT32_MAX ? m_streamer.Slot(texture.stream_id) : texture.slot;
+                constants.uv_scale = texture.uv_scale;
+                constants.uv_offset = texture.uv_offset;
+
+                vkCmdPushConstants(cmd, m_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+            } else {
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &texture.descriptor_set, 1, &uniform_offset);
+            }
+
+            bound_texture = model->texture_id;
+        }
+
+        model->Draw(cmd);
+    }
+}
+
+void Renderer::RecordSecondaries()
+{
+    BuildDrawList();
+
+    auto& pools = m_recording_pools[m_frame_index];
+
+    for (auto& pool : pools) {
+        VK_CHECK(vkResetCommandPool(m_device, pool.pool, 0));
+        pool.used = 0;
+    }
+
+    const u32 draw_count = static_cast<u32>(m_draw_list.size());
+    const u32 max_chunks = m_parallel_recording ? m_jobs.ThreadCount() * 2 : 1;
+    const u32 chunk_count = std::clamp((draw_count + DrawsPerChunk - 1) / DrawsPerChunk, 1u, max_chunks);
+    const u32 chunk_size = (draw_count + chunk_count - 1) / chunk_count;
+
+    auto& secondaries = m_frame_secondaries[m_frame_index];
+
+    if (secondaries.size() != chunk_count) {
+        memory::FrameAllocationPause pause;
+        secondaries.resize(chunk_count);
+    }
+
+    // Buffers are replayed into whichever image is acquired, so only the attachment formats are known
+    VkCommandBufferInheritanceRenderingInfo rendering_info{};
+    rendering_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachmentFormats = &m_swapchain.format.format;
+    rendering_info.depthAttachmentFormat = m_depth_format;
+    // The depth attachment is bound without a stencil attachment, both here and in the pipelines
+    rendering_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    rendering_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritance_info{};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+
+    if (m_dynamic_rendering) {
+        inheritance_info.pNext = &rendering_info;
+    } else {
+        inheritance_info.renderPass = m_render_pass;
+        inheritance_info.subpass = 0;
+    }
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.pInheritanceInfo = &inheritance_info;
+
+    // The thread calling Draw may not be one of the job system's, and then has the last pool
+    const auto pool_index = [this] {
+        if (!m_parallel_recording) return 0u;
+
+        const u32 index = m_jobs.ThreadIndex();
+        return index != JobSystem::NoThread ? index : m_jobs.ThreadCount();
+    };
+
+    // Chunks go to whichever thread picks them up, but keep their place in the draw order
+    m_jobs.ParallelFor(chunk_count, 1, [&](u32 begin, u32 end) {
+        RecordingPool& pool = pools[pool_index()];
+
+        for (u32 chunk = begin; chunk < end; ++chunk) {
+            if (pool.used == pool.buffers.size()) {
+                memory::FrameAllocationPause pause;
+
+                VkCommandBufferAllocateInfo allocate_info{};
+                allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocate_info.commandPool = pool.pool;
+                allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocate_info.commandBufferCount = 1;
+
+                VK_CHECK(vkAllocateCommandBuffers(m_device, &allocate_info, &pool.buffers.emplace_back()));
+            }
+
+            const VkCommandBuffer cmd = pool.buffers[pool.used++];
+
+            const u32 first = std::min(chunk * chunk_size, draw_count);
+            const u32 last = std::min(first + chunk_size, draw_count);
+
+            vkBeginCommandBuffer(cmd, &begin_info);
+            RecordDraws(cmd, m_draw_list.subspan(first, last - first));
+            vkEndCommandBuffer(cmd);
+
+            secondaries[chunk] = cmd;
+        }
+    });
+
+    m_secondary_versions[m_frame_index] = m_scene_version;
+}
+
+void Renderer::BeginRendering(VkCommandBuffer cmd, bool secondary)
+{
     VkClearValue clear_values[2];
     clear_values[0].color = {{ 119.0f / 255.0f, 41.0f / 255.0f, 83.0f / 255.0f, 1.0f }};
     clear_values[1].depthStencil = { 1.0f, 0 };
 
-    VkRenderPassBeginInfo render_pass_begin_info{};
-    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_begin_info.renderPass = m_render_pass;
-    render_pass_begin_info.framebuffer = m_swapchain.framebuffers[m_frame_index];
-    render_pass_begin_info.renderArea.offset.x = 0;
-    render_pass_begin_info.renderArea.offset.y = 0;
-    render_pass_begin_info.renderArea.extent = m_swapchain.extent;
-    render_pass_begin_info.clearValueCount = 2;
-    render_pass_begin_info.pClearValues = clear_values;
+    VkRect2D render_area;
+    render_area.offset = { 0, 0 };
+    render_area.extent = m_swapchain.extent;
+
+    if (!m_dynamic_rendering) {
+        VkRenderPassBeginInfo render_pass_begin_info{};
+        render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_begin_info.renderPass = m_render_pass;
+        render_pass_begin_info.framebuffer = m_swapchain.framebuffers[m_image_index * m_frames_in_flight + m_frame_index];
+        render_pass_begin_info.renderArea = render_area;
+        render_pass_begin_info.clearValueCount = 2;
+        render_pass_begin_info.pClearValues = clear_values;
+
+        vkCmdBeginRenderPass(cmd, &render_pass_begin_info, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+        return;
+    }
 
-    const glm::mat4 mvp = cam.GetProjectionMatrix() * cam.GetViewMatrix() * glm::mat4(1.0f);
-    std::memcpy(m_uniform_buffer_addr, &mvp, sizeof(mvp));
+    VkRenderingAttachmentInfo color{};
+    color.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    color.imageView = m_swapchain.image_views[m_image_index];
+    color.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color.clearValue = clear_values[0];
+
+    VkRenderingAttachmentInfo depth{};
+    depth.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depth.imageView = m_render_graph.View(m_depth_buffer, m_frame_index);
+    depth.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depth.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth.clearValue = clear_values[1];
+
+    VkRenderingInfo rendering_info{};
+    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    rendering_info.flags = secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+    rendering_info.renderArea = render_area;
+    rendering_info.layerCount = 1;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachments = &color;
+    rendering_info.pDepthAttachment = &depth;
+
+    vkCmdBeginRendering(cmd, &rendering_info);
+}
+
+void Renderer::EndRendering(VkCommandBuffer cmd)
+{
+    if (!m_dynamic_rendering) {
+        vkCmdEndRenderPass(cmd);
+        return;
+    }
 
-    vkCmdBeginRenderPass(buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdEndRendering(cmd);
+}
 
-    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+void Renderer::Submit(VkCommandBuffer cmd, VkSemaphore wait, VkPipelineStageFlags2 wait_stage, VkSemaphore signal, VkFence fence, u64 value)
+{
+    if (m_synchronization2) {
+        VkSemaphoreSubmitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        wait_info.semaphore = wait;
+        wait_info.stageMask = wait_stage;
+
+        VkSemaphoreSubmitInfo signal_infos[2]{};
+        u32 signal_count = 0;
+
+        if (signal != VK_NULL_HANDLE) {
+            signal_infos[signal_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            signal_infos[signal_count].semaphore = signal;
+            signal_infos[signal_count].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            ++signal_count;
+        }
 
-    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_uniform_descriptor_set, 0, nullptr);
+        if (m_timeline) {
+            signal_infos[signal_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            signal_infos[signal_count].semaphore = m_queue_timeline;
+            signal_infos[signal_count].value = value;
+            signal_infos[signal_count].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            ++signal_count;
+        }
 
-    for (const auto& model : m_models) {
-        model.Draw(buffer);
+        VkCommandBufferSubmitInfo cmd_info{};
+        cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        cmd_info.commandBuffer = cmd;
+
+        VkSubmitInfo2 submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submit_info.waitSemaphoreInfoCount = wait != VK_NULL_HANDLE ? 1 : 0;
+        submit_info.pWaitSemaphoreInfos = &wait_info;
+        submit_info.commandBufferInfoCount = 1;
+        submit_info.pCommandBufferInfos = &cmd_info;
+        submit_info.signalSemaphoreInfoCount = signal_count;
+        submit_info.pSignalSemaphoreInfos = signal_infos;
+
+        VK_CHECK(vkQueueSubmit2(m_queue, 1, &submit_info, fence));
+        return;
     }
 
-    vkCmdEndRenderPass(buffer);
+    const VkPipelineStageFlags legacy_wait_stage = static_cast<VkPipelineStageFlags>(wait_stage);
 
-    vkEndCommandBuffer(buffer);
+    VkSemaphore signals[2];
+    u32 signal_count = 0;
+
+    if (signal != VK_NULL_HANDLE) signals[signal_count++] = signal;
+    if (m_timeline) signals[signal_count++] = m_queue_timeline;
+
+    // Binary semaphores ignore their values
+    const u64 signal_values[2] = { value, value };
 
-    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = signal_count;
+    timeline_info.pSignalSemaphoreValues = signal_values;
 
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &image_available_sema;
-    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.pNext = m_timeline ? &timeline_info : nullptr;
+    submit_info.waitSemaphoreCount = wait != VK_NULL_HANDLE ? 1 : 0;
+    submit_info.pWaitSemaphores = &wait;
+    submit_info.pWaitDstStageMask = &legacy_wait_stage;
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &buffer;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &render_finished_sema;
+    submit_info.pCommandBuffers = &cmd;
+    submit_info.signalSemaphoreCount = signal_count;
+    submit_info.pSignalSemaphores = signals;
 
-    vkQueueSubmit(m_queue, 1, &submit_info, fence);
+    VK_CHECK(vkQueueSubmit(m_queue, 1, &submit_info, fence));
+}
+
+void Renderer::WaitForFrame(u32 frame)
+{
+    if (!m_timeline) {
+        VK_CHECK(vkWaitForFences(m_device, 1, &m_fences[frame], VK_TRUE, UINT64_MAX));
+        return;
+    }
+
+    // A frame slot that has not been submitted yet waits for value zero, which has always been reached
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &m_queue_timeline;
+    wait_info.pValues = &m_frame_timeline_values[frame];
+
+    VK_CHECK(vkWaitSemaphores(m_device, &wait_info, UINT64_MAX));
 }
 
 void Renderer::Present()
 {
+    if (m_threaded_submission) {
+        m_frame_packets.Push(m_frame_packet);
+    } else {
+        SubmitFrame(m_frame_packet);
+    }
+
+    m_frame_index = (m_frame_index + 1) % m_frames_in_flight;
+}
+
+void Renderer::SubmissionLoop()
+{
+    for (;;) {
+        const FramePacket& packet = m_frame_packets.Front();
+        if (packet.quit) break;
+
+        SubmitFrame(packet);
+        m_frame_packets.Pop();
+    }
+
+    m_frame_packets.Pop();
+}
+
+void Renderer::SubmitFrame(const FramePacket& packet)
+{
+    {
+        std::lock_guard lock{m_queue_mutex};
+
+        // Frames only sample the uploaded textures once it has finished, so nothing waits on it
+        if (packet.upload_cmd != VK_NULL_HANDLE) {
+            Submit(packet.upload_cmd, VK_NULL_HANDLE, VK_PIPELINE_STAGE_2_NONE, VK_NULL_HANDLE, packet.upload_fence, packet.upload_timeline_value);
+        }
+
+        // Only writing the color attachment has to wait for the image, not the whole frame
+        Submit(packet.cmd, packet.image_available, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, packet.render_finished, packet.fence, packet.timeline_value);
+    }
+
+    // Presenting uses both the queue and the swapchain, while acquiring only uses the swapchain
+    std::scoped_lock lock{m_queue_mutex, m_swapchain_mutex};
+
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = &m_render_finished_semaphores[m_semaphores_index];
+    present_info.pWaitSemaphores = &packet.render_finished;
     present_info.swapchainCount = 1;
-    present_info.pSwapchains = &m_swapchain.swapchain;
-    present_info.pImageIndices = &m_frame_index;
-
-    VK_CHECK(vkQueuePresentKHR(m_queue, &present_info));
+    present_info.pSwapchains = &packet.swapchain;
+    present_info.pImageIndices = &packet.image_index;
+
+    const auto present_start = std::chrono::steady_clock::now();
+    const VkResult result = vkQueuePresentKHR(m_queue, &present_info);
+    m_present_time.store(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - present_start).count(), std::memory_order_relaxed);
+
+    // The swapchain belongs to the main thread, which recreates it at its next frame
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        m_present_out_of_date.store(true, std::memory_order_relaxed);
+    } else {
+        VK_CHECK(result);
+    }
+}
 
-    m_semaphores_index = (m_semaphores_index + 1) % m_swapchain.image_count;
+void Renderer::WaitForSubmissions()
+{
+    if (m_threaded_submission) m_frame_packets.WaitEmpty();
 }
 
 void Renderer::CreateInstance(const Window &window)
@@ -213,6 +903,14 @@ void Renderer::CreateInstance(const Window &window)
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 #endif // NDEBUG
 
+    // vkEnumerateInstanceVersion only exists on Vulkan 1.1 loaders
+    m_api_version = VK_API_VERSION_1_0;
+
+    auto enumerate_instance_version = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    if (enumerate_instance_version) VK_CHECK(enumerate_instance_version(&m_api_version));
+
+    m_api_version = std::min(m_api_version, VK_API_VERSION_1_3);
+
     u32 wextension_count = 0;
     auto wextensions = window.QueryInstanceExtensions(wextension_count);
 
@@ -226,7 +924,7 @@ void Renderer::CreateInstance(const Window &window)
     app_info.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
     app_info.pEngineName = "vker";
     app_info.engineVersion = VK_MAKE_VERSION(0, 1, 0);
-    app_info.apiVersion = VK_API_VERSION_1_0;
+    app_info.apiVersion = m_api_version;
 
     VkInstanceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -236,7 +934,7 @@ void Renderer::CreateInstance(const Window &window)
     create_info.enabledExtensionCount = static_cast<u32>(extensions.size());
     create_info.ppEnabledExtensionNames = extensions.data();
 
-    VK_CHECK(vkCreateInstance(&create_info, nullptr, &m_instance));
+    VK_CHECK(vkCreateInstance(&create_info, DriverCallbacks, &m_instance));
 }
 
 #ifndef NDEBUG
@@ -261,7 +959,7 @@ void Renderer::CreateDebugMessenger()
     auto create_debug_messenger = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(m_instance, "vkCreateDebugUtilsMessengerEXT");
     assert(create_debug_messenger);
 
-    VK_CHECK(create_debug_messenger(m_instance, &create_info, nullptr, &m_debug_messenger));
+    VK_CHECK(create_debug_messenger(m_instance, &create_info, DriverCallbacks, &m_debug_messenger));
 }
 
 void Renderer::DestroyDebugMessenger()
@@ -269,7 +967,7 @@ void Renderer::DestroyDebugMessenger()
     auto destroy_debug_messenger = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(m_instance, "vkDestroyDebugUtilsMessengerEXT");
     assert(destroy_debug_messenger);
 
-    destroy_debug_messenger(m_instance, m_debug_messenger, nullptr);
+    destroy_debug_messenger(m_instance, m_debug_messenger, DriverCallbacks);
 }
 #endif // NDEBUG
 
@@ -291,54 +989,80 @@ void Renderer::EnumeratePhysicalDevices()
         gpu.device = devices[i];
 
         vkGetPhysicalDeviceProperties(devices[i], &gpu.props);
+        vkGetPhysicalDeviceFeatures(devices[i], &gpu.features);
         vkGetPhysicalDeviceMemoryProperties(devices[i], &gpu.memory_props);
 
-    {
-        u32 extension_props;
-        VK_CHECK(vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extension_props, nullptr));
-        assert(extension_props != 0);
+        if (m_api_version >= VK_API_VERSION_1_2 && gpu.props.apiVersion >= VK_API_VERSION_1_2) {
+            gpu.features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            gpu.props12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
 
-        gpu.extension_props.resize(extension_props);
+            VkPhysicalDeviceFeatures2 features{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &gpu.features12;
 
-        VK_CHECK(vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extension_props, gpu.extension_props.data()));
-        assert(extension_props != 0);
-    }
+            if (m_api_version >= VK_API_VERSION_1_3 && gpu.props.apiVersion >= VK_API_VERSION_1_3) {
+                gpu.features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+                gpu.features12.pNext = &gpu.features13;
+            }
 
-    {
-        u32 queue_family_props;
-        vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queue_family_props, nullptr);
-        assert(queue_family_props != 0);
+            VkPhysicalDeviceProperties2 props{};
+            props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            props.pNext = &gpu.props12;
 
-        gpu.queue_family_props.resize(queue_family_props);
+            vkGetPhysicalDeviceFeatures2(devices[i], &features);
+            vkGetPhysicalDeviceProperties2(devices[i], &props);
 
-        vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queue_family_props, gpu.queue_family_props.data());
-        assert(queue_family_props != 0);
-    }
+            // The chain would dangle once gpu_info is copied
+            gpu.features12.pNext = nullptr;
+            gpu.features13.pNext = nullptr;
+            gpu.props12.pNext = nullptr;
+        }
 
-        VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(devices[i], m_surface, &gpu.surface_caps));
+        {
+            u32 extension_props;
+            VK_CHECK(vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extension_props, nullptr));
+            assert(extension_props != 0);
 
-    {
-        u32 surface_formats;
-        VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(devices[i], m_surface, &surface_formats, nullptr));
-        assert(surface_formats != 0);
+            gpu.extension_props.resize(extension_props);
 
-        gpu.surface_formats.resize(surface_formats);
+            VK_CHECK(vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extension_props, gpu.extension_props.data()));
+            assert(extension_props != 0);
+        }
 
-        VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(devices[i], m_surface, &surface_formats, gpu.surface_formats.data()));
-        assert(surface_formats != 0);
-    }
+        {
+            u32 queue_family_props;
+            vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queue_family_props, nullptr);
+            assert(queue_family_props != 0);
 
-    {
-        u32 surface_present_modes;
-        VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(devices[i], m_surface, &surface_present_modes, nullptr));
-        assert(surface_present_modes != 0);
+            gpu.queue_family_props.resize(queue_family_props);
 
-        gpu.surface_present_modes.resize(surface_present_modes);
+            vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queue_family_props, gpu.queue_family_props.data());
+            assert(queue_family_props != 0);
+        }
 
-        VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(devices[i], m_surface, &surface_present_modes, gpu.surface_present_modes.data()));
-        assert(surface_present_modes != 0);
-    }
+        VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(devices[i], m_surface, &gpu.surface_caps));
+
+        {
+            u32 surface_formats;
+            VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(devices[i], m_surface, &surface_formats, nullptr));
+            assert(surface_formats != 0);
+
+            gpu.surface_formats.resize(surface_formats);
+
+            VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(devices[i], m_surface, &surface_formats, gpu.surface_formats.data()));
+            assert(surface_formats != 0);
+        }
 
+        {
+            u32 surface_present_modes;
+            VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(devices[i], m_surface, &surface_present_modes, nullptr));
+            assert(surface_present_modes != 0);
+
+            gpu.surface_present_modes.resize(surface_present_modes);
+
+            VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(devices[i], m_surface, &surface_present_modes, gpu.surface_present_modes.data()));
+            assert(surface_present_modes != 0);
+        }
     }
 }
 
@@ -349,6 +1073,8 @@ void Renderer::SelectPhysicalDevice()
 
     fmt::print("selected physical device {}\n", m_gpu.props.deviceName);
 
+    m_api_version = std::min(m_api_version, m_gpu.props.apiVersion);
+
     u32 max_queue_count{};
 
     // Select the largest queue family supporting both graphics and present
@@ -378,10 +1104,48 @@ void Renderer::CreateDevice()
     std::vector<const char *> extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
     const float priorities[] = { 1.f };
 
-    VkDeviceQueueCreateInfo device_queue_create_info{};
-    device_queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    device_queue_create_info.queueFamilyIndex = m_queue_family;
-    device_queue_create_info.queueCount = 1;
+    m_bindless = m_settings.bindless && SupportsBindless();
+    fmt::print("bindless textures {}\n", m_bindless ? "enabled" : "disabled");
+
+    m_virtual_textures = m_bindless && m_settings.virtual_textures && m_gpu.features.fragmentStoresAndAtomics;
+    fmt::print("virtual textures {}\n", m_virtual_textures ? "enabled" : "disabled");
+
+    m_timeline = m_settings.timeline_semaphores && m_api_version >= VK_API_VERSION_1_2 && m_gpu.features12.timelineSemaphore;
+    fmt::print("timeline semaphores {}\n", m_timeline ? "enabled" : "disabled");
+
+    m_synchronization2 = m_settings.synchronization2 && m_api_version >= VK_API_VERSION_1_3 && m_gpu.features13.synchronization2;
+    fmt::print("synchronization2 {}\n", m_synchronization2 ? "enabled" : "disabled");
+
+    m_dynamic_rendering = m_settings.dynamic_rendering && m_api_version >= VK_API_VERSION_1_3 && m_gpu.features13.dynamicRendering;
+    fmt::print("dynamic rendering {}\n", m_dynamic_rendering ? "enabled" : "disabled");
+
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore = m_timeline;
+
+    VkPhysicalDeviceVulkan13Features features13{};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    features13.synchronization2 = m_synchronization2;
+    features13.dynamicRendering = m_dynamic_rendering;
+
+    if (m_bindless) {
+        features12.runtimeDescriptorArray = VK_TRUE;
+        features12.descriptorBindingPartiallyBound = VK_TRUE;
+        features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    }
+
+    // Without BC support compressed textures are decoded when they are created
+    VkPhysicalDeviceFeatures features{};
+    features.textureCompressionBC = m_gpu.features.textureCompressionBC;
+
+    // Virtual texture feedback is written from the fragment shader
+    features.fragmentStoresAndAtomics = m_virtual_textures;
+
+    VkDeviceQueueCreateInfo device_queue_create_info{};
+    device_queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    device_queue_create_info.queueFamilyIndex = m_queue_family;
+    device_queue_create_info.queueCount = 1;
     device_queue_create_info.pQueuePriorities = priorities;
 
     VkDeviceCreateInfo create_info{};
@@ -390,9 +1154,28 @@ void Renderer::CreateDevice()
     create_info.pQueueCreateInfos = &device_queue_create_info;
     create_info.enabledExtensionCount = static_cast<u32>(extensions.size());
     create_info.ppEnabledExtensionNames = extensions.data();
+    create_info.pEnabledFeatures = &features;
+
+    if (m_api_version >= VK_API_VERSION_1_2) create_info.pNext = &features12;
+    if (m_api_version >= VK_API_VERSION_1_3) features12.pNext = &features13;
 
-    VK_CHECK(vkCreateDevice(m_physical_device, &create_info, nullptr, &m_device));
+    VK_CHECK(vkCreateDevice(m_physical_device, &create_info, DriverCallbacks, &m_device));
     vkGetDeviceQueue(m_device, m_queue_family, 0, &m_queue);
+
+    sync::UseSynchronization2(m_synchronization2);
+
+    if (m_bindless) {
+        const auto& props12 = m_gpu.props12;
+
+        // Combined image samplers count against both the image and sampler limits
+        u32 capacity = MaxBindlessTextures;
+        capacity = std::min(capacity, props12.maxPerStageDescriptorUpdateAfterBindSampledImages);
+        capacity = std::min(capacity, props12.maxPerStageDescriptorUpdateAfterBindSamplers);
+        capacity = std::min(capacity, props12.maxDescriptorSetUpdateAfterBindSampledImages);
+        capacity = std::min(capacity, props12.maxDescriptorSetUpdateAfterBindSamplers);
+
+        m_texture_table.Setup(m_device, capacity);
+    }
 }
 
 void Renderer::CreateAllocator()
@@ -401,7 +1184,10 @@ void Renderer::CreateAllocator()
     allocator_info.physicalDevice = m_physical_device;
     allocator_info.device = m_device;
     allocator_info.instance = m_instance;
-    allocator_info.vulkanApiVersion = VK_API_VERSION_1_0;
+    allocator_info.pAllocationCallbacks = memory::HostCallbacks(memory::Tag::Allocator);
+    allocator_info.pDeviceMemoryCallbacks = memory::DeviceCallbacks();
+    // This version of VMA knows nothing newer than Vulkan 1.1
+    allocator_info.vulkanApiVersion = std::min(m_api_version, VK_API_VERSION_1_1);
 
     VK_CHECK(vmaCreateAllocator(&allocator_info, &m_allocator));
 }
@@ -412,6 +1198,7 @@ void Renderer::CreateSwapchain()
 
     m_swapchain.format = SelectOptimalSwapchainFormat();
     m_swapchain.extent = SelectOptimalSwapchainExtent();
+    m_swapchain.present_mode = SelectOptimalSwapchainPresentMode();
     m_swapchain.image_count = SelectOptimalSwapchainImageCount();
 
     VkSwapchainCreateInfoKHR create_info{};
@@ -426,20 +1213,22 @@ void Renderer::CreateSwapchain()
     create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     create_info.preTransform = caps.currentTransform;
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    create_info.presentMode = m_swapchain.present_mode;
     create_info.clipped = VK_TRUE;
     create_info.oldSwapchain = m_swapchain.swapchain;
 
-    VK_CHECK(vkCreateSwapchainKHR(m_device, &create_info, nullptr, &m_swapchain.swapchain));
-
-    for (size_t i = 0; i < m_swapchain.image_views.size(); ++i) {
-        vkDestroyImageView(m_device, m_swapchain.image_views[i], nullptr);
-    }
+    VK_CHECK(vkCreateSwapchainKHR(m_device, &create_info, RenderTargetCallbacks, &m_swapchain.swapchain));
+    m_swapchain.valid = true;
 
     u32 swapchain_images;
     VK_CHECK(vkGetSwapchainImagesKHR(m_device, m_swapchain.swapchain, &swapchain_images, nullptr));
     assert(swapchain_images != 0);
 
+    // Every frame in flight can hold an image that has not been presented yet, and an acquire
+    // may only block forever while those leave at least minImageCount images to the presentation engine
+    const u32 unpresented = m_settings.submission_thread ? m_frames_in_flight : 0;
+    m_swapchain.blocking_acquire = swapchain_images >= caps.minImageCount + unpresented;
+
     m_swapchain.images.resize(swapchain_images);
     m_swapchain.image_views.resize(swapchain_images);
 
@@ -462,7 +1251,7 @@ void Renderer::CreateSwapchain()
         iv_create_info.subresourceRange.baseArrayLayer = 0;
         iv_create_info.subresourceRange.layerCount = 1;
 
-        VK_CHECK(vkCreateImageView(m_device, &iv_create_info, nullptr, &m_swapchain.image_views[i]));
+        VK_CHECK(vkCreateImageView(m_device, &iv_create_info, RenderTargetCallbacks, &m_swapchain.image_views[i]));
     }
 }
 
@@ -475,16 +1264,16 @@ void Renderer::CreateRenderPass()
     attachment_descriptions[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment_descriptions[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachment_descriptions[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment_descriptions[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment_descriptions[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachment_descriptions[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachment_descriptions[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    attachment_descriptions[1].format = VK_FORMAT_D32_SFLOAT_S8_UINT;
+    attachment_descriptions[1].format = m_depth_format;
     attachment_descriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
     attachment_descriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachment_descriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachment_descriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachment_descriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment_descriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment_descriptions[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     attachment_descriptions[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference color_reference{};
@@ -501,30 +1290,22 @@ void Renderer::CreateRenderPass()
     subpass.pColorAttachments = &color_reference;
     subpass.pDepthStencilAttachment = &depth_reference;
 
-    VkSubpassDependency subpass_depencency{};
-    subpass_depencency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpass_depencency.dstSubpass = 0;
-    subpass_depencency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_depencency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_depencency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+    // The render graph records the layout transitions and dependencies around the pass
     VkRenderPassCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     create_info.attachmentCount = 2;
     create_info.pAttachments = attachment_descriptions;
     create_info.subpassCount = 1;
     create_info.pSubpasses = &subpass;
-    create_info.dependencyCount = 1;
-    create_info.pDependencies = &subpass_depencency;
 
-    VK_CHECK(vkCreateRenderPass(m_device, &create_info, nullptr, &m_render_pass));
+    VK_CHECK(vkCreateRenderPass(m_device, &create_info, PipelineCallbacks, &m_render_pass));
 }
 
 void Renderer::CreatePipeline()
 {
     VkDescriptorSetLayoutBinding layout_bindings[2]{};
     layout_bindings[0].binding = 0;
-    layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     layout_bindings[0].descriptorCount = 1;
     layout_bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -533,89 +1314,122 @@ void Renderer::CreatePipeline()
     layout_bindings[1].descriptorCount = 1;
     layout_bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
+    // Bindless textures live in their own set, leaving only the uniform buffer here
     VkDescriptorSetLayoutCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    create_info.bindingCount = 2;
+    create_info.bindingCount = m_bindless ? 1 : 2;
     create_info.pBindings = layout_bindings;
 
-    vkCreateDescriptorSetLayout(m_device, &create_info, nullptr, &m_descriptor_set_layout);
+    vkCreateDescriptorSetLayout(m_device, &create_info, RendererCallbacks, &m_descriptor_set_layout);
 
     PipelineLayoutBuilder layout_builder;
     layout_builder.AddDescriptor(m_descriptor_set_layout);
 
-    PipelineBuilder pipeline_builder;
+    if (m_bindless) {
+        layout_builder.AddDescriptor(m_texture_table.Layout());
+        if (m_virtual_textures) layout_builder.AddDescriptor(m_virtual_cache.Layout());
+        layout_builder.AddPushConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(DrawConstants));
+    }
 
-    VkShaderModule vert;
-    VkShaderModule frag;
+    m_pipeline_layout = layout_builder.Build(m_device);
 
-    shader::Create(m_device, &vert, "../../../shader/triangle.vert.spv");
-    shader::Create(m_device, &frag, "../../../shader/triangle.frag.spv");
+    // Virtual textures share everything but the fragment shader
+    const std::filesystem::path shader_dir = std::filesystem::path{ VKER_BUILD_DIR } / "shader";
 
-    pipeline_builder.AddShader(VK_SHADER_STAGE_VERTEX_BIT, vert);
-    pipeline_builder.AddShader(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
+    const auto build = [&](const char *frag_name) {
+        PipelineBuilder pipeline_builder;
 
-    pipeline_builder.AddVertexBinding(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
+        VkShaderModule vert;
+        VkShaderModule frag;
 
-    pipeline_builder.AddVertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos));
-    pipeline_builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, tex));
+        shader::Create(m_device, &vert, shader_dir / "triangle.vert.spv");
+        shader::Create(m_device, &frag, shader_dir / frag_name);
 
-    pipeline_builder.SetInputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
+        pipeline_builder.AddShader(VK_SHADER_STAGE_VERTEX_BIT, vert);
+        pipeline_builder.AddShader(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
 
-    VkViewport viewport;
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(m_swapchain.extent.width);
-    viewport.height = static_cast<float>(m_swapchain.extent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
+        pipeline_builder.AddVertexBinding(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
 
-    pipeline_builder.AddViewport(viewport);
+        pipeline_builder.AddVertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos));
+        pipeline_builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, tex));
 
-    VkRect2D scissor;
-    scissor.offset = { 0, 0 };
-    scissor.extent = m_swapchain.extent;
+        pipeline_builder.SetInputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
 
-    pipeline_builder.AddScissor(scissor);
+        // Set per frame from the swapchain extent, so resizing never rebuilds pipelines
+        pipeline_builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
+        pipeline_builder.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR);
 
-    m_pipeline_layout = layout_builder.Build(m_device);
-    m_pipeline = pipeline_builder.Build(m_device, m_pipeline_layout, m_render_pass);
+        pipeline_builder.SetAttachmentFormats(m_swapchain.format.format, m_depth_format);
+
+        const VkPipeline pipeline = pipeline_builder.Build(m_device, m_pipeline_layout, m_dynamic_rendering ? VK_NULL_HANDLE : m_render_pass);
+
+        shader::Destroy(m_device, vert);
+        shader::Destroy(m_device, frag);
 
-    shader::Destroy(m_device, vert);
-    shader::Destroy(m_device, frag);
+        return pipeline;
+    };
+
+    m_pipeline = build(m_bindless ? "bindless.frag.spv" : "triangle.frag.spv");
+    if (m_virtual_textures) m_virtual_pipeline = build("virtual.frag.spv");
 }
 
 void Renderer::CreateUniformBuffer()
 {
-    m_uniform_buffer.Setup(m_allocator, sizeof(glm::mat4), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    const VkDeviceSize alignment = m_gpu.props.limits.minUniformBufferOffsetAlignment;
+    m_uniform_stride = static_cast<u32>((sizeof(glm::mat4) + alignment - 1) / alignment * alignment);
+
+    m_uniform_buffer.Setup(m_allocator, VkDeviceSize(m_uniform_stride) * m_frames_in_flight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Renderer);
     m_uniform_buffer_addr = m_uniform_buffer.Map();
 }
 
-void Renderer::CreateDepthBuffers()
+void Renderer::BuildRenderGraph()
 {
-    m_depth_buffers.resize(m_swapchain.images.size());
+    m_render_graph.Reset();
 
-    for (auto& depth_buffer : m_depth_buffers) {
-        depth_buffer.Setup(m_device, m_allocator, m_swapchain.extent, VK_FORMAT_D32_SFLOAT_S8_UINT, true);
-    }
+    // Color writes wait for the acquire semaphore at the attachment output stage, so start there
+    m_backbuffer = m_render_graph.ImportImage("backbuffer", VK_IMAGE_ASPECT_COLOR_BIT,
+        { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE },
+        { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE });
+
+    // Every frame in flight clears its own depth buffer, without waiting for the previous frame's depth tests
+    RenderGraph::ImageDesc depth_desc{};
+    depth_desc.format = m_depth_format;
+    depth_desc.extent = m_swapchain.extent;
+    depth_desc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    depth_desc.aspect = HasStencil(m_depth_format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+
+    m_depth_buffer = m_render_graph.CreateImage("depth", depth_desc);
+
+    m_render_graph.AddPass("forward", {
+        { m_backbuffer, RenderGraph::Access::ColorAttachment },
+        { m_depth_buffer, RenderGraph::Access::DepthAttachment }
+    }, [this](VkCommandBuffer cmd) { RecordForwardPass(cmd); });
+
+    m_render_graph.Compile(m_deletion_queue, m_frame_index);
 }
 
 void Renderer::CreateDescriptorPool()
 {
+    const u32 max_sets = m_bindless ? 1 : MaxLegacyTextures;
+
     VkDescriptorPoolSize pool_size[2];
-    pool_size[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    pool_size[0].descriptorCount = 1;
+    pool_size[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    pool_size[0].descriptorCount = max_sets;
 
     pool_size[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pool_size[1].descriptorCount = 1;
+    pool_size[1].descriptorCount = max_sets;
 
     VkDescriptorPoolCreateInfo ci{};
     ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     //ci.flags = ...;
-    ci.maxSets = 2;
-    ci.poolSizeCount = 2;
+    ci.maxSets = max_sets;
+    ci.poolSizeCount = m_bindless ? 1 : 2;
     ci.pPoolSizes = pool_size;
 
-    VK_CHECK(vkCreateDescriptorPool(m_device, &ci, nullptr, &m_descriptor_pool));
+    VK_CHECK(vkCreateDescriptorPool(m_device, &ci, RendererCallbacks, &m_descriptor_pool));
+
+    // Without bindless each texture allocates its own set in CreateTexture
+    if (!m_bindless) return;
 
     VkDescriptorSetAllocateInfo alloc_info{};
     alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -628,45 +1442,28 @@ void Renderer::CreateDescriptorPool()
     VkDescriptorBufferInfo buffer_info{};
     buffer_info.buffer = m_uniform_buffer.Handle();
     buffer_info.offset = 0;
-    buffer_info.range = VK_WHOLE_SIZE;
-
-    VkDescriptorImageInfo image_info{};
-    image_info.sampler = m_texture.Sampler();
-    image_info.imageView = m_texture.View();
-    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-    VkWriteDescriptorSet writes[2]{};
-    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[0].dstSet = m_uniform_descriptor_set;
-    writes[0].dstBinding = 0;
-    writes[0].dstArrayElement = 0;
-    writes[0].descriptorCount = 1;
-    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writes[0].pBufferInfo = &buffer_info;
-
-    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[1].dstSet = m_uniform_descriptor_set;
-    writes[1].dstBinding = 1;
-    writes[1].dstArrayElement = 0;
-    writes[1].descriptorCount = 1;
-    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writes[1].pImageInfo = &image_info;
-
-    vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+    buffer_info.range = sizeof(glm::mat4);
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = m_uniform_descriptor_set;
+    write.dstBinding = 0;
+    write.dstArrayElement = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    write.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
 }
 
 void Renderer::CreateFramebuffers()
 {
-    for (size_t i = 0; i < m_swapchain.framebuffers.size(); ++i) {
-        vkDestroyFramebuffer(m_device, m_swapchain.framebuffers[i], nullptr);
-    }
+    m_swapchain.framebuffers.resize(m_swapchain.image_views.size() * m_frames_in_flight);
 
-    m_swapchain.framebuffers.resize(m_swapchain.image_views.size());
-
-    for (size_t i = 0; i < m_swapchain.image_views.size(); ++i) {
+    for (size_t i = 0; i < m_swapchain.framebuffers.size(); ++i) {
         VkImageView attachments[2] = {
-            m_swapchain.image_views[i],
-            m_depth_buffers[i].View()
+            m_swapchain.image_views[i / m_frames_in_flight],
+            m_render_graph.View(m_depth_buffer, static_cast<u32>(i % m_frames_in_flight))
         };
 
         VkFramebufferCreateInfo create_info{};
@@ -678,31 +1475,75 @@ void Renderer::CreateFramebuffers()
         create_info.height = m_swapchain.extent.height;
         create_info.layers = 1;
 
-        VK_CHECK(vkCreateFramebuffer(m_device, &create_info, nullptr, &m_swapchain.framebuffers[i]));
+        VK_CHECK(vkCreateFramebuffer(m_device, &create_info, RenderTargetCallbacks, &m_swapchain.framebuffers[i]));
     }
 }
 
-void Renderer::CreateCommandPool()
+void Renderer::CreateCommandPools()
 {
+    // Command buffers are never reset individually, the whole pool is reset each frame
     VkCommandPoolCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
     create_info.queueFamilyIndex = m_queue_family;
 
-    VK_CHECK(vkCreateCommandPool(m_device, &create_info, nullptr, &m_command_pool));
+    m_command_pools.resize(m_frames_in_flight);
+
+    for (size_t i = 0; i < m_command_pools.size(); ++i) {
+        VK_CHECK(vkCreateCommandPool(m_device, &create_info, RendererCallbacks, &m_command_pools[i]));
+    }
+
+    // Requested textures each take a buffer from here, freed once their upload has finished
+    VK_CHECK(vkCreateCommandPool(m_device, &create_info, RendererCallbacks, &m_upload_pool));
+    VK_CHECK(vkCreateCommandPool(m_device, &create_info, RendererCallbacks, &m_immediate_pool));
 }
 
 void Renderer::CreateCommandBuffers()
 {
-    m_command_buffers.resize(m_swapchain.framebuffers.size());
+    m_command_buffers.resize(m_frames_in_flight);
+
+    for (size_t i = 0; i < m_command_buffers.size(); ++i) {
+        VkCommandBufferAllocateInfo allocate_info{};
+        allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocate_info.commandPool = m_command_pools[i];
+        allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocate_info.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(m_device, &allocate_info, &m_command_buffers[i]));
+    }
 
     VkCommandBufferAllocateInfo allocate_info{};
     allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocate_info.commandPool = m_command_pool;
+    allocate_info.commandPool = m_immediate_pool;
     allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocate_info.commandBufferCount = static_cast<u32>(m_command_buffers.size());
+    allocate_info.commandBufferCount = 1;
+
+    VK_CHECK(vkAllocateCommandBuffers(m_device, &allocate_info, &m_immediate_cmd));
+}
+
+void Renderer::CreateRecordingPools()
+{
+    // Buffers are never reset one by one, the whole pool is reset before its frame records again
+    VkCommandPoolCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    create_info.queueFamilyIndex = m_queue_family;
+
+    // One for each job system thread, and one for the thread calling Draw, in case it is not among them
+    const u32 thread_count = m_parallel_recording ? m_jobs.ThreadCount() + 1 : 1;
+
+    m_recording_pools.resize(m_frames_in_flight);
+
+    for (auto& pools : m_recording_pools) {
+        pools.resize(thread_count);
 
-    VK_CHECK(vkAllocateCommandBuffers(m_device, &allocate_info, m_command_buffers.data()));
+        for (auto& pool : pools) {
+            VK_CHECK(vkCreateCommandPool(m_device, &create_info, RendererCallbacks, &pool.pool));
+            pool.used = 0;
+        }
+    }
+
+    m_frame_secondaries.resize(m_frames_in_flight);
+    m_secondary_versions.assign(m_frames_in_flight, 0);
 }
 
 void Renderer::CreateSemaphores()
@@ -710,19 +1551,76 @@ void Renderer::CreateSemaphores()
     VkSemaphoreCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    m_image_available_semaphores.resize(m_swapchain.image_count);
+    m_image_available_semaphores.resize(m_frames_in_flight);
 
     for (size_t i = 0; i < m_image_available_semaphores.size(); ++i) {
-        VK_CHECK(vkCreateSemaphore(m_device, &create_info, nullptr, &m_image_available_semaphores[i]));
+        VK_CHECK(vkCreateSemaphore(m_device, &create_info, RendererCallbacks, &m_image_available_semaphores[i]));
     }
 
-    m_render_finished_semaphores.resize(m_swapchain.image_count);
+    CreateSwapchainSemaphores();
+
+    m_frame_timeline_values.assign(m_frames_in_flight, 0);
+    if (!m_timeline) return;
+
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    create_info.pNext = &type_info;
 
-    for (size_t i = 0; i < m_render_finished_semaphores.size(); ++i) {
-        VK_CHECK(vkCreateSemaphore(m_device, &create_info, nullptr, &m_render_finished_semaphores[i]));
+    VK_CHECK(vkCreateSemaphore(m_device, &create_info, RendererCallbacks, &m_queue_timeline));
+}
+
+void Renderer::RecreateSwapchain()
+{
+    memory::FrameAllocationPause pause;
+
+    // Frames still queued for present refer to the swapchain being retired
+    WaitForSubmissions();
+
+    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physical_device, m_surface, &m_gpu.surface_caps));
+
+    // Frames in flight may still render to the old images or wait to present them. The
+    // last of them was submitted before this frame, which retires no earlier than they do
+    m_deletion_queue.Push(m_frame_index, [this,
+        swapchain = m_swapchain.swapchain,
+        image_views = std::move(m_swapchain.image_views),
+        framebuffers = std::move(m_swapchain.framebuffers),
+        semaphores = std::move(m_swapchain.render_finished_semaphores)]() mutable {
+        for (auto& framebuffer : framebuffers) vkDestroyFramebuffer(m_device, framebuffer, RenderTargetCallbacks);
+
+        for (size_t i = 0; i < image_views.size(); ++i) {
+            vkDestroyImageView(m_device, image_views[i], RenderTargetCallbacks);
+            vkDestroySemaphore(m_device, semaphores[i], RendererCallbacks);
+        }
+
+        vkDestroySwapchainKHR(m_device, swapchain, RenderTargetCallbacks);
+    });
+
+    // The old swapchain is handed over through oldSwapchain, and retired by it
+    CreateSwapchain();
+    CreateSwapchainSemaphores();
+    BuildRenderGraph();
+    if (!m_dynamic_rendering) CreateFramebuffers();
+
+    // Recorded draws set the viewport to the old extent
+    ++m_scene_version;
+}
+
+void Renderer::CreateSwapchainSemaphores()
+{
+    VkSemaphoreCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    auto& semaphores = m_swapchain.render_finished_semaphores;
+    semaphores.resize(m_swapchain.images.size());
+
+    for (size_t i = 0; i < semaphores.size(); ++i) {
+        VK_CHECK(vkCreateSemaphore(m_device, &create_info, RendererCallbacks, &semaphores[i]));
     }
 
-    m_semaphores_index = 0;
+    m_swapchain.image_frames.assign(m_swapchain.images.size(), UINT32_MAX);
 }
 
 void Renderer::CreateFences()
@@ -731,99 +1629,808 @@ void Renderer::CreateFences()
     create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    m_fences.resize(m_swapchain.image_count);
+    // Frames wait on the queue's timeline semaphore instead
+    if (m_timeline) return;
+
+    m_fences.resize(m_frames_in_flight);
 
     for (size_t i = 0; i < m_fences.size(); ++i) {
-        VK_CHECK(vkCreateFence(m_device, &create_info, nullptr, &m_fences[i]));
+        VK_CHECK(vkCreateFence(m_device, &create_info, RendererCallbacks, &m_fences[i]));
+    }
+}
+
+void Renderer::CreateFrameArenas()
+{
+    m_frame_arenas.clear();
+    m_frame_arenas.reserve(m_frames_in_flight);
+
+    for (u32 i = 0; i < m_frames_in_flight; ++i) {
+        m_frame_arenas.emplace_back(FrameArenaSize);
+    }
+}
+
+u32 Renderer::CreateTexture(const std::filesystem::path& path)
+{
+    if (path.extension() == ".vtex") return CreateVirtualTexture(path);
+
+    return CreateTextures({ &path, 1 })[0];
+}
+
+u32 Renderer::CreateVirtualTexture(const std::filesystem::path& path)
+{
+    if (!m_virtual_textures) FatalError("virtual textures are not supported, unable to load {}", path.string());
+
+    RequestRedraw();
+
+    Texture texture{};
+    texture.slot = m_virtual_cache.Register(path);
+    texture.virtual_texture = true;
+
+    m_textures.push_back(texture);
+    return static_cast<u32>(m_textures.size() - 1);
+}
+
+std::vector<u32> Renderer::CreateTextures(std::span<const std::filesystem::path> paths)
+{
+    TextureBatch batch;
+    batch.paths.assign(paths.begin(), paths.end());
+
+    LoadTextures(batch);
+
+    const VkCommandBuffer cmd = BeginImmediateCommands();
+    RecordTextureUploads(batch, cmd);
+    SubmitImmediateCommands(cmd);
+
+    return AddTextures(batch);
+}
+
+void Renderer::LoadTextures(TextureBatch& batch)
+{
+    const std::vector<std::filesystem::path>& paths = batch.paths;
+
+    std::vector<TextureBatch::PendingTexture>& pending = batch.pending;
+    pending.resize(paths.size());
+
+    // Streaming reads share the job system, and are not waited on here
+    JobCounter loads;
+
+    // Headers alone are enough to lay out the staging buffer before decoding anything
+    for (size_t i = 0; i < paths.size(); ++i) {
+        m_jobs.Submit([&, i] {
+            TextureBatch::PendingTexture& texture = pending[i];
+            texture.ktx2 = paths[i].extension() == ".ktx2";
+
+            if (texture.ktx2) {
+                texture.info = ktx2::ReadInfo(paths[i]);
+                return;
+            }
+
+            std::ifstream file{ paths[i], std::ios::binary | std::ios::ate };
+            if (!file) FatalError("failed to open {}", paths[i].string());
+
+            texture.file.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char *>(texture.file.data()), texture.file.size());
+
+            texture.info.format = VK_FORMAT_R8G8B8A8_UNORM;
+            texture.native_png = png::ReadInfo(texture.file, texture.info.size);
+
+            if (!texture.native_png) {
+                int width, height, channels;
+                if (!stbi_info_from_memory(texture.file.data(), static_cast<int>(texture.file.size()), &width, &height, &channels)) {
+                    FatalError("failed to load texture {}: {}", paths[i].string(), stbi_failure_reason());
+                }
+
+                texture.info.size = { static_cast<u32>(width), static_cast<u32>(height) };
+            }
+        }, &loads);
+    }
+
+    m_jobs.Wait(loads);
+
+    std::vector<TextureBatch::PendingAtlas>& atlases = batch.atlases;
+
+    // Atlases need a per-draw UV transform, which only the bindless path pushes
+    if (m_bindless && m_settings.texture_atlas) {
+        const auto block_size = [](u32 size) { return (size + 2 * AtlasGutter + AtlasGutter - 1) / AtlasGutter * AtlasGutter; };
+
+        std::vector<size_t> small;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            const VkExtent2D size = pending[i].info.size;
+            if (!pending[i].ktx2 && std::max(size.width, size.height) <= AtlasMaxTextureSize) small.push_back(i);
+        }
+
+        // Tallest first keeps the skyline flat
+        std::stable_sort(small.begin(), small.end(), [&](size_t a, size_t b) { return pending[a].info.size.height > pending[b].info.size.height; });
+
+        while (small.size() > 1) {
+            // The smallest atlas that holds everything left, otherwise the largest filled as far as it goes
+            VkExtent2D atlas_size;
+            std::vector<size_t> packed, left;
+
+            for (u32 size = AtlasMinSize; size <= AtlasMaxSize; size *= 2) {
+                atlas::SkylinePacker packer{ { size, size } };
+                atlas_size = packer.Size();
+                packed.clear();
+                left.clear();
+
+                for (size_t i : small) {
+                    const VkExtent2D extent = pending[i].info.size;
+                    (packer.Pack(block_size(extent.width), block_size(extent.height), pending[i].block) ? packed : left).push_back(i);
+                }
+
+                if (left.empty()) break;
+            }
+
+            // A texture on its own gains nothing from an atlas
+            if (packed.size() < 2) break;
+
+            TextureBatch::PendingAtlas atlas{};
+            atlas.size = atlas_size;
+            atlas.count = static_cast<u32>(packed.size());
+
+            for (size_t i : packed) {
+                pending[i].atlas = static_cast<u32>(atlases.size());
+                atlas.texels += u64(pending[i].info.size.width) * pending[i].info.size.height;
+            }
+
+            atlases.push_back(std::move(atlas));
+            small = std::move(left);
+        }
+    }
+
+    const bool gpu_mips = SupportsBlitMips(VK_FORMAT_R8G8B8A8_UNORM);
+    size_t staging_size = 0;
+
+    for (auto& texture : pending) {
+        const VkExtent2D size = texture.info.size;
+
+        bc::Format bc_format;
+        texture.decode = bc::FromVulkanFormat(texture.info.format, bc_format) && !SupportsSampling(texture.info.format);
+        texture.format = texture.decode ? VK_FORMAT_R8G8B8A8_UNORM : texture.info.format;
+
+        if (!SupportsSampling(texture.format)) FatalError("texture format {} is not supported", static_cast<u32>(texture.format));
+        if (texture.atlas != UINT32_MAX) continue;
+
+        // Each texture starts on a boundary suitable for any block size
+        staging_size = (staging_size + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+
+        texture.stream = m_streaming && texture.ktx2 && !texture.decode;
+        texture.first_level = texture.stream ? TextureStreamer::TailLevel(size, texture.info.MipLevels()) : 0;
+
+        if (texture.ktx2) {
+            texture.mip_levels = texture.info.MipLevels() - texture.first_level;
+
+            for (u32 level = texture.first_level; level < texture.info.MipLevels(); ++level) {
+                const VkExtent2D extent = mipmap::LevelExtent(size, level);
+                const size_t level_size = texture.decode ? size_t(extent.width) * extent.height * 4 : texture.info.levels[level].size;
+
+                staging_size = (staging_size + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+                texture.staged.push_back({ staging_size, level_size });
+                staging_size += level_size;
+            }
+        } else {
+            texture.mip_levels = mipmap::LevelCount(size);
+
+            // A CPU generated chain must be packed the way mipmap::GenerateRGBA8 expects
+            const u32 staged_levels = gpu_mips ? 1 : texture.mip_levels;
+
+            for (u32 level = 0; level < staged_levels; ++level) {
+                const VkExtent2D extent = mipmap::LevelExtent(size, level);
+                texture.staged.push_back({ staging_size + mipmap::LevelOffset(size, level), size_t(extent.width) * extent.height * 4 });
+            }
+
+            staging_size += mipmap::ChainSize(size, staged_levels);
+        }
+    }
+
+    for (auto& atlas : atlases) {
+        staging_size = (staging_size + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+
+        const u32 staged_levels = gpu_mips ? 1 : AtlasMipLevels;
+
+        for (u32 level = 0; level < staged_levels; ++level) {
+            const VkExtent2D extent = mipmap::LevelExtent(atlas.size, level);
+            atlas.staged.push_back({ staging_size + mipmap::LevelOffset(atlas.size, level), size_t(extent.width) * extent.height * 4 });
+        }
+
+        staging_size += mipmap::ChainSize(atlas.size, staged_levels);
+    }
+
+    Buffer& staging_buffer = batch.staging_buffer;
+    staging_buffer.Setup(m_allocator, staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+
+    u8 *address = static_cast<u8 *>(staging_buffer.Map());
+
+    // Every texture decodes concurrently, and stored levels are further split into bands
+    for (size_t i = 0; i < paths.size(); ++i) {
+        TextureBatch::PendingTexture& texture = pending[i];
+
+        if (!texture.ktx2) {
+            m_jobs.Submit([&, i] {
+                const VkExtent2D size = texture.info.size;
+
+                // Atlased images are decoded aside, then copied into their block
+                std::vector<u8> decoded;
+                if (texture.atlas != UINT32_MAX) decoded.resize(size_t(size.width) * size.height * 4);
+
+                u8 *chain = texture.atlas != UINT32_MAX ? decoded.data() : address + texture.staged[0].offset;
+
+                // Anything the native decoder turns down, such as 16-bit or interlaced PNGs, goes through stb_image
+                if (!texture.native_png || !png::DecodeRGBA8(texture.file, chain)) {
+                    int width, height, channels;
+                    stbi_uc *pixels = stbi_load_from_memory(texture.file.data(), static_cast<int>(texture.file.size()), &width, &height, &channels, STBI_rgb_alpha);
+                    if (!pixels) FatalError("failed to load texture {}: {}", paths[i].string(), stbi_failure_reason());
+
+                    std::memcpy(chain, pixels, size_t(size.width) * size.height * 4);
+                    stbi_image_free(pixels);
+                }
+
+                texture.file = {};
+
+                if (texture.atlas != UINT32_MAX) {
+                    const TextureBatch::PendingAtlas& atlas = atlases[texture.atlas];
+                    atlas::Blit(chain, size, address + atlas.staged[0].offset, atlas.size.width, texture.block, AtlasGutter);
+                    return;
+                }
+
+                const u32 staged_levels = static_cast<u32>(texture.staged.size());
+                if (staged_levels > 1) mipmap::GenerateRGBA8(chain, size, staged_levels);
+            }, &loads);
+
+            continue;
+        }
+
+        for (u32 level = texture.first_level; level < texture.info.MipLevels(); ++level) {
+            const TextureData::Level src = texture.info.levels[level];
+            const TextureData::Level dst = texture.staged[level - texture.first_level];
+
+            if (texture.decode) {
+                m_jobs.Submit([&, i, level, src, dst] {
+                    std::vector<u8> blocks(src.size);
+                    ktx2::ReadRange(paths[i], src.offset, src.size, blocks.data());
+
+                    bc::Format bc_format;
+                    bc::FromVulkanFormat(texture.info.format, bc_format);
+
+                    bc::Decode(bc_format, blocks.data(), mipmap::LevelExtent(texture.info.size, level), address + dst.offset);
+                }, &loads);
+
+                continue;
+            }
+
+            for (size_t band = 0; band < src.size; band += TextureBandSize) {
+                const size_t band_size = std::min(TextureBandSize, src.size - band);
+
+                m_jobs.Submit([&, i, src, dst, band, band_size] {
+                    ktx2::ReadRange(paths[i], src.offset + band, band_size, address + dst.offset + band);
+                }, &loads);
+            }
+        }
+    }
+
+    m_jobs.Wait(loads);
+
+    // Atlas levels can only be built once every block is in place
+    for (auto& atlas : atlases) {
+        const u32 staged_levels = static_cast<u32>(atlas.staged.size());
+        if (staged_levels > 1) m_jobs.Submit([&atlas, address, staged_levels] { mipmap::GenerateRGBA8(address + atlas.staged[0].offset, atlas.size, staged_levels); }, &loads);
+    }
+
+    m_jobs.Wait(loads);
+    staging_buffer.Unmap();
+
+    // Images are made here too, so that recording the upload is all that is left for the renderer
+    for (auto& atlas : atlases) {
+        atlas.texture.image.Setup(m_device, m_allocator, atlas.size, VK_FORMAT_R8G8B8A8_UNORM, AtlasMipLevels, false);
+    }
+
+    for (auto& texture : pending) {
+        if (texture.atlas != UINT32_MAX) continue;
+
+        const VkExtent2D extent = mipmap::LevelExtent(texture.info.size, texture.first_level);
+        texture.texture.image.Setup(m_device, m_allocator, extent, texture.format, texture.mip_levels, false);
     }
 }
 
-void Renderer::CreateTexture()
+void Renderer::RecordTextureUploads(TextureBatch& batch, VkCommandBuffer cmd)
 {
-    int width, height, channels;
-    stbi_uc* pixels = stbi_load("../../../asset/texture/viking_room.png", &width, &height, &channels, STBI_rgb_alpha);
-    assert(pixels);
+    const VkBuffer staging_buffer = batch.staging_buffer.Handle();
+
+    for (auto& atlas : batch.atlases) {
+        atlas.texture.image.RecordUpload(cmd, staging_buffer, atlas.staged);
+    }
+
+    for (auto& texture : batch.pending) {
+        if (texture.atlas == UINT32_MAX) texture.texture.image.RecordUpload(cmd, staging_buffer, texture.staged);
+    }
+}
+
+std::vector<u32> Renderer::AddTextures(TextureBatch& batch)
+{
+    if (!m_bindless && m_textures.size() + batch.pending.size() > MaxLegacyTextures) FatalError("too many textures ({})", MaxLegacyTextures);
+
+    RequestRedraw();
+
+    batch.staging_buffer.Destroy();
+
+    std::vector<TextureBatch::PendingTexture>& pending = batch.pending;
+    std::vector<TextureBatch::PendingAtlas>& atlases = batch.atlases;
+
+    for (size_t i = 0; i < atlases.size(); ++i) {
+        TextureBatch::PendingAtlas& atlas = atlases[i];
+        atlas.texture.slot = m_textures[AddTexture(atlas.texture)].slot;
+
+        const u64 area = u64(atlas.size.width) * atlas.size.height;
+        fmt::print("texture atlas {}: {} textures in {}x{}, {:.1f}% of texels used\n", i, atlas.count, atlas.size.width, atlas.size.height, 100.0 * atlas.texels / area);
+    }
+
+    std::vector<u32> ids;
+    ids.reserve(pending.size());
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+        TextureBatch::PendingTexture& texture = pending[i];
+
+        if (texture.atlas != UINT32_MAX) {
+            const TextureBatch::PendingAtlas& atlas = atlases[texture.atlas];
+            const glm::vec2 atlas_size{ atlas.size.width, atlas.size.height };
+
+            // Shares the atlas image and slot, and maps its UVs onto the block inside the gutter
+            texture.texture.slot = atlas.texture.slot;
+            texture.texture.atlased = true;
+            texture.texture.uv_scale = glm::vec2{ texture.info.size.width, texture.info.size.height } / atlas_size;
+            texture.texture.uv_offset = glm::vec2{ texture.block.x + AtlasGutter, texture.block.y + AtlasGutter } / atlas_size;
+
+            m_textures.push_back(texture.texture);
+            ids.push_back(static_cast<u32>(m_textures.size() - 1));
+            continue;
+        }
+
+        const u32 id = AddTexture(texture.texture);
+
+        if (texture.stream) {
+            Texture& added = m_textures[id];
+            added.stream_id = m_streamer.Register(batch.paths[i], texture.info, added.image, texture.first_level, added.slot);
+        }
+
+        ids.push_back(id);
+    }
+
+    return ids;
+}
+
+u32 Renderer::CreateTexture(const u8 *pixels, VkExtent2D size)
+{
+    if (!m_bindless && m_textures.size() == MaxLegacyTextures) FatalError("too many textures ({})", MaxLegacyTextures);
+
+    const VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    const u32 mip_levels = mipmap::LevelCount(size);
+
+    // Without linear filtered blits the chain is generated on the CPU and uploaded whole
+    const u32 staged_levels = SupportsBlitMips(format) ? 1 : mip_levels;
 
     Buffer staging_buffer;
-    staging_buffer.Setup(m_allocator, width * height * 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    
-    void *address = staging_buffer.Map();
-    std::memcpy(address, pixels, width * height * 4);
+    staging_buffer.Setup(m_allocator, mipmap::ChainSize(size, staged_levels), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+
+    u8 *address = static_cast<u8 *>(staging_buffer.Map());
+    std::memcpy(address, pixels, size_t(size.width) * size.height * 4);
+    if (staged_levels > 1) mipmap::GenerateRGBA8(address, size, staged_levels);
     staging_buffer.Unmap();
 
-    VkExtent2D size{ width, height };
-    m_texture.Setup(m_device, m_allocator, size, VK_FORMAT_R8G8B8A8_UNORM, false);
+    std::vector<TextureData::Level> levels;
+
+    for (u32 level = 0; level < staged_levels; ++level) {
+        const VkExtent2D extent = mipmap::LevelExtent(size, level);
+        levels.push_back({ mipmap::LevelOffset(size, level), size_t(extent.width) * extent.height * 4 });
+    }
+
+    Texture texture{};
+    texture.image.Setup(m_device, m_allocator, size, format, mip_levels, false);
+
+    const VkCommandBuffer cmd = BeginImmediateCommands();
+    texture.image.RecordUpload(cmd, staging_buffer.Handle(), levels);
+    SubmitImmediateCommands(cmd);
 
+    staging_buffer.Destroy();
+
+    return AddTexture(texture);
+}
+
+u32 Renderer::CreateTexture(const TextureData& data)
+{
+    RequestRedraw();
+
+    bc::Format bc_format;
+
+    if (bc::FromVulkanFormat(data.format, bc_format) && !SupportsSampling(data.format)) {
+        TextureData decoded;
+        decoded.format = VK_FORMAT_R8G8B8A8_UNORM;
+        decoded.size = data.size;
+
+        for (u32 level = 0; level < data.MipLevels(); ++level) {
+            const VkExtent2D extent = mipmap::LevelExtent(data.size, level);
+            const size_t offset = decoded.data.size();
+            const size_t size = size_t(extent.width) * extent.height * 4;
+
+            decoded.levels.push_back({ offset, size });
+            decoded.data.resize(offset + size);
+
+            bc::Decode(bc_format, data.LevelData(level), extent, decoded.data.data() + offset);
+        }
+
+        return CreateTexture(decoded);
+    }
+
+    if (!SupportsSampling(data.format)) FatalError("texture format {} is not supported", static_cast<u32>(data.format));
+    if (!m_bindless && m_textures.size() == MaxLegacyTextures) FatalError("too many textures ({})", MaxLegacyTextures);
+
+    Buffer staging_buffer;
+    staging_buffer.Setup(m_allocator, data.data.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+
+    std::memcpy(staging_buffer.Map(), data.data.data(), data.data.size());
+    staging_buffer.Unmap();
+
+    Texture texture{};
+    texture.image.Setup(m_device, m_allocator, data.size, data.format, data.MipLevels(), false);
+
+    const VkCommandBuffer cmd = BeginImmediateCommands();
+    texture.image.RecordUpload(cmd, staging_buffer.Handle(), data.levels);
+    SubmitImmediateCommands(cmd);
+
+    staging_buffer.Destroy();
+
+    return AddTexture(texture);
+}
+
+VkCommandBuffer Renderer::BeginImmediateCommands()
+{
     VkCommandBufferBeginInfo begin_info{};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    const VkCommandBuffer cmd = m_command_buffers[0];
+    // The last immediate submission was waited for, so the pool is free to reset
+    VK_CHECK(vkResetCommandPool(m_device, m_immediate_pool, 0));
+    VK_CHECK(vkBeginCommandBuffer(m_immediate_cmd, &begin_info));
 
-    VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+    return m_immediate_cmd;
+}
 
-    {
-        VkImageMemoryBarrier image_barrier{};
-        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        image_barrier.srcAccessMask = 0;
-        image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        image_barrier.image = m_texture.Handle();
-        image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        image_barrier.subresourceRange.baseMipLevel = 0;
-        image_barrier.subresourceRange.levelCount = 1;
-        image_barrier.subresourceRange.baseArrayLayer = 0;
-        image_barrier.subresourceRange.layerCount = 1;
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
-    }
-
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageSubresource.mipLevel = 0;
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = { size.width, size.height, 1 };
-
-    vkCmdCopyBufferToImage(cmd, staging_buffer.Handle(), m_texture.Handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+void Renderer::SubmitImmediateCommands(VkCommandBuffer cmd)
+{
+    VK_CHECK(vkEndCommandBuffer(cmd));
 
-    {
-        VkImageMemoryBarrier image_barrier{};
-        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        image_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        image_barrier.image = m_texture.Handle();
-        image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        image_barrier.subresourceRange.baseMipLevel = 0;
-        image_barrier.subresourceRange.levelCount = 1;
-        image_barrier.subresourceRange.baseArrayLayer = 0;
-        image_barrier.subresourceRange.layerCount = 1;
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+    // Frames handed over before this must take their timeline values first
+    WaitForSubmissions();
+
+    std::unique_lock lock{m_queue_mutex};
+
+    const u64 value = NextTimelineValue();
+    Submit(cmd, VK_NULL_HANDLE, VK_PIPELINE_STAGE_2_NONE, VK_NULL_HANDLE, VK_NULL_HANDLE, value);
+
+    // Waiting for this submission alone leaves other work on the queue running
+    if (!m_timeline) {
+        VK_CHECK(vkQueueWaitIdle(m_queue));
+        return;
     }
 
-    VK_CHECK(vkEndCommandBuffer(cmd));
+    lock.unlock();
 
-    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &m_queue_timeline;
+    wait_info.pValues = &value;
 
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pWaitDstStageMask = &wait_stage;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &m_command_buffers[0];
+    VK_CHECK(vkWaitSemaphores(m_device, &wait_info, UINT64_MAX));
+}
+
+u32 Renderer::AddTexture(Texture& texture)
+{
+    if (m_bindless) {
+        texture.slot = m_texture_table.Allocate(texture.image);
+    } else {
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = m_descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &m_descriptor_set_layout;
+
+        VK_CHECK(vkAllocateDescriptorSets(m_device, &alloc_info, &texture.descriptor_set));
+
+        VkDescriptorBufferInfo buffer_info{};
+        buffer_info.buffer = m_uniform_buffer.Handle();
+        buffer_info.offset = 0;
+        buffer_info.range = sizeof(glm::mat4);
+
+        VkDescriptorImageInfo image_info{};
+        image_info.sampler = texture.image.Sampler();
+        image_info.imageView = texture.image.View();
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet writes[2]{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = texture.descriptor_set;
+        writes[0].dstBinding = 0;
+        writes[0].dstArrayElement = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        writes[0].pBufferInfo = &buffer_info;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = texture.descriptor_set;
+        writes[1].dstBinding = 1;
+        writes[1].dstArrayElement = 0;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[1].pImageInfo = &image_info;
+
+        vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+    }
 
-    vkQueueSubmit(m_queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_queue);
+    m_textures.push_back(texture);
+    return static_cast<u32>(m_textures.size() - 1);
+}
 
-    staging_buffer.Destroy();
-    stbi_image_free(pixels);
+TextureHandle Renderer::RequestTexture(std::filesystem::path path)
+{
+    memory::FrameAllocationPause pause;
+
+    TextureHandle handle = TextureHandle::Create();
+
+    m_pending_requests.fetch_add(1, std::memory_order_release);
+    m_texture_requests.Push({ std::move(path), handle });
+
+    return handle;
+}
+
+ModelHandle Renderer::RequestModel(memory::TaggedVector<u32, memory::Tag::Models> indices,
+    memory::TaggedVector<Vertex, memory::Tag::Models> vertices, TextureHandle texture)
+{
+    memory::FrameAllocationPause pause;
+
+    ModelHandle handle = ModelHandle::Create();
+
+    m_pending_requests.fetch_add(1, std::memory_order_release);
+    m_model_requests.Push({ std::move(indices), std::move(vertices), std::move(texture), handle });
+
+    return handle;
+}
+
+BufferHandle Renderer::RequestBuffer(std::vector<u8> data, VkBufferUsageFlags usage, memory::Tag tag)
+{
+    assert(!data.empty());
+
+    memory::FrameAllocationPause pause;
+
+    BufferHandle handle = BufferHandle::Create();
+
+    m_pending_requests.fetch_add(1, std::memory_order_release);
+    m_buffer_requests.Push({ std::move(data), usage, tag, handle });
+
+    return handle;
+}
+
+void Renderer::ProcessRequests()
+{
+    UpdateRequests();
+
+    // Nothing draws to take the upload along, so it is submitted on its own
+    if (m_recorded_upload) {
+        WaitForSubmissions();
+
+        std::lock_guard lock{m_queue_mutex};
+
+        TextureBatch& batch = *m_recorded_upload;
+        batch.timeline_value = NextTimelineValue();
+        batch.submitted = true;
+
+        Submit(batch.cmd, VK_NULL_HANDLE, VK_PIPELINE_STAGE_2_NONE, VK_NULL_HANDLE, batch.fence, batch.timeline_value);
+        m_recorded_upload = nullptr;
+    }
+}
+
+void Renderer::UpdateRequests()
+{
+    if (!RequestsPending()) return;
+
+    memory::FrameAllocationPause pause;
+
+    std::unique_ptr<TextureBatch> batch;
+
+    while (auto request = m_texture_requests.TryPop()) {
+        if (request->path.extension() == ".vtex") {
+            request->handle.Fulfil(CreateVirtualTexture(request->path));
+            m_pending_requests.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        if (!batch) batch = std::make_unique<TextureBatch>();
+
+        batch->paths.push_back(std::move(request->path));
+        batch->handles.push_back(std::move(request->handle));
+    }
+
+    // Loading waits on jobs of its own, so it runs as a job too rather than on the drawing thread
+    if (batch) {
+        TextureBatch& loading = *batch;
+        m_jobs.Submit([this, &loading] { LoadTextures(loading); }, &loading.loaded);
+
+        m_texture_batches.push_back(std::move(batch));
+    }
+
+    for (size_t i = 0; i < m_texture_batches.size();) {
+        TextureBatch& uploading = *m_texture_batches[i];
+
+        // One upload goes out with each frame
+        if (uploading.cmd == VK_NULL_HANDLE) {
+            if (uploading.loaded.Done() && !m_recorded_upload) RecordTextureBatch(uploading);
+
+            ++i;
+            continue;
+        }
+
+        if (!UploadFinished(uploading)) {
+            ++i;
+            continue;
+        }
+
+        if (uploading.fence != VK_NULL_HANDLE) vkDestroyFence(m_device, uploading.fence, RendererCallbacks);
+        vkFreeCommandBuffers(m_device, m_upload_pool, 1, &uploading.cmd);
+
+        const std::vector<u32> ids = AddTextures(uploading);
+
+        for (size_t j = 0; j < ids.size(); ++j) uploading.handles[j].Fulfil(ids[j]);
+        m_pending_requests.fetch_sub(static_cast<u32>(ids.size()), std::memory_order_release);
+
+        m_texture_batches.erase(m_texture_batches.begin() + i);
+    }
+
+    while (auto request = m_model_requests.TryPop()) m_waiting_models.push_back(std::move(*request));
+
+    // Textures may be requested after the models that use them, and only load in a later frame
+    for (size_t i = 0; i < m_waiting_models.size();) {
+        ModelRequest& request = m_waiting_models[i];
+
+        if (request.texture.Valid() && !request.texture.Ready()) {
+            ++i;
+            continue;
+        }
+
+        auto build = std::make_unique<ModelBuild>();
+        build->model = std::make_unique<Model>(m_allocator);
+        build->handle = std::move(request.handle);
+
+        Model& model = *build->model;
+        model.indices = std::move(request.indices);
+        model.vertices = std::move(request.vertices);
+        if (request.texture.Valid()) model.texture_id = request.texture.Id();
+
+        // Buffers are host visible, so building them is only allocation and copying
+        m_jobs.Submit([&model] { model.BuildBuffers(); }, &build->built);
+        m_model_builds.push_back(std::move(build));
+
+        m_waiting_models.erase(m_waiting_models.begin() + i);
+    }
+
+    for (size_t i = 0; i < m_model_builds.size();) {
+        ModelBuild& build = *m_model_builds[i];
+
+        if (!build.built.Done()) {
+            ++i;
+            continue;
+        }
+
+        m_models.push_back(std::move(build.model));
+        InvalidateScene();
+
+        build.handle.Fulfil(static_cast<u32>(m_models.size() - 1));
+        m_pending_requests.fetch_sub(1, std::memory_order_release);
+
+        m_model_builds.erase(m_model_builds.begin() + i);
+    }
+
+    while (auto request = m_buffer_requests.TryPop()) {
+        auto build = std::make_unique<BufferBuild>();
+        build->request = std::move(*request);
+
+        BufferBuild& building = *build;
+        m_jobs.Submit([this, &building] {
+            const std::vector<u8>& data = building.request.data;
+            building.buffer.Setup(m_allocator, data.size(), building.request.usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, building.request.tag);
+
+            std::memcpy(building.buffer.Map(), data.data(), data.size());
+            building.buffer.Unmap();
+        }, &building.built);
+
+        m_buffer_builds.push_back(std::move(build));
+    }
+
+    for (size_t i = 0; i < m_buffer_builds.size();) {
+        BufferBuild& build = *m_buffer_builds[i];
+
+        if (!build.built.Done()) {
+            ++i;
+            continue;
+        }
+
+        m_buffers.push_back(build.buffer);
+
+        build.request.handle.Fulfil(static_cast<u32>(m_buffers.size() - 1));
+        m_pending_requests.fetch_sub(1, std::memory_order_release);
+
+        m_buffer_builds.erase(m_buffer_builds.begin() + i);
+    }
+}
+
+void Renderer::RecordTextureBatch(TextureBatch& batch)
+{
+    VkCommandBufferAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool = m_upload_pool;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+
+    VK_CHECK(vkAllocateCommandBuffers(m_device, &allocate_info, &batch.cmd));
+
+    if (!m_timeline) {
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VK_CHECK(vkCreateFence(m_device, &fence_info, RendererCallbacks, &batch.fence));
+    }
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(batch.cmd, &begin_info));
+    RecordTextureUploads(batch, batch.cmd);
+    VK_CHECK(vkEndCommandBuffer(batch.cmd));
+
+    m_recorded_upload = &batch;
+}
+
+bool Renderer::UploadFinished(const TextureBatch& batch) const
+{
+    if (!batch.submitted) return false;
+    if (!m_timeline) return vkGetFenceStatus(m_device, batch.fence) == VK_SUCCESS;
+
+    u64 value;
+    VK_CHECK(vkGetSemaphoreCounterValue(m_device, m_queue_timeline, &value));
+
+    return value >= batch.timeline_value;
+}
+
+void Renderer::RequestTextureLevels(const Camera& cam)
+{
+    // Scale from a sphere's angular size to its height in pixels on screen
+    const float pixels_per_unit = static_cast<float>(m_swapchain.extent.height) / std::tan(glm::radians(cam.fov) * 0.5f);
+    const glm::vec3 forward = glm::normalize(cam.dir);
+
+    for (const auto& model : m_models) {
+        const Texture& texture = m_textures[model->texture_id];
+        if (texture.stream_id == UINT32_MAX) continue;
+
+        const glm::vec3 to_center = model->BoundsCenter() - cam.pos;
+        const float distance = glm::length(to_center);
+        const float radius = model->BoundsRadius();
+
+        // Models entirely behind the camera leave their textures to shrink
+        if (glm::dot(to_center, forward) < -radius) continue;
+
+        u32 level = 0;
+
+        // Assumes the texture is stretched once across the model, which holds for unique UV layouts
+        if (distance > radius) {
+            const float pixels = std::max(radius / distance * pixels_per_unit, 1.0f);
+            const VkExtent2D extent = m_streamer.Extent(texture.stream_id);
+            const float texels = static_cast<float>(std::max(extent.width, extent.height));
+
+            if (texels > pixels) level = static_cast<u32>(std::log2(texels / pixels));
+        }
+
+        m_streamer.Request(texture.stream_id, std::min(level, m_streamer.LevelCount(texture.stream_id) - 1));
+    }
 }
 
 void Renderer::SelectOptimalPhysicalDevice(VkPhysicalDeviceType type)
@@ -853,6 +2460,37 @@ void Renderer::SelectOptimalPhysicalDevice(VkPhysicalDeviceType type)
     }
 }
 
+bool Renderer::SupportsBindless() const
+{
+    const auto& features12 = m_gpu.features12;
+
+    return features12.runtimeDescriptorArray &&
+        features12.descriptorBindingPartiallyBound &&
+        features12.descriptorBindingSampledImageUpdateAfterBind &&
+        features12.descriptorBindingUpdateUnusedWhilePending;
+}
+
+bool Renderer::SupportsSampling(VkFormat format) const
+{
+    bc::Format bc_format;
+    if (bc::FromVulkanFormat(format, bc_format) && !m_gpu.features.textureCompressionBC) return false;
+
+    VkFormatProperties format_props;
+    vkGetPhysicalDeviceFormatProperties(m_physical_device, format, &format_props);
+
+    const VkFormatFeatureFlags sample_features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (format_props.optimalTilingFeatures & sample_features) == sample_features;
+}
+
+bool Renderer::SupportsBlitMips(VkFormat format) const
+{
+    VkFormatProperties format_props;
+    vkGetPhysicalDeviceFormatProperties(m_physical_device, format, &format_props);
+
+    const VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (format_props.optimalTilingFeatures & blit_features) == blit_features;
+}
+
 VkSurfaceFormatKHR Renderer::SelectOptimalSwapchainFormat()
 {
     const VkSurfaceFormatKHR optimal = { VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
@@ -881,13 +2519,53 @@ u32 Renderer::SelectOptimalSwapchainImageCount()
 {
     const auto caps = m_gpu.surface_caps;
 
+    // With a submission thread every frame in flight may hold an image waiting to be presented,
+    // otherwise we will attempt to use (minimum + 1) images so that we will always have
+    // a free image available for rendering
+    const u32 spare = m_settings.submission_thread ? m_frames_in_flight : 1;
+
     // A maximum image count of zero is a special case which indicates
-    // that there is no maximum image limit, therefore we use (minimum + 1)
-    if (caps.maxImageCount == 0) return caps.minImageCount + 1;
+    // that there is no maximum image limit
+    if (caps.maxImageCount == 0) return caps.minImageCount + spare;
 
-    // We will attempt to use (minimum + 1) images so that we will always have
-    // a free image available for rendering
-    return std::min(caps.minImageCount + 1, caps.maxImageCount);
+    return std::min(caps.minImageCount + spare, caps.maxImageCount);
+}
+
+VkPresentModeKHR Renderer::SelectOptimalSwapchainPresentMode()
+{
+    const auto& modes = m_gpu.surface_present_modes;
+    const auto supported = [&](VkPresentModeKHR mode) { return std::find(modes.begin(), modes.end(), mode) != modes.end(); };
+
+    // Mailbox falls back to FIFO rather than immediate, as it was chosen not to tear
+    switch (m_settings.latency_mode) {
+    case LatencyMode::Immediate:
+        if (supported(VK_PRESENT_MODE_IMMEDIATE_KHR)) return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        [[fallthrough]];
+    case LatencyMode::Mailbox:
+        if (supported(VK_PRESENT_MODE_MAILBOX_KHR)) return VK_PRESENT_MODE_MAILBOX_KHR;
+        [[fallthrough]];
+    case LatencyMode::VSync:
+    case LatencyMode::Capped:
+        break;
+    }
+
+    // FIFO is the only mode every surface has to support
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkFormat Renderer::SelectOptimalDepthFormat()
+{
+    // Stencil is never used, so plain 32-bit depth does for devices without either packed format
+    constexpr VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT };
+
+    for (const VkFormat format : candidates) {
+        VkFormatProperties format_props;
+        vkGetPhysicalDeviceFormatProperties(m_physical_device, format, &format_props);
+
+        if (format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) return format;
+    }
+
+    FatalError("no supported depth format");
 }
 
 } // namespace vker
\ No newline at end of file
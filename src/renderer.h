@@ -1,31 +1,127 @@
 #pragma once
 
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
 #include <vector>
 
+#include <glm/vec2.hpp>
+
 #include <vulkan/vulkan.h>
 
 #include "contrib/vk_mem_alloc.h"
 
+#include "arena.h"
 #include "buffer.h"
 #include "camera.h"
+#include "deletion_queue.h"
+#include "frame_limiter.h"
 #include "image.h"
+#include "job_system.h"
 #include "model.h"
+#include "mpsc_queue.h"
+#include "render_graph.h"
+#include "resource_handle.h"
+#include "settings.h"
+#include "spsc_queue.h"
+#include "texture_data.h"
+#include "texture_streamer.h"
+#include "texture_table.h"
 #include "types.h"
+#include "vertex.h"
+#include "virtual_texture.h"
 #include "window.h"
 
 namespace vker {
 
 class Renderer {
 public:
-	Renderer(const Window &window);
+	// Loading and recording run on the job system, which must outlive the renderer
+	Renderer(const Window &window, JobSystem& jobs, const RendererSettings& settings = {});
 	~Renderer();
 
-	void Draw(const Camera& cam);
+	// Paces frames when the latency mode is capped. Call before sampling the frame's
+	// input, and pass the time it returns to Draw, which times it until the frame is submitted
+	FrameLimiter::Clock::time_point BeginFrame();
+
+	void Draw(const Camera& cam, FrameLimiter::Clock::time_point input_time);
 	void Present();
 
-	inline void InvalidateSwapchain() { m_swapchain.valid = false; }
+	// Most recent and smoothed time from BeginFrame until the frame is recorded and
+	// ready to submit, in milliseconds
+	inline float InputToSubmitTime() const { return m_input_to_submit.load(std::memory_order_relaxed); }
+	inline float AverageInputToSubmitTime() const { return m_input_to_submit_average.load(std::memory_order_relaxed); }
+
+	// How long the most recent vkQueuePresentKHR blocked, in milliseconds
+	inline float PresentTime() const { return m_present_time.load(std::memory_order_relaxed); }
+
+	inline void InvalidateSwapchain()
+	{
+		m_swapchain.valid = false;
+		RequestRedraw();
+	}
+
+	// Anything that changes what is on screen asks for a redraw. A few more frames
+	// follow it, so that texture requests and feedback from the change are acted on
+	inline void RequestRedraw() { m_redraw_frames = m_frames_in_flight + 1; }
+
+	// Whether a redraw was requested, or textures are still loading in for earlier frames
+	bool NeedsRedraw() const;
+
+	inline Model& CreateModel()
+	{
+		InvalidateScene();
+		return *m_models.emplace_back(std::make_unique<Model>(m_allocator));
+	}
+
+	// Models changed after the frame they were created in must be reported, so that
+	// draws recorded into static command buffers are recorded again
+	inline void InvalidateScene()
+	{
+		++m_scene_version;
+		RequestRedraw();
+	}
+
+	// PNG and other stb_image formats, or KTX2 and .vtex files written by vker_cook
+	u32 CreateTexture(const std::filesystem::path& path);
+
+	// Decodes every texture concurrently on the loader threads, straight into
+	// one staging buffer, and uploads them all with a single submission
+	std::vector<u32> CreateTextures(std::span<const std::filesystem::path> paths);
+
+	// Block compressed data is decoded first if the device cannot sample it
+	u32 CreateTexture(const TextureData& data);
 
-	inline Model& CreateModel() { return m_models.emplace_back(m_allocator); }
+	// Pages are loaded as they come into view, which needs virtual texture support
+	u32 CreateVirtualTexture(const std::filesystem::path& path);
+
+	// Safe to call from any thread, unlike the Create functions. The handle is returned straight
+	// away, the file loads and decodes on the job system and uploads without the frame waiting
+	// for it, and the handle becomes ready at the start of a frame after the upload has finished.
+	// Textures requested between two frames load together, with a single upload
+	TextureHandle RequestTexture(std::filesystem::path path);
+
+	// Models wait for their texture to be ready before their buffers are built on the job system,
+	// and are plain white without one
+	ModelHandle RequestModel(memory::TaggedVector<u32, memory::Tag::Models> indices,
+		memory::TaggedVector<Vertex, memory::Tag::Models> vertices, TextureHandle texture = {});
+
+	// Host visible buffers holding a copy of the data, made on the job system like model buffers
+	BufferHandle RequestBuffer(std::vector<u8> data, VkBufferUsageFlags usage, memory::Tag tag = memory::Tag::Renderer);
+
+	// On the drawing thread, once the handle is ready. Requested buffers live as long as the renderer
+	inline VkBuffer GetBuffer(const BufferHandle& handle) const { return m_buffers[handle.Id()].Handle(); }
+
+	// Any thread, whether requests are still waiting on frames to be made
+	inline bool RequestsPending() const { return m_pending_requests.load(std::memory_order_acquire) != 0; }
+
+	// Starts on whatever has been requested since the last call, and makes ready whatever has
+	// finished, without waiting for either. Draw does this at the start of every frame, so it
+	// is only needed once nothing draws any more, on the thread that used to
+	void ProcessRequests();
 
 private:
 	void CreateInstance(const Window &window);
@@ -53,39 +149,181 @@ private:
 	void CreateDescriptorPool();
 	void CreatePipeline();
 	void CreateFramebuffers();
-	void CreateCommandPool();
+	void CreateCommandPools();
 	void CreateCommandBuffers();
+	void CreateRecordingPools();
 	void CreateSemaphores();
+	void CreateSwapchainSemaphores();
+
+	// Hands the swapchain over to a new one without waiting for the device, the old
+	// swapchain and everything made for its images are freed as their frames retire
+	void RecreateSwapchain();
 	void CreateFences();
+	void CreateFrameArenas();
 
 	void CreateUniformBuffer();
-	void CreateDepthBuffers();
 
-	Image m_texture;
-	void CreateTexture();
+	// Declares the frame's passes for the current swapchain, and compiles them
+	void BuildRenderGraph();
+	void RecordForwardPass(VkCommandBuffer cmd);
+
+	// Gathers the models into the frame's arena, sorted by texture
+	void BuildDrawList();
+	void RecordDraws(VkCommandBuffer cmd, std::span<const Model *const> draws);
+
+	// Records the draw list into the frame's secondary command buffers, in chunks spread across
+	// the job system's threads, each recording from a command pool of its own
+	void RecordSecondaries();
+
+	struct Texture {
+		Image image;
+
+		// Slot in the bindless texture table, otherwise the
+		// texture's own uniform and sampler descriptor set
+		u32 slot;
+		VkDescriptorSet descriptor_set;
+
+		// Streamed textures are owned by the streamer, which also moves their slot
+		u32 stream_id = UINT32_MAX;
+
+		// Virtual textures have no image, and slot is their page table offset instead
+		bool virtual_texture = false;
+
+		// Atlased textures share their atlas's image and slot, sampling the block their UVs map to
+		bool atlased = false;
+		glm::vec2 uv_scale{ 1.0f };
+		glm::vec2 uv_offset{ 0.0f };
+	};
+
+	std::vector<Texture> m_textures;
+	JobSystem& m_jobs;
+	u32 CreateTexture(const u8 *pixels, VkExtent2D size);
+	u32 AddTexture(Texture& texture);
+
+	// Textures made together, from their files through to the upload
+	struct TextureBatch;
+
+	// Reads and decodes the batch into a staging buffer and makes its images, on any thread
+	void LoadTextures(TextureBatch& batch);
+	void RecordTextureUploads(TextureBatch& batch, VkCommandBuffer cmd);
+
+	// Once the upload has finished, frees the staging buffer and gives the textures their ids
+	std::vector<u32> AddTextures(TextureBatch& batch);
+
+	// Records a loaded batch's upload on a command buffer from the upload pool. The next frame
+	// hands it to the queue just ahead of itself, so its timeline value is taken in order
+	void RecordTextureBatch(TextureBatch& batch);
+	bool UploadFinished(const TextureBatch& batch) const;
+
+	// Starts and finishes requests for Draw, which takes a recorded upload along with its frame
+	void UpdateRequests();
+
+	// Asks the streamer for the mip level each streamed texture covers on screen
+	void RequestTextureLevels(const Camera& cam);
+
+	// Records on a command buffer of its own, and waits for the submission to finish
+	VkCommandBuffer BeginImmediateCommands();
+	void SubmitImmediateCommands(VkCommandBuffer cmd);
 
 	void SelectOptimalPhysicalDevice(VkPhysicalDeviceType type);
+	bool SupportsBindless() const;
+	bool SupportsSampling(VkFormat format) const;
+	bool SupportsBlitMips(VkFormat format) const;
 
 	VkSurfaceFormatKHR SelectOptimalSwapchainFormat();
 	VkExtent2D SelectOptimalSwapchainExtent();
 	u32 SelectOptimalSwapchainImageCount();
+	VkPresentModeKHR SelectOptimalSwapchainPresentMode();
+	VkFormat SelectOptimalDepthFormat();
 
+	// One slice per frame in flight, selected with a dynamic offset
 	Buffer m_uniform_buffer;
 	void *m_uniform_buffer_addr;
+	u32 m_uniform_stride;
+
+	// Models never move once made, so draw lists can point at them
+	std::vector<std::unique_ptr<Model>> m_models;
+
+	struct TextureRequest {
+		std::filesystem::path path;
+		TextureHandle handle;
+	};
+
+	struct ModelRequest {
+		memory::TaggedVector<u32, memory::Tag::Models> indices;
+		memory::TaggedVector<Vertex, memory::Tag::Models> vertices;
+		TextureHandle texture;
+		ModelHandle handle;
+	};
+
+	struct BufferRequest {
+		std::vector<u8> data;
+		VkBufferUsageFlags usage;
+		memory::Tag tag;
+		BufferHandle handle;
+	};
 
-	std::vector<Image> m_depth_buffers;
+	MpscQueue<TextureRequest> m_texture_requests;
+	MpscQueue<ModelRequest> m_model_requests;
+	MpscQueue<BufferRequest> m_buffer_requests;
 
-	std::vector<Model> m_models;
+	// Popped model requests whose texture is not ready yet
+	std::vector<ModelRequest> m_waiting_models;
+
+	// Models whose buffers are being built on the job system, added to the scene once they are
+	struct ModelBuild {
+		std::unique_ptr<Model> model;
+		ModelHandle handle;
+		JobCounter built;
+	};
+
+	std::vector<std::unique_ptr<ModelBuild>> m_model_builds;
+
+	// Requested buffers being made on the job system, and those that are ready
+	struct BufferBuild {
+		BufferRequest request;
+		Buffer buffer;
+		JobCounter built;
+	};
+
+	std::vector<std::unique_ptr<BufferBuild>> m_buffer_builds;
+	std::vector<Buffer> m_buffers;
+
+	// Requested textures loading on the job system or uploading, like the streamer's transitions.
+	// Upload command buffers come from a pool of their own, which only the drawing thread uses
+	std::vector<std::unique_ptr<TextureBatch>> m_texture_batches;
+	TextureBatch *m_recorded_upload = nullptr;
+	VkCommandPool m_upload_pool;
+
+	// Immediate commands never share a pool with frames, which the drawing thread may be recording
+	VkCommandPool m_immediate_pool;
+	VkCommandBuffer m_immediate_cmd;
+
+	// Requests made and not yet ready, which keep frames coming until they are
+	std::atomic<u32> m_pending_requests = 0;
+
+	RendererSettings m_settings;
 
 	VkInstance m_instance;
 	VkSurfaceKHR m_surface;
 
+	// Highest Vulkan version supported by both the instance and the selected device
+	u32 m_api_version;
+
 	struct gpu_info {
 		VkPhysicalDevice device;
 
 		VkPhysicalDeviceProperties props;
+		VkPhysicalDeviceFeatures features;
 		VkPhysicalDeviceMemoryProperties memory_props;
 
+		// Only queried for Vulkan 1.2 devices, zeroed otherwise
+		VkPhysicalDeviceVulkan12Features features12;
+		VkPhysicalDeviceVulkan12Properties props12;
+
+		// Only queried for Vulkan 1.3 devices, zeroed otherwise
+		VkPhysicalDeviceVulkan13Features features13;
+
 		std::vector<VkExtensionProperties> extension_props;
 		std::vector<VkQueueFamilyProperties> queue_family_props;
 
@@ -105,21 +343,41 @@ private:
 
 	VmaAllocator m_allocator;
 
+	// The first depth format the device can render to, with or without stencil
+	VkFormat m_depth_format;
+
 	struct Swapchain {
 		VkSwapchainKHR swapchain;
 
 		std::vector<VkImage> images;
 		std::vector<VkImageView> image_views;
+
+		// One for each image and frame in flight, since every frame has its own depth buffer
 		std::vector<VkFramebuffer> framebuffers;
 
+		// Signalled by the frame rendering to each image, and waited on by its present
+		std::vector<VkSemaphore> render_finished_semaphores;
+
+		// Frame in flight that last rendered to each image, if any
+		std::vector<u32> image_frames;
+
 		VkExtent2D extent;
 		VkSurfaceFormatKHR format;
+		VkPresentModeKHR present_mode;
 		u32 image_count;
 
+		// Set when the images cover every frame that can be waiting to present, so acquire never waits on one
+		bool blocking_acquire;
+
 		bool valid;
 	};
 
-	u32 m_frame_index;
+	// Frames the CPU may record ahead of the GPU, independent of the swapchain
+	u32 m_frames_in_flight;
+	u32 m_frame_index = 0;
+
+	// Swapchain image acquired by the current frame
+	u32 m_image_index;
 
 	Swapchain m_swapchain;
 	
@@ -127,18 +385,135 @@ private:
 
 	VkPipelineLayout m_pipeline_layout;
 	VkPipeline m_pipeline;
+	VkPipeline m_virtual_pipeline;
 	VkDescriptorSetLayout m_descriptor_set_layout;
 
 	VkDescriptorPool m_descriptor_pool;
 	VkDescriptorSet m_uniform_descriptor_set;
 
-	VkCommandPool m_command_pool;
+	bool m_bindless;
+	TextureTable m_texture_table;
+
+	bool m_streaming = false;
+	TextureStreamer m_streamer;
+
+	bool m_virtual_textures;
+	VirtualTextureCache m_virtual_cache;
+
+	// Per frame in flight, each pool is reset once its frame's fence has signalled
+	std::vector<VkCommandPool> m_command_pools;
 	std::vector<VkCommandBuffer> m_command_buffers;
 
-	u32 m_semaphores_index = 0;
 	std::vector<VkSemaphore> m_image_available_semaphores;
-	std::vector<VkSemaphore> m_render_finished_semaphores;
+
+	// Frame completion is tracked with one timeline semaphore for the queue, which every
+	// submission advances, when the device supports it, and with a fence per frame otherwise
+	bool m_timeline;
+	VkSemaphore m_queue_timeline;
+	u64 m_queue_timeline_value = 0;
+	std::vector<u64> m_frame_timeline_values;
 	std::vector<VkFence> m_fences;
+
+	// Submissions and barriers go through vkQueueSubmit2 and vkCmdPipelineBarrier2
+	bool m_synchronization2;
+
+	// Frames render with vkCmdBeginRendering, and the render pass and framebuffers are never created
+	bool m_dynamic_rendering;
+
+	// The swapchain image is imported into the graph each frame, and the depth buffer is one of its
+	// transients, with an instance for each frame in flight
+	RenderGraph m_render_graph;
+	u32 m_backbuffer;
+	u32 m_depth_buffer;
+
+	// Models the forward pass draws this frame, sorted by texture
+	std::span<const Model *const> m_draw_list;
+
+	// Draws go into secondary command buffers when they are kept until the scene changes, or are
+	// recorded on several threads. Otherwise they are recorded straight into the primary
+	bool m_static_commands;
+	bool m_parallel_recording;
+	bool m_secondary_draws;
+
+	// Pools for each thread that records, per frame in flight, reset wholesale before the frame
+	// records again. Their buffers stay allocated for later frames to reuse
+	struct RecordingPool {
+		VkCommandPool pool;
+		std::vector<VkCommandBuffer> buffers;
+		u32 used;
+	};
+
+	std::vector<std::vector<RecordingPool>> m_recording_pools;
+
+	// Secondaries each frame executes, in draw list order, and the scene version they were recorded at
+	std::vector<std::vector<VkCommandBuffer>> m_frame_secondaries;
+	std::vector<u64> m_secondary_versions;
+	u64 m_scene_version = 1;
+	u64 m_streamer_slot_version = 0;
+
+	// Begins rendering to the acquired image and its depth buffer, cleared, on either path.
+	// The render graph has already moved them into their attachment layouts
+	void BeginRendering(VkCommandBuffer cmd, bool secondary);
+	void EndRendering(VkCommandBuffer cmd);
+
+	// Zero without timeline semaphores. Values must be submitted in the order they were taken
+	inline u64 NextTimelineValue() { return m_timeline ? ++m_queue_timeline_value : 0; }
+
+	// Called with the queue mutex held
+	void Submit(VkCommandBuffer cmd, VkSemaphore wait, VkPipelineStageFlags2 wait_stage, VkSemaphore signal, VkFence fence, u64 timeline_value);
+	void WaitForFrame(u32 frame);
+
+	// Everything Present hands over to the submission thread for one frame
+	struct FramePacket {
+		VkCommandBuffer cmd;
+		VkSemaphore image_available;
+		VkSemaphore render_finished;
+		VkFence fence;
+		u64 timeline_value;
+
+		// A recorded texture upload, submitted just before the frame
+		VkCommandBuffer upload_cmd;
+		VkFence upload_fence;
+		u64 upload_timeline_value;
+
+		VkSwapchainKHR swapchain;
+		u32 image_index;
+
+		// Stops the submission thread
+		bool quit;
+	};
+
+	// The queue and swapchain are used by both threads, each only under its own mutex, so an acquire
+	// never holds up a submit. Packets are submitted in order, and timeline values are taken when they are built
+	bool m_threaded_submission = false;
+	std::thread m_submission_thread;
+	SpscQueue<FramePacket, 4> m_frame_packets;
+	FramePacket m_frame_packet;
+	std::mutex m_queue_mutex;
+	std::mutex m_swapchain_mutex;
+
+	std::atomic<bool> m_present_out_of_date = false;
+	std::atomic<float> m_present_time = 0.0f;
+
+	void SubmissionLoop();
+	void SubmitFrame(const FramePacket& packet);
+
+	// Blocks until every frame handed over so far has been submitted and presented
+	void WaitForSubmissions();
+
+	// Timings are read back from whichever thread samples input
+	FrameLimiter m_frame_limiter;
+	std::atomic<float> m_input_to_submit = 0.0f;
+	std::atomic<float> m_input_to_submit_average = 0.0f;
+
+	DeletionQueue m_deletion_queue;
+
+	// Frames still to draw since the last redraw was requested
+	u32 m_redraw_frames = UINT32_MAX;
+	bool TexturesLoading() const;
+
+	// Transient CPU data for each frame in flight, reset once its fence has signalled
+	std::vector<LinearArena> m_frame_arenas;
 };
 
 } // namespace vker
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+
+#include "types.h"
+
+namespace vker {
+
+// Returned straight away by the renderer's requests, from any thread, and filled in once the
+// renderer has created the resource. Copies share the same state. The id is written before
+// the ready flag is released, so it can be read from any thread that has seen Ready()
+template <typename Tag>
+class ResourceHandle {
+public:
+	// Told once the resource is ready, on the thread that made it, so should only hand work on
+	struct Waiter {
+		void (*notify)(Waiter *waiter);
+		Waiter *next = nullptr;
+	};
+
+	ResourceHandle() = default;
+
+	inline bool Valid() const { return m_state != nullptr; }
+	inline bool Ready() const { return m_state && m_state->waiters.load(std::memory_order_acquire) == &s_ready; }
+
+	inline u32 Id() const
+	{
+		assert(Ready());
+		return m_state->id;
+	}
+
+	// Fails without adding the waiter if the resource is ready already
+	bool AddWaiter(Waiter *waiter) const
+	{
+		Waiter *head = m_state->waiters.load(std::memory_order_acquire);
+
+		do {
+			if (head == &s_ready) return false;
+			waiter->next = head;
+		} while (!m_state->waiters.compare_exchange_weak(head, waiter, std::memory_order_release, std::memory_order_acquire));
+
+		return true;
+	}
+
+private:
+	friend class Renderer;
+
+	// Waiters are pushed onto a list until the resource is ready, which swaps the list for s_ready
+	struct State {
+		std::atomic<Waiter *> waiters = nullptr;
+		u32 id = UINT32_MAX;
+	};
+
+	static ResourceHandle Create()
+	{
+		ResourceHandle handle;
+		handle.m_state = std::make_shared<State>();
+		return handle;
+	}
+
+	void Fulfil(u32 id) const
+	{
+		m_state->id = id;
+
+		Waiter *waiter = m_state->waiters.exchange(&s_ready, std::memory_order_acq_rel);
+
+		while (waiter) {
+			// Notifying may free the waiter
+			Waiter *next = waiter->next;
+			waiter->notify(waiter);
+			waiter = next;
+		}
+	}
+
+	inline static Waiter s_ready{};
+
+	std::shared_ptr<State> m_state;
+};
+
+struct BufferResource;
+struct ModelResource;
+struct TextureResource;
+
+// Model ids count models in the order the renderer made them, and texture ids are the same as
+// those returned by Renderer::CreateTexture. Buffer ids are only for Renderer::GetBuffer
+using BufferHandle = ResourceHandle<BufferResource>;
+using ModelHandle = ResourceHandle<ModelResource>;
+using TextureHandle = ResourceHandle<TextureResource>;
+
+} // namespace vker
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "types.h"
+
+namespace vker {
+
+enum class LatencyMode {
+	// FIFO presentation, never tears
+	VSync,
+	// Replaces the queued image with each new one, lower latency without tearing
+	Mailbox,
+	// Presents straight away, lowest latency but may tear
+	Immediate,
+	// FIFO presentation with frames paced to the frame rate cap, to save power
+	Capped,
+};
+
+struct RendererSettings {
+	// Sample every texture through one descriptor indexing table and
+	// select it with a push constant, when the device supports it
+	bool bindless = true;
+
+	// Frames the CPU may record ahead of the GPU. More keeps the GPU busier
+	// when frame times vary, fewer shortens the latency from input to display
+	u32 frames_in_flight = 2;
+
+	// Falls back to the closest mode the surface supports, VSync is always available
+	LatencyMode latency_mode = LatencyMode::VSync;
+	u32 frame_rate_cap = 30;
+
+	// Track frame completion with a timeline semaphore instead of fences (Vulkan 1.2),
+	// and submit and record barriers with synchronization2 (Vulkan 1.3), when supported
+	bool timeline_semaphores = true;
+	bool synchronization2 = true;
+
+	// Render straight to the swapchain images with vkCmdBeginRendering, without render pass
+	// or framebuffer objects, when the device supports it (Vulkan 1.3)
+	bool dynamic_rendering = true;
+
+	// Submit and present finished frames on a thread of their own, so that a present
+	// which blocks in the driver does not hold up recording the next frame
+	bool submission_thread = true;
+
+	// Record the scene's draws once into secondary command buffers and replay them every
+	// frame, until models are added, the swapchain is recreated or a texture changes slot
+	bool static_command_buffers = true;
+
+	// Split draw recording across the job system's threads, into secondary command buffers
+	// that are executed in draw order, once the scene has enough models to be worth it
+	bool parallel_recording = true;
+
+	// Keep only the mip levels of KTX2 textures that are needed on screen
+	// resident, within the budget. Requires bindless textures
+	bool texture_streaming = true;
+	u64 texture_streaming_budget = 256 * 1024 * 1024;
+
+	// Sample .vtex textures page by page from a cache of resident pages. Requires
+	// bindless textures and fragment shader stores, which feed back the pages wanted
+	bool virtual_textures = true;
+
+	// Pack small images loaded together by CreateTextures into shared atlases,
+	// with gutters for their mip levels. Requires bindless textures
+	bool texture_atlas = true;
+};
+
+struct EngineSettings {
+	RendererSettings renderer;
+
+	// Job system workers, zero for one per core besides the main thread's. Fewer leave
+	// cores free for other threads, such as those of a software rasterizer like lavapipe
+	u32 job_workers = 0;
+	bool pin_job_workers = false;
+
+	// The main thread runs jobs while it waits on them, instead of only blocking
+	bool main_thread_jobs = true;
+
+	// Draw on a thread of its own, which takes a packet from the main thread each frame
+	// while the main thread polls input and updates the camera for the next
+	bool render_thread = true;
+
+	// Only draw when the camera, scene or window changed or textures are still loading
+	// in, and otherwise sleep until the window receives an event
+	bool render_on_demand = true;
+
+	// Frames per second while the window is unfocused, zero for no limit
+	u32 background_frame_rate = 10;
+
+	// Fail when a frame makes any global heap allocation once it has warmed up
+#ifndef NDEBUG
+	bool check_frame_allocations = true;
+#else
+	bool check_frame_allocations = false;
+#endif // NDEBUG
+};
+
+} // namespace vker
\ No newline at end of file
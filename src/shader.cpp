@@ -6,6 +6,7 @@
 
 #include <vulkan/vulkan.h>
 
+#include "memory.h"
 #include "shader.h"
 #include "types.h"
 #include "utils.h"
@@ -26,12 +27,12 @@ void Create(VkDevice device, VkShaderModule *shader, const std::filesystem::path
     create_info.codeSize = static_cast<u32>(data.size());
     create_info.pCode = reinterpret_cast<u32 *>(data.data());
 
-	VK_CHECK(vkCreateShaderModule(device, &create_info, nullptr, shader));
+	VK_CHECK(vkCreateShaderModule(device, &create_info, memory::HostCallbacks(memory::Tag::Pipelines), shader));
 }
 
 void Destroy(VkDevice device, VkShaderModule shader)
 {
-	vkDestroyShaderModule(device, shader, nullptr);
+	vkDestroyShaderModule(device, shader, memory::HostCallbacks(memory::Tag::Pipelines));
 }
 
 } // namespace vker
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "types.h"
+
+namespace vker {
+
+// Bounded queue between one producer thread and one consumer thread, without locks.
+// Blocking waits park on the indices themselves. The consumer reads the front item
+// in place and pops it once done, so WaitEmpty also waits for the last item's work
+template <typename T, u32 Capacity>
+class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+	// Producer only, blocks while the queue is full
+	void Push(const T& item)
+	{
+		const u32 write = m_write.load(std::memory_order_relaxed);
+
+		for (u32 read = m_read.load(std::memory_order_acquire); write - read == Capacity; read = m_read.load(std::memory_order_acquire)) {
+			m_read.wait(read, std::memory_order_acquire);
+		}
+
+		m_items[write % Capacity] = item;
+
+		m_write.store(write + 1, std::memory_order_release);
+		m_write.notify_one();
+	}
+
+	// Producer only, blocks until every pushed item has been popped
+	void WaitEmpty()
+	{
+		const u32 write = m_write.load(std::memory_order_relaxed);
+
+		for (u32 read = m_read.load(std::memory_order_acquire); read != write; read = m_read.load(std::memory_order_acquire)) {
+			m_read.wait(read, std::memory_order_acquire);
+		}
+	}
+
+	// Consumer only, blocks while the queue is empty
+	const T& Front()
+	{
+		const u32 read = m_read.load(std::memory_order_relaxed);
+
+		for (u32 write = m_write.load(std::memory_order_acquire); write == read; write = m_write.load(std::memory_order_acquire)) {
+			m_write.wait(write, std::memory_order_acquire);
+		}
+
+		return m_items[read % Capacity];
+	}
+
+	// Consumer only, null while the queue is empty
+	const T *TryFront()
+	{
+		const u32 read = m_read.load(std::memory_order_relaxed);
+		if (m_write.load(std::memory_order_acquire) == read) return nullptr;
+
+		return &m_items[read % Capacity];
+	}
+
+	// Consumer only, after Front or a successful TryFront
+	void Pop()
+	{
+		m_read.store(m_read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		m_read.notify_one();
+	}
+
+private:
+	std::array<T, Capacity> m_items{};
+
+	// Indices only ever increase, and wrap around together
+	alignas(64) std::atomic<u32> m_write = 0;
+	alignas(64) std::atomic<u32> m_read = 0;
+};
+
+} // namespace vker
\ No newline at end of file
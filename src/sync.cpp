@@ -0,0 +1,153 @@
+#include "sync.h"
+
+#include <algorithm>
+
+namespace vker::sync {
+
+static bool s_synchronization2 = false;
+
+// Image barriers recorded by one call
+constexpr size_t MaxBatch = 16;
+
+// The copy and blit stages, and sampled reads, only have coarser equivalents
+static VkPipelineStageFlags LegacyStages(VkPipelineStageFlags2 stages, VkPipelineStageFlags none)
+{
+    if (stages & (VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT)) stages |= VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+
+    const VkPipelineStageFlags legacy = static_cast<VkPipelineStageFlags>(stages);
+    return legacy != 0 ? legacy : none;
+}
+
+static VkAccessFlags LegacyAccess(VkAccessFlags2 access)
+{
+    if (access & VK_ACCESS_2_SHADER_SAMPLED_READ_BIT) access |= VK_ACCESS_2_SHADER_READ_BIT;
+
+    return static_cast<VkAccessFlags>(access);
+}
+
+static VkImageSubresourceRange Range(const ImageBarrier& barrier)
+{
+    VkImageSubresourceRange range{};
+    range.aspectMask = barrier.aspect;
+    range.baseMipLevel = barrier.base_level;
+    range.levelCount = barrier.level_count;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    return range;
+}
+
+void UseSynchronization2(bool enabled)
+{
+    s_synchronization2 = enabled;
+}
+
+bool Synchronization2()
+{
+    return s_synchronization2;
+}
+
+void RecordImageBarrier(VkCommandBuffer cmd, const ImageBarrier& barrier)
+{
+    RecordImageBarriers(cmd, { &barrier, 1 });
+}
+
+void RecordImageBarriers(VkCommandBuffer cmd, std::span<const ImageBarrier> barriers)
+{
+    // Recorded in batches from the stack, so recording never allocates
+    for (size_t first = 0; first < barriers.size(); first += MaxBatch) {
+        const auto batch = barriers.subspan(first, std::min(barriers.size() - first, MaxBatch));
+
+        if (s_synchronization2) {
+            VkImageMemoryBarrier2 image_barriers[MaxBatch];
+
+            for (size_t i = 0; i < batch.size(); ++i) {
+                const ImageBarrier& barrier = batch[i];
+
+                VkImageMemoryBarrier2& image_barrier = image_barriers[i];
+                image_barrier = {};
+                image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+                image_barrier.srcStageMask = barrier.src_stage;
+                image_barrier.srcAccessMask = barrier.src_access;
+                image_barrier.dstStageMask = barrier.dst_stage;
+                image_barrier.dstAccessMask = barrier.dst_access;
+                image_barrier.oldLayout = barrier.old_layout;
+                image_barrier.newLayout = barrier.new_layout;
+                image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_barrier.image = barrier.image;
+                image_barrier.subresourceRange = Range(barrier);
+            }
+
+            VkDependencyInfo dependency{};
+            dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependency.imageMemoryBarrierCount = static_cast<u32>(batch.size());
+            dependency.pImageMemoryBarriers = image_barriers;
+
+            vkCmdPipelineBarrier2(cmd, &dependency);
+            continue;
+        }
+
+        VkImageMemoryBarrier image_barriers[MaxBatch];
+        VkPipelineStageFlags2 src_stages = 0;
+        VkPipelineStageFlags2 dst_stages = 0;
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const ImageBarrier& barrier = batch[i];
+
+            VkImageMemoryBarrier& image_barrier = image_barriers[i];
+            image_barrier = {};
+            image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            image_barrier.srcAccessMask = LegacyAccess(barrier.src_access);
+            image_barrier.dstAccessMask = LegacyAccess(barrier.dst_access);
+            image_barrier.oldLayout = barrier.old_layout;
+            image_barrier.newLayout = barrier.new_layout;
+            image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.image = barrier.image;
+            image_barrier.subresourceRange = Range(barrier);
+
+            src_stages |= barrier.src_stage;
+            dst_stages |= barrier.dst_stage;
+        }
+
+        vkCmdPipelineBarrier(cmd,
+            LegacyStages(src_stages, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+            LegacyStages(dst_stages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+            0, 0, nullptr, 0, nullptr, static_cast<u32>(batch.size()), image_barriers);
+    }
+}
+
+void RecordMemoryBarrier(VkCommandBuffer cmd,
+    VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access,
+    VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access)
+{
+    if (s_synchronization2) {
+        VkMemoryBarrier2 memory_barrier{};
+        memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        memory_barrier.srcStageMask = src_stage;
+        memory_barrier.srcAccessMask = src_access;
+        memory_barrier.dstStageMask = dst_stage;
+        memory_barrier.dstAccessMask = dst_access;
+
+        VkDependencyInfo dependency{};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.memoryBarrierCount = 1;
+        dependency.pMemoryBarriers = &memory_barrier;
+
+        vkCmdPipelineBarrier2(cmd, &dependency);
+        return;
+    }
+
+    VkMemoryBarrier memory_barrier{};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask = LegacyAccess(src_access);
+    memory_barrier.dstAccessMask = LegacyAccess(dst_access);
+
+    vkCmdPipelineBarrier(cmd,
+        LegacyStages(src_stage, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+        LegacyStages(dst_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+        0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+}
+
+} // namespace vker::sync
\ No newline at end of file
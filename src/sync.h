@@ -0,0 +1,42 @@
+#pragma once
+
+#include <span>
+
+#include <vulkan/vulkan.h>
+
+#include "types.h"
+
+namespace vker::sync {
+
+// Barriers are recorded with vkCmdPipelineBarrier2 once the device has
+// enabled synchronization2, and translated to the original call otherwise
+void UseSynchronization2(bool enabled);
+bool Synchronization2();
+
+// Masks use the synchronization2 bits, which are a superset of the
+// original ones, so the same barrier can be recorded either way
+struct ImageBarrier {
+	VkImage image;
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	u32 base_level = 0;
+	u32 level_count = 1;
+
+	VkImageLayout old_layout;
+	VkImageLayout new_layout;
+
+	VkPipelineStageFlags2 src_stage;
+	VkAccessFlags2 src_access;
+	VkPipelineStageFlags2 dst_stage;
+	VkAccessFlags2 dst_access;
+};
+
+void RecordImageBarrier(VkCommandBuffer cmd, const ImageBarrier& barrier);
+
+// Records the barriers together. Without synchronization2 they share the union of their stages
+void RecordImageBarriers(VkCommandBuffer cmd, std::span<const ImageBarrier> barriers);
+
+void RecordMemoryBarrier(VkCommandBuffer cmd,
+	VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access,
+	VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access);
+
+} // namespace vker::sync
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include <fstream>
+
+#include "task.h"
+#include "utils.h"
+
+namespace vker {
+
+namespace detail {
+
+Detached RunSpawned(JobSystem& jobs, Task<> task, JobCounter *counter)
+{
+    co_await ScheduleOn{ jobs };
+    co_await task;
+
+    if (counter) jobs.Release(*counter);
+}
+
+} // namespace detail
+
+Task<std::vector<u8>> ReadFile(JobSystem& jobs, std::filesystem::path path)
+{
+    co_await ScheduleOn{ jobs };
+
+    std::ifstream file{ path, std::ios::binary | std::ios::ate };
+    if (!file) FatalError("failed to open {}", path.string());
+
+    std::vector<u8> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(data.data()), data.size());
+
+    co_return data;
+}
+
+} // namespace vker
\ No newline at end of file
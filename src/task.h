@@ -0,0 +1,248 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "job_system.h"
+#include "resource_handle.h"
+#include "types.h"
+
+namespace vker {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+template <typename T>
+struct TaskPromiseValue {
+	std::optional<T> value;
+
+	void return_value(T result) { value.emplace(std::move(result)); }
+};
+
+template <>
+struct TaskPromiseValue<void> {
+	void return_void() {}
+};
+
+// Coroutines that start straight away and free themselves once they finish, for the roots
+// that tasks are awaited from
+struct Detached {
+	struct promise_type {
+		Detached get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+} // namespace detail
+
+// Suspends until resumed as a job, and carries on from there on one of the job system's threads
+class ScheduleOn {
+public:
+	explicit ScheduleOn(JobSystem& jobs) : m_jobs{ jobs } {}
+
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> handle) { m_jobs.Submit([handle] { handle.resume(); }); }
+	void await_resume() const noexcept {}
+
+private:
+	JobSystem& m_jobs;
+};
+
+// Coroutines that only start once awaited, and resume whoever awaited them when they finish,
+// on whichever thread they finished on
+template <typename T>
+class Task {
+public:
+	struct promise_type : detail::TaskPromiseValue<T> {
+		std::coroutine_handle<> continuation = std::noop_coroutine();
+
+		Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		auto final_suspend() noexcept
+		{
+			struct FinalAwaiter {
+				bool await_ready() const noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept { return handle.promise().continuation; }
+				void await_resume() const noexcept {}
+			};
+
+			return FinalAwaiter{};
+		}
+
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	Task() = default;
+
+	~Task()
+	{
+		if (m_handle) m_handle.destroy();
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	Task(Task&& other) noexcept : m_handle{ std::exchange(other.m_handle, nullptr) } {}
+
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other) {
+			if (m_handle) m_handle.destroy();
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+
+		return *this;
+	}
+
+	// Tasks are awaited once, which runs them up to their first suspension on the awaiting thread
+	bool await_ready() const noexcept { return false; }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+	{
+		m_handle.promise().continuation = continuation;
+		return m_handle;
+	}
+
+	T await_resume()
+	{
+		if constexpr (!std::is_void_v<T>) return std::move(*m_handle.promise().value);
+	}
+
+private:
+	explicit Task(std::coroutine_handle<promise_type> handle) : m_handle{ handle } {}
+
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+// Suspends until the renderer has made the resource, once its upload has finished, then
+// carries on as a job. Ready resources carry on without suspending
+template <typename Tag>
+class WhenReady : private ResourceHandle<Tag>::Waiter {
+public:
+	WhenReady(JobSystem& jobs, ResourceHandle<Tag> handle) : m_jobs{ jobs }, m_handle{ std::move(handle) }
+	{
+		this->notify = [](typename ResourceHandle<Tag>::Waiter *waiter) {
+			auto *self = static_cast<WhenReady *>(waiter);
+			const std::coroutine_handle<> continuation = self->m_continuation;
+
+			self->m_jobs.Submit([continuation] { continuation.resume(); });
+		};
+	}
+
+	bool await_ready() const { return m_handle.Ready(); }
+
+	bool await_suspend(std::coroutine_handle<> continuation)
+	{
+		m_continuation = continuation;
+		return m_handle.AddWaiter(this);
+	}
+
+	u32 await_resume() const { return m_handle.Id(); }
+
+private:
+	JobSystem& m_jobs;
+	ResourceHandle<Tag> m_handle;
+	std::coroutine_handle<> m_continuation;
+};
+
+template <typename Tag>
+WhenReady(JobSystem&, ResourceHandle<Tag>) -> WhenReady<Tag>;
+
+namespace detail {
+
+// Resumes the awaiting coroutine once every task has arrived, or carries straight on if they
+// all did before it was awaited. The awaiter holds one count of its own, so whoever takes the
+// count to zero is the only one to resume it
+class WhenAllLatch {
+public:
+	explicit WhenAllLatch(size_t count) : m_remaining{ static_cast<u32>(count) + 1 } {}
+
+	void Arrive()
+	{
+		if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) m_continuation.resume();
+	}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> continuation) noexcept
+	{
+		m_continuation = continuation;
+		return m_remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+	void await_resume() const noexcept {}
+
+private:
+	std::atomic<u32> m_remaining;
+	std::coroutine_handle<> m_continuation;
+};
+
+template <typename T>
+Detached RunWhenAllTask(JobSystem& jobs, Task<T>& task, std::optional<T>& result, WhenAllLatch& latch)
+{
+	co_await ScheduleOn{ jobs };
+	result.emplace(co_await task);
+	latch.Arrive();
+}
+
+inline Detached RunWhenAllTask(JobSystem& jobs, Task<>& task, WhenAllLatch& latch)
+{
+	co_await ScheduleOn{ jobs };
+	co_await task;
+	latch.Arrive();
+}
+
+Detached RunSpawned(JobSystem& jobs, Task<> task, JobCounter *counter);
+
+} // namespace detail
+
+// Starts every task as its own job, so they run alongside each other, and finishes once they
+// all have, with their results in the same order
+template <typename T>
+Task<std::vector<T>> WhenAll(JobSystem& jobs, std::vector<Task<T>> tasks)
+{
+	std::vector<std::optional<T>> results(tasks.size());
+	detail::WhenAllLatch latch{ tasks.size() };
+
+	for (size_t i = 0; i < tasks.size(); ++i) detail::RunWhenAllTask(jobs, tasks[i], results[i], latch);
+	co_await latch;
+
+	std::vector<T> values;
+	values.reserve(results.size());
+
+	for (auto& result : results) values.push_back(std::move(*result));
+	co_return values;
+}
+
+inline Task<> WhenAll(JobSystem& jobs, std::vector<Task<>> tasks)
+{
+	detail::WhenAllLatch latch{ tasks.size() };
+
+	for (auto& task : tasks) detail::RunWhenAllTask(jobs, task, latch);
+	co_await latch;
+}
+
+// Runs the task as a job, without anything awaiting it. The counter stays above zero until
+// the task has finished, for JobSystem::Wait
+inline void Spawn(JobSystem& jobs, Task<> task, JobCounter *counter = nullptr)
+{
+	if (counter) jobs.Retain(*counter);
+	detail::RunSpawned(jobs, std::move(task), counter);
+}
+
+// Reads the whole file as a job, leaving the awaiting coroutine on the job system's thread
+Task<std::vector<u8>> ReadFile(JobSystem& jobs, std::filesystem::path path);
+
+} // namespace vker
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "types.h"
+
+namespace vker {
+
+// A texture and its mip chain in host memory, either RGBA8 or block compressed
+struct TextureData {
+	struct Level {
+		size_t offset;
+		size_t size;
+	};
+
+	VkFormat format;
+	VkExtent2D size;
+
+	// Level zero is the full size image
+	std::vector<Level> levels;
+	std::vector<u8> data;
+
+	inline u32 MipLevels() const { return static_cast<u32>(levels.size()); }
+	inline const u8 *LevelData(u32 level) const { return data.data() + levels[level].offset; }
+};
+
+} // namespace vker
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+
+#include "ktx2.h"
+#include "memory.h"
+#include "mipmap.h"
+#include "utils.h"
+
+namespace vker {
+
+// Level offsets in staging suit every texel block size
+constexpr VkDeviceSize StagingAlignment = 16;
+
+void TextureStreamer::Setup(VkDevice device, VmaAllocator allocator, VkQueue queue, std::mutex& queue_mutex, u32 queue_family,
+    TextureTable& table, JobSystem& jobs, VkDeviceSize budget, u32 frames_in_flight)
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_queue = queue;
+    m_queue_mutex = &queue_mutex;
+    m_table = &table;
+    m_jobs = &jobs;
+    m_budget = budget;
+    m_frames_in_flight = frames_in_flight;
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+
+    VK_CHECK(vkCreateCommandPool(device, &pool_info, memory::HostCallbacks(memory::Tag::Textures), &m_command_pool));
+
+    for (auto& transition : m_transitions) {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = m_command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(device, &alloc_info, &transition.cmd));
+
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VK_CHECK(vkCreateFence(device, &fence_info, memory::HostCallbacks(memory::Tag::Textures), &transition.fence));
+    }
+
+    m_init = true;
+}
+
+void TextureStreamer::Destroy()
+{
+    assert(m_init);
+
+    // Level reads may still be writing into staging buffers
+    m_jobs->Wait(m_reads);
+
+    for (auto& transition : m_transitions) {
+        if (transition.active) {
+            if (transition.submitted) {
+                VK_CHECK(vkWaitForFences(m_device, 1, &transition.fence, VK_TRUE, UINT64_MAX));
+            } else {
+                transition.staging.Unmap();
+            }
+
+            transition.staging.Destroy();
+            transition.image.Destroy();
+            transition.active = false;
+        }
+
+        vkDestroyFence(m_device, transition.fence, memory::HostCallbacks(memory::Tag::Textures));
+    }
+
+    vkDestroyCommandPool(m_device, m_command_pool, memory::HostCallbacks(memory::Tag::Textures));
+
+    for (auto& retired : m_retired) retired.image.Destroy();
+    for (auto& texture : m_textures) texture.image.Destroy();
+
+    m_retired.clear();
+    m_textures.clear();
+    m_wanted_levels.clear();
+
+    m_init = false;
+}
+
+u32 TextureStreamer::Register(const std::filesystem::path& path, const TextureData& info, Image& image, u32 first_level, u32 slot)
+{
+    assert(m_init);
+    assert(info.data.empty());
+
+    Texture& texture = m_textures.emplace_back();
+    texture.path = path;
+    texture.info = info;
+    texture.image = image;
+    texture.slot = slot;
+    texture.tail_level = TailLevel(info.size, info.MipLevels());
+    texture.resident_level = first_level;
+    texture.requested_level = texture.tail_level;
+    texture.frames_over = 0;
+    texture.busy = false;
+
+    m_resident_size += ResidentSize(texture, first_level);
+    m_wanted_levels.push_back(first_level);
+
+    return static_cast<u32>(m_textures.size() - 1);
+}
+
+void TextureStreamer::Request(u32 id, u32 level)
+{
+    Texture& texture = m_textures[id];
+    texture.requested_level = std::min(texture.requested_level, level);
+}
+
+void TextureStreamer::Update()
+{
+    assert(m_init);
+
+    ++m_frame;
+
+    // One extra frame of margin, since frames are not always acquired in order
+    for (size_t i = 0; i < m_retired.size();) {
+        if (m_retired[i].frame + m_frames_in_flight < m_frame) {
+            memory::FrameAllocationPause pause;
+
+            m_table->Free(m_retired[i].slot);
+            m_retired[i].image.Destroy();
+
+            m_retired[i] = m_retired.back();
+            m_retired.pop_back();
+        } else {
+            ++i;
+        }
+    }
+
+    for (auto& transition : m_transitions) {
+        if (!transition.active) continue;
+
+        if (!transition.submitted) {
+            if (transition.pending_reads.load(std::memory_order_acquire) == 0) Submit(transition);
+        } else if (vkGetFenceStatus(m_device, transition.fence) == VK_SUCCESS) {
+            Finish(transition);
+        }
+    }
+
+    VkDeviceSize wanted_size = 0;
+
+    for (size_t i = 0; i < m_textures.size(); ++i) {
+        Texture& texture = m_textures[i];
+        u32 wanted = texture.requested_level;
+
+        // Shrinking waits until the texture has gone without its resident levels for a while
+        if (wanted > texture.resident_level) {
+            if (++texture.frames_over < ShrinkDelay) wanted = texture.resident_level;
+        } else {
+            texture.frames_over = 0;
+        }
+
+        m_wanted_levels[i] = wanted;
+        wanted_size += ResidentSize(texture, wanted);
+
+        texture.requested_level = texture.tail_level;
+    }
+
+    // Over budget, drop the top level that frees the most memory until everything fits
+    while (wanted_size > m_budget) {
+        size_t coarsest = SIZE_MAX;
+        VkDeviceSize saving = 0;
+
+        for (size_t i = 0; i < m_textures.size(); ++i) {
+            const Texture& texture = m_textures[i];
+            if (m_wanted_levels[i] >= texture.tail_level) continue;
+
+            const VkDeviceSize level_size = texture.info.levels[m_wanted_levels[i]].size;
+
+            if (level_size > saving) {
+                coarsest = i;
+                saving = level_size;
+            }
+        }
+
+        if (coarsest == SIZE_MAX) break;
+
+        ++m_wanted_levels[coarsest];
+        wanted_size -= saving;
+    }
+
+    // Growing textures are served before shrinking ones
+    for (const bool grow : { true, false }) {
+        for (u32 i = 0; i < m_textures.size(); ++i) {
+            const Texture& texture = m_textures[i];
+            if (texture.busy || m_wanted_levels[i] == texture.resident_level) continue;
+            if ((m_wanted_levels[i] < texture.resident_level) != grow) continue;
+
+            auto transition = std::find_if(m_transitions.begin(), m_transitions.end(), [](const Transition& t) { return !t.active; });
+            if (transition == m_transitions.end()) return;
+
+            Begin(*transition, i, m_wanted_levels[i]);
+        }
+    }
+}
+
+bool TextureStreamer::Busy() const
+{
+    assert(m_init);
+    return std::any_of(m_transitions.begin(), m_transitions.end(), [](const Transition& t) { return t.active; });
+}
+
+u32 TextureStreamer::TailLevel(VkExtent2D size, u32 mip_levels)
+{
+    u32 level = 0;
+
+    while (level + 1 < mip_levels) {
+        const VkExtent2D extent = mipmap::LevelExtent(size, level);
+        if (std::max(extent.width, extent.height) <= TailSize) break;
+
+        ++level;
+    }
+
+    return level;
+}
+
+VkDeviceSize TextureStreamer::ResidentSize(const Texture& texture, u32 level) const
+{
+    VkDeviceSize size = 0;
+    for (u32 i = level; i < texture.info.MipLevels(); ++i) size += texture.info.levels[i].size;
+
+    return size;
+}
+
+// Creates the replacement image and reads its levels from the file on the loader threads
+void TextureStreamer::Begin(Transition& transition, u32 id, u32 level)
+{
+    memory::FrameAllocationPause pause;
+
+    Texture& texture = m_textures[id];
+    texture.busy = true;
+
+    transition.active = true;
+    transition.submitted = false;
+    transition.texture = id;
+    transition.level = level;
+
+    const u32 mip_levels = texture.info.MipLevels() - level;
+    transition.image.Setup(m_device, m_allocator, mipmap::LevelExtent(texture.info.size, level), texture.info.format, mip_levels, false);
+
+    transition.levels.clear();
+    VkDeviceSize staging_size = 0;
+
+    for (u32 i = level; i < texture.info.MipLevels(); ++i) {
+        staging_size = (staging_size + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+        transition.levels.push_back({ static_cast<size_t>(staging_size), texture.info.levels[i].size });
+        staging_size += texture.info.levels[i].size;
+    }
+
+    transition.staging.Setup(m_allocator, staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+    transition.staging_address = static_cast<u8 *>(transition.staging.Map());
+    transition.pending_reads.store(mip_levels, std::memory_order_relaxed);
+
+    for (u32 i = 0; i < mip_levels; ++i) {
+        const TextureData::Level src = texture.info.levels[level + i];
+        const TextureData::Level dst = transition.levels[i];
+
+        // The path is copied, as registering more textures may move the texture list
+        m_jobs->Submit([&transition, path = texture.path, src, dst] {
+            memory::FrameAllocationPause pause;
+
+            ktx2::ReadRange(path, src.offset, src.size, transition.staging_address + dst.offset);
+            transition.pending_reads.fetch_sub(1, std::memory_order_release);
+        }, &m_reads);
+    }
+}
+
+void TextureStreamer::Submit(Transition& transition)
+{
+    memory::FrameAllocationPause pause;
+
+    transition.staging.Unmap();
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(transition.cmd, &begin_info));
+    transition.image.RecordUpload(transition.cmd, transition.staging.Handle(), transition.levels);
+    VK_CHECK(vkEndCommandBuffer(transition.cmd));
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &transition.cmd;
+
+    {
+        std::lock_guard lock{*m_queue_mutex};
+        VK_CHECK(vkQueueSubmit(m_queue, 1, &submit_info, transition.fence));
+    }
+
+    transition.submitted = true;
+}
+
+// Swaps the finished image in. Frames in flight may still sample the old slot, which
+// cannot be rewritten while they are pending, so the image moves to a fresh slot and
+// the old one is freed along with the old image once those frames have finished
+void TextureStreamer::Finish(Transition& transition)
+{
+    memory::FrameAllocationPause pause;
+
+    VK_CHECK(vkResetFences(m_device, 1, &transition.fence));
+    transition.staging.Destroy();
+
+    Texture& texture = m_textures[transition.texture];
+
+    m_resident_size -= ResidentSize(texture, texture.resident_level);
+    m_resident_size += ResidentSize(texture, transition.level);
+
+    m_retired.push_back({ texture.image, texture.slot, m_frame });
+
+    texture.image = transition.image;
+    texture.slot = m_table->Allocate(texture.image);
+    texture.resident_level = transition.level;
+    ++m_slot_version;
+    texture.busy = false;
+
+    transition.active = false;
+}
+
+} // namespace vker
\ No newline at end of file
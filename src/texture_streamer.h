@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "contrib/vk_mem_alloc.h"
+
+#include "buffer.h"
+#include "image.h"
+#include "job_system.h"
+#include "texture_data.h"
+#include "texture_table.h"
+#include "types.h"
+
+namespace vker {
+
+// Keeps only the mip levels that are on screen resident for textures loaded from
+// KTX2 files. A texture changes resolution by building a replacement image from
+// the file in the background and publishing it in a new bindless slot once uploaded
+class TextureStreamer {
+public:
+	TextureStreamer() = default;
+
+	// The queue is shared with the renderer's submission thread, and only used under the mutex
+	void Setup(VkDevice device, VmaAllocator allocator, VkQueue queue, std::mutex& queue_mutex, u32 queue_family,
+		TextureTable& table, JobSystem& jobs, VkDeviceSize budget, u32 frames_in_flight);
+	void Destroy();
+
+	// Takes ownership of an image holding levels [first_level, info.MipLevels()) of the
+	// file, which is already bound to the slot. Level offsets in info point into the file
+	u32 Register(const std::filesystem::path& path, const TextureData& info, Image& image, u32 first_level, u32 slot);
+
+	// Asks for the given level to be resident, the finest level requested in a frame wins
+	void Request(u32 id, u32 level);
+
+	// Publishes finished uploads and starts new ones. Called once per frame, after the
+	// frame's fence has been waited on and before any texture requests are made
+	void Update();
+
+	// The first level kept resident for every texture, no larger than TailSize texels
+	static u32 TailLevel(VkExtent2D size, u32 mip_levels);
+
+	// Bindless slot of the texture's current image, which changes as it streams
+	inline u32 Slot(u32 id) const { return m_textures[id].slot; }
+
+	// Changes whenever any texture moves to a new slot
+	inline u64 SlotVersion() const { return m_slot_version; }
+
+	inline u32 LevelCount(u32 id) const { return m_textures[id].info.MipLevels(); }
+	inline VkExtent2D Extent(u32 id) const { return m_textures[id].info.size; }
+
+	inline VkDeviceSize ResidentSize() const { return m_resident_size; }
+
+	// Whether any texture is changing resolution, which shows once it is published
+	bool Busy() const;
+
+private:
+	static constexpr u32 TailSize = 128;
+
+	// Replacement images being built at once
+	static constexpr u32 MaxTransitions = 4;
+
+	// Frames a texture must go unrequested at a level before it is shrunk, avoiding churn
+	static constexpr u32 ShrinkDelay = 120;
+
+	struct Texture {
+		std::filesystem::path path;
+		TextureData info;
+
+		Image image;
+		u32 slot;
+
+		u32 tail_level;
+		u32 resident_level;
+		u32 requested_level;
+		u32 frames_over;
+
+		bool busy;
+	};
+
+	struct Transition {
+		bool active = false;
+		bool submitted;
+
+		u32 texture;
+		u32 level;
+
+		Image image;
+		Buffer staging;
+		u8 *staging_address;
+		std::vector<TextureData::Level> levels;
+
+		// Level reads still running on the loader threads
+		std::atomic<u32> pending_reads;
+
+		VkCommandBuffer cmd;
+		VkFence fence;
+	};
+
+	struct Retired {
+		Image image;
+		u32 slot;
+		u64 frame;
+	};
+
+	// Bytes needed for levels [level, MipLevels()) of a texture
+	VkDeviceSize ResidentSize(const Texture& texture, u32 level) const;
+
+	void Begin(Transition& transition, u32 id, u32 level);
+	void Submit(Transition& transition);
+	void Finish(Transition& transition);
+
+	bool m_init = false;
+
+	VkDevice m_device;
+	VmaAllocator m_allocator;
+	VkQueue m_queue;
+	std::mutex *m_queue_mutex;
+
+	TextureTable *m_table;
+	JobSystem *m_jobs;
+
+	// Level reads still running for any transition
+	JobCounter m_reads;
+
+	VkDeviceSize m_budget;
+	VkDeviceSize m_resident_size = 0;
+
+	u32 m_frames_in_flight;
+	u64 m_frame = 0;
+	u64 m_slot_version = 0;
+
+	std::vector<Texture> m_textures;
+	std::vector<u32> m_wanted_levels;
+	std::vector<Retired> m_retired;
+
+	VkCommandPool m_command_pool;
+	std::array<Transition, MaxTransitions> m_transitions;
+};
+
+} // namespace vker
\ No newline at end of file
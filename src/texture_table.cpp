@@ -0,0 +1,131 @@
+#include <cassert>
+
+#include <vulkan/vulkan.h>
+
+#include "image.h"
+#include "memory.h"
+#include "texture_table.h"
+#include "types.h"
+#include "utils.h"
+
+namespace vker {
+
+void TextureTable::Setup(VkDevice device, u32 capacity)
+{
+    m_device = device;
+    m_capacity = capacity;
+    m_next_slot = 0;
+    m_free_slots.clear();
+
+    {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.descriptorCount = capacity;
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        // Slots may be empty, and may be written while the set is bound
+        // or while other slots are in use by the GPU
+        const VkDescriptorBindingFlags binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo flags_ci{};
+        flags_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        flags_ci.bindingCount = 1;
+        flags_ci.pBindingFlags = &binding_flags;
+
+        VkDescriptorSetLayoutCreateInfo ci{};
+        ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        ci.pNext = &flags_ci;
+        ci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        ci.bindingCount = 1;
+        ci.pBindings = &binding;
+
+        VK_CHECK(vkCreateDescriptorSetLayout(device, &ci, memory::HostCallbacks(memory::Tag::Textures), &m_layout));
+    }
+
+    {
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_size.descriptorCount = capacity;
+
+        VkDescriptorPoolCreateInfo ci{};
+        ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        ci.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        ci.maxSets = 1;
+        ci.poolSizeCount = 1;
+        ci.pPoolSizes = &pool_size;
+
+        VK_CHECK(vkCreateDescriptorPool(device, &ci, memory::HostCallbacks(memory::Tag::Textures), &m_pool));
+    }
+
+    {
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = m_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &m_layout;
+
+        VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &m_set));
+    }
+
+    m_init = true;
+}
+
+void TextureTable::Destroy()
+{
+    assert(m_init);
+    vkDestroyDescriptorPool(m_device, m_pool, memory::HostCallbacks(memory::Tag::Textures));
+    vkDestroyDescriptorSetLayout(m_device, m_layout, memory::HostCallbacks(memory::Tag::Textures));
+    m_init = false;
+}
+
+u32 TextureTable::Allocate(Image& image)
+{
+    assert(m_init);
+
+    u32 slot;
+
+    // Reuse freed slots first so that the live range stays compact
+    if (!m_free_slots.empty()) {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    } else {
+        if (m_next_slot == m_capacity) FatalError("texture table is full ({} slots)", m_capacity);
+        slot = m_next_slot++;
+    }
+
+    Update(slot, image);
+    return slot;
+}
+
+void TextureTable::Update(u32 slot, Image& image)
+{
+    assert(m_init);
+    assert(slot < m_next_slot);
+
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = image.Sampler();
+    image_info.imageView = image.View();
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = m_set;
+    write.dstBinding = 0;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
+
+void TextureTable::Free(u32 slot)
+{
+    assert(m_init);
+    assert(slot < m_next_slot);
+    m_free_slots.push_back(slot);
+}
+
+} // namespace vker
\ No newline at end of file
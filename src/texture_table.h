@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "image.h"
+#include "types.h"
+
+namespace vker {
+
+// A single, partially bound array of combined image samplers which every
+// draw indexes into, rather than binding a descriptor set per texture
+class TextureTable {
+public:
+	TextureTable() = default;
+
+	void Setup(VkDevice device, u32 capacity);
+	void Destroy();
+
+	u32 Allocate(Image& image);
+	void Update(u32 slot, Image& image);
+
+	// The caller must ensure that no in-flight frame still samples the slot
+	void Free(u32 slot);
+
+	inline VkDescriptorSetLayout Layout() const
+	{
+		assert(m_init);
+		return m_layout;
+	}
+
+	inline VkDescriptorSet Set() const
+	{
+		assert(m_init);
+		return m_set;
+	}
+
+	inline u32 Capacity() const { return m_capacity; }
+
+private:
+	bool m_init = false;
+
+	VkDevice m_device;
+
+	u32 m_capacity;
+	u32 m_next_slot;
+	std::vector<u32> m_free_slots;
+
+	VkDescriptorSetLayout m_layout;
+	VkDescriptorPool m_pool;
+	VkDescriptorSet m_set;
+};
+
+} // namespace vker
\ No newline at end of file
@@ -0,0 +1,460 @@
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "memory.h"
+#include "sync.h"
+#include "utils.h"
+
+namespace vker {
+
+static void AtlasBarrier(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+    VkAccessFlags2 src_access, VkAccessFlags2 dst_access, VkPipelineStageFlags2 src_stage, VkPipelineStageFlags2 dst_stage)
+{
+    sync::ImageBarrier barrier{};
+    barrier.image = image;
+    barrier.old_layout = old_layout;
+    barrier.new_layout = new_layout;
+    barrier.src_stage = src_stage;
+    barrier.src_access = src_access;
+    barrier.dst_stage = dst_stage;
+    barrier.dst_access = dst_access;
+
+    sync::RecordImageBarrier(cmd, barrier);
+}
+
+void VirtualTextureCache::Setup(VkDevice device, VmaAllocator allocator, JobSystem& jobs, u32 frames_in_flight)
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_jobs = &jobs;
+    m_frames_in_flight = frames_in_flight;
+
+    m_table.reserve(PageTableCapacity);
+    m_mapping.reserve(PageTableCapacity);
+    m_requested_frame.reserve(PageTableCapacity);
+    m_wanted.reserve(FeedbackSize + MaxTextures);
+    m_pages.resize(AtlasPages * AtlasPages);
+
+    const u32 atlas_size = AtlasPages * vtex::StoredPageSize;
+    m_atlas.Setup(device, allocator, { atlas_size, atlas_size }, VK_FORMAT_R8G8B8A8_UNORM, 1, false);
+
+    m_staging.Setup(allocator, MaxLoads * vtex::PageBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+    m_staging_address = static_cast<u8 *>(m_staging.Map());
+
+    m_page_tables.resize(frames_in_flight);
+    m_page_table_addresses.resize(frames_in_flight);
+    m_page_table_versions.assign(frames_in_flight, 0);
+    m_feedback.resize(frames_in_flight);
+    m_feedback_addresses.resize(frames_in_flight);
+
+    for (u32 i = 0; i < frames_in_flight; ++i) {
+        m_page_tables[i].Setup(allocator, PageTableCapacity * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Textures);
+        m_page_table_addresses[i] = static_cast<u32 *>(m_page_tables[i].Map());
+
+        m_feedback[i].Setup(allocator, FeedbackSize * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Textures);
+        m_feedback_addresses[i] = static_cast<u32 *>(m_feedback[i].Map());
+        std::memset(m_feedback_addresses[i], 0, FeedbackSize * sizeof(u32));
+    }
+
+    {
+        VkDescriptorSetLayoutBinding bindings[3]{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        bindings[2].binding = 2;
+        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[2].descriptorCount = 1;
+        bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo ci{};
+        ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        ci.bindingCount = 3;
+        ci.pBindings = bindings;
+
+        VK_CHECK(vkCreateDescriptorSetLayout(device, &ci, memory::HostCallbacks(memory::Tag::Textures), &m_layout));
+    }
+
+    {
+        VkDescriptorPoolSize pool_sizes[2]{};
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_sizes[0].descriptorCount = 2 * frames_in_flight;
+        pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_sizes[1].descriptorCount = frames_in_flight;
+
+        VkDescriptorPoolCreateInfo ci{};
+        ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        ci.maxSets = frames_in_flight;
+        ci.poolSizeCount = 2;
+        ci.pPoolSizes = pool_sizes;
+
+        VK_CHECK(vkCreateDescriptorPool(device, &ci, memory::HostCallbacks(memory::Tag::Textures), &m_descriptor_pool));
+    }
+
+    m_sets.resize(frames_in_flight);
+
+    for (u32 i = 0; i < frames_in_flight; ++i) {
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = m_descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &m_layout;
+
+        VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &m_sets[i]));
+
+        VkDescriptorBufferInfo page_table_info{};
+        page_table_info.buffer = m_page_tables[i].Handle();
+        page_table_info.offset = 0;
+        page_table_info.range = VK_WHOLE_SIZE;
+
+        VkDescriptorImageInfo atlas_info{};
+        atlas_info.sampler = m_atlas.Sampler();
+        atlas_info.imageView = m_atlas.View();
+        atlas_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkDescriptorBufferInfo feedback_info{};
+        feedback_info.buffer = m_feedback[i].Handle();
+        feedback_info.offset = 0;
+        feedback_info.range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet writes[3]{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = m_sets[i];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[0].pBufferInfo = &page_table_info;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = m_sets[i];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[1].pImageInfo = &atlas_info;
+
+        writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[2].dstSet = m_sets[i];
+        writes[2].dstBinding = 2;
+        writes[2].descriptorCount = 1;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[2].pBufferInfo = &feedback_info;
+
+        vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
+    }
+
+    m_init = true;
+}
+
+void VirtualTextureCache::Destroy()
+{
+    assert(m_init);
+
+    // Page reads may still be writing into staging
+    m_jobs->Wait(m_reads);
+
+    vkDestroyDescriptorPool(m_device, m_descriptor_pool, memory::HostCallbacks(memory::Tag::Textures));
+    vkDestroyDescriptorSetLayout(m_device, m_layout, memory::HostCallbacks(memory::Tag::Textures));
+
+    for (u32 i = 0; i < m_frames_in_flight; ++i) {
+        m_page_tables[i].Unmap();
+        m_page_tables[i].Destroy();
+        m_feedback[i].Unmap();
+        m_feedback[i].Destroy();
+    }
+
+    m_staging.Unmap();
+    m_staging.Destroy();
+    m_atlas.Destroy();
+
+    m_init = false;
+}
+
+u32 VirtualTextureCache::Register(const std::filesystem::path& path)
+{
+    assert(m_init);
+
+    if (m_textures.size() == MaxTextures) FatalError("too many virtual textures ({})", MaxTextures);
+
+    Texture& texture = m_textures.emplace_back();
+    texture.path = path;
+    texture.info = vtex::ReadInfo(path);
+    texture.base = static_cast<u32>(m_table.size());
+
+    // Feedback packs page coordinates into ten bits each
+    if (vtex::LevelPages(texture.info.size, 0).width > 1024 || vtex::LevelPages(texture.info.size, 0).height > 1024) {
+        FatalError("{} is too large for a virtual texture", path.string());
+    }
+
+    u32 entries = HeaderSize;
+
+    for (u32 level = 0; level < texture.info.levels; ++level) {
+        texture.pages[level] = vtex::LevelPages(texture.info.size, level);
+        entries += texture.pages[level].width * texture.pages[level].height;
+    }
+
+    if (m_table.size() + entries > PageTableCapacity) FatalError("virtual texture page table is full ({} entries)", PageTableCapacity);
+
+    m_table.resize(m_table.size() + entries, InvalidEntry);
+    m_mapping.resize(m_table.size(), NotResident);
+    m_requested_frame.resize(m_table.size(), 0);
+
+    m_table[texture.base + 0] = texture.info.size.width;
+    m_table[texture.base + 1] = texture.info.size.height;
+    m_table[texture.base + 2] = texture.info.levels;
+    m_table[texture.base + 3] = static_cast<u32>(m_textures.size() - 1);
+
+    u32 offset = texture.base + HeaderSize;
+
+    for (u32 level = 0; level < texture.info.levels; ++level) {
+        m_table[texture.base + 4 + level] = offset;
+        offset += texture.pages[level].width * texture.pages[level].height;
+    }
+
+    m_table_dirty = true;
+
+    return texture.base;
+}
+
+void VirtualTextureCache::Update(u32 frame, VkCommandBuffer cmd)
+{
+    assert(m_init);
+
+    ++m_frame;
+    m_wanted.clear();
+
+    // One extra frame of margin, since frames are not always acquired in order
+    for (auto& load : m_loads) {
+        if (load.state.load(std::memory_order_relaxed) == LoadState::Copied && load.copied_frame + m_frames_in_flight < m_frame) {
+            load.state.store(LoadState::Free, std::memory_order_relaxed);
+        }
+    }
+
+    // Every texture's last level is always wanted
+    for (u32 id = 0; id < m_textures.size(); ++id) Touch(id, m_textures[id].info.levels - 1, 0, 0);
+
+    // Values are offset by one so that zero means no request, and anything out of range is ignored
+    u32 *feedback = m_feedback_addresses[frame];
+
+    for (u32 i = 0; i < FeedbackSize; ++i) {
+        if (feedback[i] == 0) continue;
+
+        const u32 request = feedback[i] - 1;
+        const u32 id = request >> 24;
+        const u32 level = (request >> 20) & 0xf;
+        const u32 y = (request >> 10) & 0x3ff;
+        const u32 x = request & 0x3ff;
+
+        if (id >= m_textures.size()) continue;
+
+        const Texture& texture = m_textures[id];
+        if (level >= texture.info.levels || x >= texture.pages[level].width || y >= texture.pages[level].height) continue;
+
+        Touch(id, level, x, y);
+    }
+
+    std::memset(feedback, 0, FeedbackSize * sizeof(u32));
+
+    // Loaded pages are copied over the least recently used pages in the atlas
+    bool copying = false;
+
+    for (u32 i = 0; i < MaxLoads; ++i) {
+        Load& load = m_loads[i];
+        if (load.state.load(std::memory_order_acquire) != LoadState::Ready) continue;
+
+        const u32 page = AllocatePage();
+        if (page == NotResident) break;
+
+        PhysicalPage& physical = m_pages[page];
+        if (physical.entry != NotResident) m_mapping[physical.entry] = NotResident;
+
+        physical.entry = load.entry;
+        physical.last_used = m_frame;
+        physical.pinned = load.level == m_textures[load.texture].info.levels - 1;
+        m_mapping[load.entry] = page;
+
+        if (!copying) {
+            AtlasBarrier(cmd, m_atlas.Handle(),
+                m_atlas_ready ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_2_COPY_BIT);
+
+            copying = true;
+        }
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = i * vtex::PageBytes;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { static_cast<int32_t>(page % AtlasPages * vtex::StoredPageSize), static_cast<int32_t>(page / AtlasPages * vtex::StoredPageSize), 0 };
+        region.imageExtent = { vtex::StoredPageSize, vtex::StoredPageSize, 1 };
+
+        vkCmdCopyBufferToImage(cmd, m_staging.Handle(), m_atlas.Handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        load.copied_frame = m_frame;
+        load.state.store(LoadState::Copied, std::memory_order_relaxed);
+        m_table_dirty = true;
+    }
+
+    // The atlas is sampled from the first frame, so it leaves the undefined layout even without pages
+    if (copying || !m_atlas_ready) {
+        AtlasBarrier(cmd, m_atlas.Handle(),
+            copying ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            copying ? VK_ACCESS_2_TRANSFER_WRITE_BIT : VK_ACCESS_2_NONE, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            copying ? VK_PIPELINE_STAGE_2_COPY_BIT : VK_PIPELINE_STAGE_2_NONE, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+
+        m_atlas_ready = true;
+    }
+
+    // Coarse pages first, as they stand in for everything below them
+    std::sort(m_wanted.begin(), m_wanted.end(), [](const Want& a, const Want& b) { return a.level > b.level; });
+
+    auto slot = m_loads.begin();
+
+    for (const Want& want : m_wanted) {
+        slot = std::find_if(slot, m_loads.end(), [](const Load& load) { return load.state.load(std::memory_order_relaxed) == LoadState::Free; });
+        if (slot == m_loads.end()) break;
+
+        Load& load = *slot;
+        load.texture = want.texture;
+        load.level = want.level;
+        load.entry = want.entry;
+        load.state.store(LoadState::Reading, std::memory_order_relaxed);
+        m_mapping[want.entry] = Loading;
+
+        const Texture& texture = m_textures[want.texture];
+        u8 *out = m_staging_address + (slot - m_loads.begin()) * vtex::PageBytes;
+
+        memory::FrameAllocationPause pause;
+
+        // The path and info are copied, as registering more textures may move the texture list
+        m_jobs->Submit([&load, path = texture.path, info = texture.info, want, out] {
+            memory::FrameAllocationPause pause;
+
+            vtex::ReadPage(path, info, want.level, want.x, want.y, out);
+            load.state.store(LoadState::Ready, std::memory_order_release);
+        }, &m_reads);
+    }
+
+    if (m_table_dirty) {
+        RebuildPageTable();
+        ++m_table_version;
+        m_table_dirty = false;
+    }
+
+    if (m_page_table_versions[frame] != m_table_version) {
+        std::memcpy(m_page_table_addresses[frame], m_table.data(), m_table.size() * sizeof(u32));
+        m_page_table_versions[frame] = m_table_version;
+    }
+}
+
+void VirtualTextureCache::RecordFeedbackBarrier(VkCommandBuffer cmd)
+{
+    sync::RecordMemoryBarrier(cmd,
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+}
+
+// Entries hold the atlas position of the page to sample and the level it belongs to,
+// which is coarser than the entry's own level while that page is not resident
+bool VirtualTextureCache::Busy() const
+{
+    assert(m_init);
+
+    for (const Load& load : m_loads) {
+        const LoadState state = load.state.load(std::memory_order_relaxed);
+        if (state == LoadState::Reading || state == LoadState::Ready) return true;
+    }
+
+    return std::any_of(m_wanted.begin(), m_wanted.end(), [&](const Want& want) { return m_mapping[want.entry] == NotResident; });
+}
+
+u32 VirtualTextureCache::PackEntry(u32 page, u32 level)
+{
+    return (page % AtlasPages) | (page / AtlasPages) << 12 | level << 24;
+}
+
+u32 VirtualTextureCache::Entry(const Texture& texture, u32 level, u32 x, u32 y) const
+{
+    return m_table[texture.base + 4 + level] + y * texture.pages[level].width + x;
+}
+
+void VirtualTextureCache::Touch(u32 id, u32 level, u32 x, u32 y)
+{
+    const Texture& texture = m_textures[id];
+    const u32 entry = Entry(texture, level, x, y);
+
+    if (m_requested_frame[entry] == m_frame) return;
+    m_requested_frame[entry] = m_frame;
+
+    if (m_mapping[entry] == NotResident) m_wanted.push_back({ id, level, x, y, entry });
+
+    // Levels halve while pages stay the same size, so the page above covers this one
+    for (; level < texture.info.levels; ++level) {
+        const u32 page = m_mapping[Entry(texture, level, x, y)];
+
+        if (page < m_pages.size()) {
+            m_pages[page].last_used = m_frame;
+            return;
+        }
+
+        if (level + 1 < texture.info.levels) {
+            x = std::min(x / 2, texture.pages[level + 1].width - 1);
+            y = std::min(y / 2, texture.pages[level + 1].height - 1);
+        }
+    }
+}
+
+u32 VirtualTextureCache::AllocatePage()
+{
+    u32 oldest = NotResident;
+
+    // Pages wanted this frame are never evicted, which bounds thrashing when the atlas is too small
+    for (u32 i = 0; i < m_pages.size(); ++i) {
+        const PhysicalPage& page = m_pages[i];
+
+        if (page.entry == NotResident) return i;
+        if (page.pinned || page.last_used == m_frame) continue;
+
+        if (oldest == NotResident || page.last_used < m_pages[oldest].last_used) oldest = i;
+    }
+
+    return oldest;
+}
+
+// Entries without a resident page of their own borrow the entry of the page above
+void VirtualTextureCache::RebuildPageTable()
+{
+    for (const auto& texture : m_textures) {
+        for (u32 level = texture.info.levels; level-- > 0;) {
+            const VkExtent2D pages = texture.pages[level];
+
+            for (u32 y = 0; y < pages.height; ++y) {
+                for (u32 x = 0; x < pages.width; ++x) {
+                    const u32 entry = Entry(texture, level, x, y);
+                    const u32 page = m_mapping[entry];
+
+                    if (page < m_pages.size()) {
+                        m_table[entry] = PackEntry(page, level);
+                    } else if (level + 1 < texture.info.levels) {
+                        const VkExtent2D above = texture.pages[level + 1];
+                        m_table[entry] = m_table[Entry(texture, level + 1, std::min(x / 2, above.width - 1), std::min(y / 2, above.height - 1))];
+                    } else {
+                        m_table[entry] = InvalidEntry;
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace vker
\ No newline at end of file
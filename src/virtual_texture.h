@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <filesystem>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "contrib/vk_mem_alloc.h"
+
+#include "buffer.h"
+#include "image.h"
+#include "job_system.h"
+#include "types.h"
+#include "vtex.h"
+
+namespace vker {
+
+// Software virtual texturing for textures stored as pages in .vtex files. Fragments
+// sample through a page table into one atlas of physical pages, and write the pages
+// they want into a feedback buffer. The CPU reads that back a few frames later, loads
+// missing pages on the loader threads and evicts the least recently used ones
+class VirtualTextureCache {
+public:
+	VirtualTextureCache() = default;
+
+	void Setup(VkDevice device, VmaAllocator allocator, JobSystem& jobs, u32 frames_in_flight);
+	void Destroy();
+
+	// Returns the page table offset that shader/virtual.frag takes as its texture index
+	u32 Register(const std::filesystem::path& path);
+
+	// Called once the frame's fence has been waited on and its command buffer begun, before
+	// the render pass. Reads the frame's feedback, records copies of loaded pages into the
+	// atlas and publishes the frame's page table
+	void Update(u32 frame, VkCommandBuffer cmd);
+
+	// Called after the render pass, so the host can read the feedback once the fence signals
+	void RecordFeedbackBarrier(VkCommandBuffer cmd);
+
+	// Whether pages wanted by the last frame are still being loaded or waiting for a load
+	bool Busy() const;
+
+	inline VkDescriptorSetLayout Layout() const
+	{
+		assert(m_init);
+		return m_layout;
+	}
+
+	inline VkDescriptorSet Set(u32 frame) const
+	{
+		assert(m_init);
+		return m_sets[frame];
+	}
+
+private:
+	// Physical pages across and down the atlas
+	static constexpr u32 AtlasPages = 16;
+
+	// Pages being read from disk or waiting to be copied into the atlas at once
+	static constexpr u32 MaxLoads = 16;
+
+	// These must match shader/virtual.frag
+	static constexpr u32 FeedbackSize = 4096;
+	static constexpr u32 HeaderSize = 4 + vtex::MaxLevels;
+	static constexpr u32 InvalidEntry = UINT32_MAX;
+
+	static constexpr u32 PageTableCapacity = 256 * 1024;
+	static constexpr u32 MaxTextures = 255;
+
+	// Page table mapping states besides a physical page index
+	static constexpr u32 NotResident = UINT32_MAX;
+	static constexpr u32 Loading = UINT32_MAX - 1;
+
+	struct Texture {
+		std::filesystem::path path;
+		vtex::Info info;
+		std::array<VkExtent2D, vtex::MaxLevels> pages;
+
+		// Offset of the header, followed by a table of entries for each level
+		u32 base;
+	};
+
+	struct PhysicalPage {
+		// Page table entry of the virtual page held, NotResident when empty
+		u32 entry = NotResident;
+		u64 last_used = 0;
+
+		// A texture's last level is never evicted, so every lookup finds a page
+		bool pinned = false;
+	};
+
+	enum class LoadState : u32 { Free, Reading, Ready, Copied };
+
+	struct Load {
+		std::atomic<LoadState> state = LoadState::Free;
+
+		u32 texture;
+		u32 level;
+		u32 entry;
+
+		// Staging is reused once the frame that copied from it has finished
+		u64 copied_frame;
+	};
+
+	struct Want {
+		u32 texture;
+		u32 level;
+		u32 x;
+		u32 y;
+		u32 entry;
+	};
+
+	static u32 PackEntry(u32 page, u32 level);
+	u32 Entry(const Texture& texture, u32 level, u32 x, u32 y) const;
+
+	// Marks a page as wanted, and whichever page stands in for it as used
+	void Touch(u32 id, u32 level, u32 x, u32 y);
+
+	u32 AllocatePage();
+	void RebuildPageTable();
+
+	bool m_init = false;
+
+	VkDevice m_device;
+	VmaAllocator m_allocator;
+	JobSystem *m_jobs;
+
+	// Page reads still running
+	JobCounter m_reads;
+
+	u32 m_frames_in_flight;
+	u64 m_frame = 0;
+
+	std::vector<Texture> m_textures;
+
+	// CPU copy of the page table, with each entry's physical page or mapping state alongside
+	std::vector<u32> m_table;
+	std::vector<u32> m_mapping;
+	std::vector<u64> m_requested_frame;
+	bool m_table_dirty = false;
+	u64 m_table_version = 0;
+
+	std::vector<PhysicalPage> m_pages;
+	std::vector<Want> m_wanted;
+	std::array<Load, MaxLoads> m_loads;
+
+	Image m_atlas;
+	bool m_atlas_ready = false;
+
+	Buffer m_staging;
+	u8 *m_staging_address;
+
+	std::vector<Buffer> m_page_tables;
+	std::vector<u32 *> m_page_table_addresses;
+	std::vector<u64> m_page_table_versions;
+
+	std::vector<Buffer> m_feedback;
+	std::vector<u32 *> m_feedback_addresses;
+
+	VkDescriptorSetLayout m_layout;
+	VkDescriptorPool m_descriptor_pool;
+	std::vector<VkDescriptorSet> m_sets;
+};
+
+} // namespace vker
\ No newline at end of file
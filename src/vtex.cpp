@@ -0,0 +1,163 @@
+#include "vtex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "mipmap.h"
+#include "utils.h"
+
+namespace vker::vtex {
+
+namespace {
+
+constexpr u8 Identifier[8] = { 'V', 'K', 'E', 'R', 'V', 'T', 'X', '1' };
+
+// All fields are little endian, which is assumed to match the host
+struct Header {
+    u8 identifier[8];
+    u32 width;
+    u32 height;
+    u32 levels;
+    u32 page_size;
+    u32 page_border;
+    u32 vk_format;
+};
+
+static_assert(sizeof(Header) == 32);
+
+Info MakeInfo(VkExtent2D size)
+{
+    Info info{};
+    info.size = size;
+    info.levels = LevelCount(size);
+
+    u32 pages = 0;
+
+    for (u32 level = 0; level < info.levels; ++level) {
+        const VkExtent2D level_pages = LevelPages(size, level);
+
+        info.first_page[level] = pages;
+        pages += level_pages.width * level_pages.height;
+    }
+
+    return info;
+}
+
+size_t PageOffset(const Info& info, u32 level, u32 x, u32 y)
+{
+    const u32 page = info.first_page[level] + y * LevelPages(info.size, level).width + x;
+    return sizeof(Header) + page * PageBytes;
+}
+
+} // namespace
+
+u32 LevelCount(VkExtent2D size)
+{
+    u32 levels = 1;
+
+    while (std::max(size.width, size.height) >> (levels - 1) > PageSize) ++levels;
+
+    return levels;
+}
+
+VkExtent2D LevelPages(VkExtent2D size, u32 level)
+{
+    const VkExtent2D extent = mipmap::LevelExtent(size, level);
+    return { (extent.width + PageSize - 1) / PageSize, (extent.height + PageSize - 1) / PageSize };
+}
+
+Info ReadInfo(const std::filesystem::path& path)
+{
+    std::ifstream file{ path, std::ios::binary | std::ios::ate };
+    if (!file) FatalError("failed to open {}", path.string());
+
+    const size_t file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    Header header;
+    if (file_size < sizeof(header)) FatalError("{} is not a virtual texture", path.string());
+
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (std::memcmp(header.identifier, Identifier, sizeof(Identifier)) != 0) FatalError("{} is not a virtual texture", path.string());
+
+    if (header.page_size != PageSize || header.page_border != PageBorder || header.vk_format != VK_FORMAT_R8G8B8A8_UNORM) {
+        FatalError("{} has an unsupported page layout", path.string());
+    }
+
+    if (header.width == 0 || header.height == 0) FatalError("{} is empty", path.string());
+
+    const VkExtent2D size{ header.width, header.height };
+    if (LevelCount(size) > MaxLevels || header.levels != LevelCount(size)) FatalError("{} has a bad level count", path.string());
+
+    const Info info = MakeInfo(size);
+
+    const u32 last = info.levels - 1;
+    if (file_size < PageOffset(info, last, 0, 0) + PageBytes) FatalError("{} is truncated", path.string());
+
+    return info;
+}
+
+void ReadPage(const std::filesystem::path& path, const Info& info, u32 level, u32 x, u32 y, u8 *out)
+{
+    std::ifstream file{ path, std::ios::binary };
+    file.seekg(PageOffset(info, level, x, y));
+    file.read(reinterpret_cast<char *>(out), PageBytes);
+
+    if (!file) FatalError("failed to read {}", path.string());
+}
+
+void Write(const std::filesystem::path& path, const u8 *rgba, VkExtent2D size)
+{
+    if (LevelCount(size) > MaxLevels) FatalError("{}x{} is too large for a virtual texture", size.width, size.height);
+
+    const Info info = MakeInfo(size);
+
+    std::vector<u8> chain(mipmap::ChainSize(size, info.levels));
+    std::memcpy(chain.data(), rgba, size_t(size.width) * size.height * 4);
+    mipmap::GenerateRGBA8(chain.data(), size, info.levels);
+
+    Header header{};
+    std::memcpy(header.identifier, Identifier, sizeof(Identifier));
+    header.width = size.width;
+    header.height = size.height;
+    header.levels = info.levels;
+    header.page_size = PageSize;
+    header.page_border = PageBorder;
+    header.vk_format = VK_FORMAT_R8G8B8A8_UNORM;
+
+    std::ofstream file{ path, std::ios::binary };
+    if (!file) FatalError("failed to open {} for writing", path.string());
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<u8> page(PageBytes);
+
+    // Pages are written in file order, one at a time
+    for (u32 level = 0; level < info.levels; ++level) {
+        const VkExtent2D extent = mipmap::LevelExtent(size, level);
+        const VkExtent2D pages = LevelPages(size, level);
+        const u8 *texels = chain.data() + mipmap::LevelOffset(size, level);
+
+        for (u32 y = 0; y < pages.height; ++y) {
+            for (u32 x = 0; x < pages.width; ++x) {
+                // Texels past the edge of the level, including the outer border, repeat the edge
+                for (u32 row = 0; row < StoredPageSize; ++row) {
+                    const int src_y = std::clamp(static_cast<int>(y * PageSize + row) - static_cast<int>(PageBorder), 0, static_cast<int>(extent.height) - 1);
+
+                    for (u32 column = 0; column < StoredPageSize; ++column) {
+                        const int src_x = std::clamp(static_cast<int>(x * PageSize + column) - static_cast<int>(PageBorder), 0, static_cast<int>(extent.width) - 1);
+                        std::memcpy(page.data() + (size_t(row) * StoredPageSize + column) * 4, texels + (size_t(src_y) * extent.width + src_x) * 4, 4);
+                    }
+                }
+
+                file.write(reinterpret_cast<const char *>(page.data()), page.size());
+            }
+        }
+    }
+
+    if (!file) FatalError("failed to write {}", path.string());
+}
+
+} // namespace vker::vtex
\ No newline at end of file
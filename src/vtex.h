@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <filesystem>
+
+#include <vulkan/vulkan.h>
+
+#include "types.h"
+
+namespace vker::vtex {
+
+// Texels of a level held by one page, and the texels repeated from its
+// neighbours around each side so that bilinear filtering never crosses a page
+constexpr u32 PageSize = 128;
+constexpr u32 PageBorder = 4;
+constexpr u32 StoredPageSize = PageSize + 2 * PageBorder;
+
+// Pages are RGBA8
+constexpr size_t PageBytes = size_t(StoredPageSize) * StoredPageSize * 4;
+
+constexpr u32 MaxLevels = 16;
+
+struct Info {
+	VkExtent2D size;
+
+	// Down to the first level that fits in a single page
+	u32 levels;
+
+	// Index of each level's first page, pages are stored level by level in row order
+	std::array<u32, MaxLevels> first_page;
+};
+
+// Levels kept for a texture of the given size, ending with a single page
+u32 LevelCount(VkExtent2D size);
+
+// Pages across and down a level
+VkExtent2D LevelPages(VkExtent2D size, u32 level);
+
+// Malformed files are fatal errors
+Info ReadInfo(const std::filesystem::path& path);
+void ReadPage(const std::filesystem::path& path, const Info& info, u32 level, u32 x, u32 y, u8 *out);
+
+// Cuts an RGBA8 image and its mip chain into pages
+void Write(const std::filesystem::path& path, const u8 *rgba, VkExtent2D size);
+
+} // namespace vker::vtex
\ No newline at end of file
@@ -29,15 +29,16 @@ Window::Window(int width, int height, const std::string& title)
 	if (!m_window) FatalError("unable to create window");
 	glfwSetWindowUserPointer(m_window, this);
 
+	// Minimizing reports a zero size, which is passed on rather than waited out here
 	glfwSetFramebufferSizeCallback(m_window, [](GLFWwindow *window, int w, int h) {
-		while (w == 0 || h == 0) {
-			glfwWaitEvents();
-			glfwGetFramebufferSize(window, &w, &h);
-		}
-
 		const auto wnd = static_cast<Window *>(glfwGetWindowUserPointer(window));
 		if (wnd->GetResizeCallback()) wnd->GetResizeCallback()(w, h);
 	});
+
+	glfwSetWindowRefreshCallback(m_window, [](GLFWwindow *window) {
+		const auto wnd = static_cast<Window *>(glfwGetWindowUserPointer(window));
+		if (wnd->GetRefreshCallback()) wnd->GetRefreshCallback()();
+	});
 }
 
 Window::~Window()
@@ -49,7 +50,30 @@ Window::~Window()
 void Window::Update()
 {
 	glfwPollEvents();
+	CheckEscape();
+}
+
+void Window::WaitEvents(double timeout)
+{
+	glfwWaitEventsTimeout(timeout);
+	CheckEscape();
+}
 
+bool Window::Minimized() const
+{
+	int w, h;
+	glfwGetFramebufferSize(m_window, &w, &h);
+
+	return glfwGetWindowAttrib(m_window, GLFW_ICONIFIED) || w == 0 || h == 0;
+}
+
+bool Window::Focused() const
+{
+	return glfwGetWindowAttrib(m_window, GLFW_FOCUSED);
+}
+
+void Window::CheckEscape()
+{
 	if (glfwGetKey(m_window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 		glfwSetWindowShouldClose(m_window, GLFW_TRUE);
 	}
@@ -20,8 +20,18 @@ public:
 
 	void Update();
 
+	// Like Update, but sleeps until an event arrives or the timeout in seconds passes
+	void WaitEvents(double timeout);
+
+	// Ends a WaitEvents early. Unlike the rest, safe to call from any thread
+	inline void Wake() const { glfwPostEmptyEvent(); }
+
 	inline bool ShouldClose() const { return glfwWindowShouldClose(m_window); }
 
+	// Minimized windows have no framebuffer to present to
+	bool Minimized() const;
+	bool Focused() const;
+
 	const char ** QueryInstanceExtensions(u32 &count) const;
 	void CreateSurface(VkInstance instance, VkSurfaceKHR *surface) const;
 
@@ -37,9 +47,18 @@ public:
 	inline ResizeCb GetResizeCallback() const { return m_resize_cb; }
 	inline void SetResizeCallback(ResizeCb cb) { m_resize_cb = cb; }
 
+	// Called when the window's contents were damaged and need to be drawn again
+	using RefreshCb = std::function<void()>;
+
+	inline RefreshCb GetRefreshCallback() const { return m_refresh_cb; }
+	inline void SetRefreshCallback(RefreshCb cb) { m_refresh_cb = cb; }
+
 private:
+	void CheckEscape();
+
 	GLFWwindow *m_window;
 	ResizeCb m_resize_cb;
+	RefreshCb m_refresh_cb;
 };
 
 } // namespace vker
\ No newline at end of file
@@ -0,0 +1,278 @@
+// Encodes generated images to every format at every quality and checks the decoded result stays
+// close to the source. BC7 blocks of every mode, which the encoder does not produce, are written
+// by hand and checked against the colours their endpoints must decode to
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "bc.h"
+#include "types.h"
+
+using namespace vker;
+
+static int s_failures = 0;
+
+template <typename... Args>
+static void Fail(fmt::format_string<Args...> format, Args&&... args)
+{
+    fmt::print(stderr, "FAIL: {}\n", fmt::format(format, std::forward<Args>(args)...));
+    ++s_failures;
+}
+
+// Gradients along a line through colour space, which every format should keep close, and flat
+// colours, which it should keep exact
+static std::vector<u8> MakeImage(VkExtent2D size, u32 style, std::mt19937& rng)
+{
+    std::vector<u8> rgba(size_t(size.width) * size.height * 4);
+    const u8 flat[4] = { static_cast<u8>(rng()), static_cast<u8>(rng()), static_cast<u8>(rng()), static_cast<u8>(rng()) };
+
+    for (u32 y = 0; y < size.height; ++y) {
+        for (u32 x = 0; x < size.width; ++x) {
+            u8 *texel = rgba.data() + (size_t(y) * size.width + x) * 4;
+
+            for (u32 c = 0; c < 4; ++c) {
+                texel[c] = style == 0 ? flat[c] : static_cast<u8>((x + y) * 2 + c * 16);
+            }
+        }
+    }
+
+    return rgba;
+}
+
+struct Channels {
+    u32 count;
+    bool alpha;
+};
+
+static Channels FormatChannels(bc::Format format)
+{
+    switch (format) {
+    case bc::Format::BC1: return { 3, false };
+    case bc::Format::BC3: return { 4, true };
+    case bc::Format::BC5: return { 2, false };
+    case bc::Format::BC7: return { 4, true };
+    }
+
+    return { 0, false };
+}
+
+static void RoundTrip(bc::Format format, bc::Quality quality, VkExtent2D size, u32 style, std::mt19937& rng)
+{
+    const std::vector<u8> source = MakeImage(size, style, rng);
+
+    std::vector<u8> blocks(bc::EncodedSize(format, size));
+    bc::Encode(format, quality, source.data(), size, blocks.data());
+
+    std::vector<u8> decoded(source.size());
+    bc::Decode(format, blocks.data(), size, decoded.data());
+
+    const Channels channels = FormatChannels(format);
+
+    // BC1 colour keeps 5 or 6 bits, everything else at least 7
+    const u32 flat_tolerance = format == bc::Format::BC1 || format == bc::Format::BC3 ? 4 : 1;
+    const double gradient_tolerance = format == bc::Format::BC7 ? 2.0 : 4.0;
+
+    u32 max_error = 0;
+    double squared_error = 0.0;
+
+    for (size_t i = 0; i < source.size(); i += 4) {
+        for (u32 c = 0; c < channels.count; ++c) {
+            const u32 error = static_cast<u32>(std::abs(int(source[i + c]) - int(decoded[i + c])));
+
+            max_error = std::max(max_error, error);
+            squared_error += double(error) * error;
+        }
+
+        if (!channels.alpha && decoded[i + 3] != 255) {
+            Fail("format {} quality {}: alpha decoded as {} instead of 255", static_cast<u32>(format), static_cast<u32>(quality), decoded[i + 3]);
+            return;
+        }
+    }
+
+    const double rms_error = std::sqrt(squared_error / (double(size.width) * size.height * channels.count));
+
+    if (style == 0 && max_error > flat_tolerance) {
+        Fail("format {} quality {}, {}x{}: flat colour off by {}", static_cast<u32>(format), static_cast<u32>(quality), size.width, size.height, max_error);
+    }
+
+    if (style == 1 && rms_error > gradient_tolerance) {
+        Fail("format {} quality {}, {}x{}: gradient error {:.2f}", static_cast<u32>(format), static_cast<u32>(quality), size.width, size.height, rms_error);
+    }
+}
+
+struct ModeInfo {
+    u32 subsets;
+    u32 partition_bits;
+    u32 rotation_bits;
+    u32 selector_bits;
+    u32 colour_bits;
+    u32 alpha_bits;
+    u32 endpoint_pbits;
+    u32 shared_pbits;
+};
+
+constexpr ModeInfo Modes[8] = {
+    { 3, 4, 0, 0, 4, 0, 1, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1 },
+    { 3, 6, 0, 0, 5, 0, 0, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0 },
+    { 1, 0, 2, 0, 7, 8, 0, 0 },
+    { 1, 0, 0, 0, 7, 7, 1, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0 },
+};
+
+class BitWriter {
+public:
+    BitWriter(u8 *out) : m_out{out} { std::memset(out, 0, 16); }
+
+    void Write(u32 value, u32 bits)
+    {
+        for (u32 i = 0; i < bits; ++i, ++m_position) {
+            if (value & (1u << i)) m_out[m_position / 8] |= static_cast<u8>(1u << (m_position % 8));
+        }
+    }
+
+    // Indices come last, so filling the rest of the block sets every one of them to its largest value
+    void Fill()
+    {
+        for (; m_position < 128; ++m_position) m_out[m_position / 8] |= static_cast<u8>(1u << (m_position % 8));
+    }
+
+private:
+    u8 *m_out;
+    u32 m_position = 0;
+};
+
+// Endpoint 0 of every subset is black and endpoint 1 holds the largest value the mode can store,
+// so with every index at its largest texels decode to endpoint 1. Anchor texels store their index
+// one bit short, and come out part way. Alpha can be kept black instead, to show up rotations
+static void DecodeModeBlock(u32 mode, u32 partition, u32 rotation, bool black_alpha, u8 *texels)
+{
+    const ModeInfo& info = Modes[mode];
+
+    u8 block[16];
+    BitWriter writer{block};
+
+    writer.Write(1u << mode, mode + 1);
+    writer.Write(partition, info.partition_bits);
+    writer.Write(rotation, info.rotation_bits);
+    writer.Write(0, info.selector_bits);
+
+    for (u32 c = 0; c < 4; ++c) {
+        const u32 bits = c < 3 ? info.colour_bits : info.alpha_bits;
+
+        for (u32 s = 0; s < info.subsets; ++s) {
+            writer.Write(0, bits);
+            writer.Write(c == 3 && black_alpha ? 0 : (1u << bits) - 1, bits);
+        }
+    }
+
+    for (u32 s = 0; s < info.subsets * 2 * info.endpoint_pbits; ++s) writer.Write(s % 2, 1);
+    for (u32 s = 0; s < info.subsets * info.shared_pbits; ++s) writer.Write(0, 1);
+
+    writer.Fill();
+    bc::Decode(bc::Format::BC7, block, { 4, 4 }, texels);
+}
+
+static void CheckModes()
+{
+    for (u32 mode = 0; mode < 8; ++mode) {
+        const ModeInfo& info = Modes[mode];
+
+        for (u32 partition = 0; partition < (1u << info.partition_bits); ++partition) {
+            u8 texels[64];
+            DecodeModeBlock(mode, partition, 0, false, texels);
+
+            // Endpoints reach 255 in every channel only when the mode has a one p-bit for them,
+            // or no p-bits, and shared p-bits are written as zero here
+            const u8 full = info.shared_pbits ? static_cast<u8>(255 - (1u << (7 - info.colour_bits))) : 255;
+            u32 anchors = 0;
+            bool texel_0 = false;
+
+            for (u32 t = 0; t < 16; ++t) {
+                const u8 *texel = texels + t * 4;
+
+                if (texel[3] != 255 && info.alpha_bits == 0) {
+                    Fail("mode {} partition {}: texel {} alpha is {} without alpha bits", mode, partition, t, texel[3]);
+                }
+
+                if (texel[0] == full && texel[1] == full && texel[2] == full) continue;
+
+                // Anchors fall somewhere between the endpoints
+                if (texel[0] == 0 || texel[0] == full || texel[0] != texel[1] || texel[0] != texel[2]) {
+                    Fail("mode {} partition {}: texel {} decoded to {} {} {}", mode, partition, t, texel[0], texel[1], texel[2]);
+                }
+
+                texel_0 |= t == 0;
+                ++anchors;
+            }
+
+            // One anchor per subset, which the partition tables must agree on with the encoder's
+            if (anchors != info.subsets || !texel_0) {
+                Fail("mode {} partition {}: {} anchors, expected {} including texel 0", mode, partition, anchors, info.subsets);
+            }
+        }
+
+        // Rotation swaps the black alpha with a colour channel
+        for (u32 rotation = 0; info.rotation_bits && rotation < (1u << info.rotation_bits); ++rotation) {
+            u8 texels[64];
+            DecodeModeBlock(mode, 0, rotation, true, texels);
+
+            const u8 *texel = texels + 15 * 4;
+            const bool swapped = rotation == 0 ? texel[3] == 0 : texel[rotation - 1] == 0 && texel[3] == 255;
+
+            if (!swapped) Fail("mode {} rotation {}: texel 15 decoded to {} {} {} {}", mode, rotation, texel[0], texel[1], texel[2], texel[3]);
+        }
+    }
+
+    // Reserved mode bits decode to transparent black
+    u8 reserved[16] = {};
+    reserved[1] = 0xff;
+
+    u8 texels[64];
+    std::memset(texels, 0xff, sizeof(texels));
+    bc::Decode(bc::Format::BC7, reserved, { 4, 4 }, texels);
+
+    if (std::any_of(texels, texels + 64, [](u8 value) { return value != 0; })) Fail("reserved mode did not decode to zero");
+}
+
+int main()
+{
+    std::mt19937 rng{ 1234 };
+
+    constexpr bc::Format Formats[] = { bc::Format::BC1, bc::Format::BC3, bc::Format::BC5, bc::Format::BC7 };
+    constexpr bc::Quality Qualities[] = { bc::Quality::Fast, bc::Quality::Normal, bc::Quality::High };
+
+    // Sizes that are not multiples of the block size repeat their edges
+    constexpr VkExtent2D Sizes[] = { { 4, 4 }, { 64, 32 }, { 13, 7 } };
+
+    u32 images = 0;
+
+    for (bc::Format format : Formats) {
+        for (bc::Quality quality : Qualities) {
+            for (VkExtent2D size : Sizes) {
+                for (u32 style = 0; style < 2; ++style) {
+                    RoundTrip(format, quality, size, style, rng);
+                    ++images;
+                }
+            }
+        }
+    }
+
+    CheckModes();
+
+    if (s_failures != 0) {
+        fmt::print(stderr, "{} failures\n", s_failures);
+        return EXIT_FAILURE;
+    }
+
+    fmt::print("{} images round trip, every BC7 mode decodes\n", images);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,371 @@
+// Uploads a known image through both mip generation paths, reads every level back and
+// checks it. Prefers a CPU device such as lavapipe, and skips when there is no device
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <vulkan/vulkan.h>
+
+#define VMA_IMPLEMENTATION
+#include "contrib/vk_mem_alloc.h"
+
+#include "buffer.h"
+#include "image.h"
+#include "memory.h"
+#include "mipmap.h"
+#include "sync.h"
+#include "texture_data.h"
+#include "types.h"
+#include "utils.h"
+
+using namespace vker;
+
+// ctest reports the test as skipped rather than failed
+constexpr int SkipCode = 77;
+
+constexpr VkExtent2D Size{ 256, 128 };
+constexpr VkFormat Format = VK_FORMAT_R8G8B8A8_UNORM;
+
+static int s_failures = 0;
+
+template <typename... Args>
+static void Fail(fmt::format_string<Args...> format, Args&&... args)
+{
+    fmt::print(stderr, "FAIL: {}\n", fmt::format(format, std::forward<Args>(args)...));
+    ++s_failures;
+}
+
+struct Context {
+    VkInstance instance;
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool pool;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    VmaAllocator allocator;
+};
+
+static bool CreateContext(Context& ctx)
+{
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "vker_mipmap_test";
+    app_info.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instance_info{};
+    instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_info.pApplicationInfo = &app_info;
+
+    if (vkCreateInstance(&instance_info, nullptr, &ctx.instance) != VK_SUCCESS) return false;
+
+    u32 device_count = 0;
+    VK_CHECK(vkEnumeratePhysicalDevices(ctx.instance, &device_count, nullptr));
+    if (device_count == 0) return false;
+
+    std::vector<VkPhysicalDevice> devices(device_count);
+    VK_CHECK(vkEnumeratePhysicalDevices(ctx.instance, &device_count, devices.data()));
+
+    ctx.physical_device = devices[0];
+
+    for (const auto device : devices) {
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(device, &props);
+
+        if (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) ctx.physical_device = device;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx.physical_device, &props);
+    fmt::print("device: {}\n", props.deviceName);
+
+    u32 family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, families.data());
+
+    u32 family = UINT32_MAX;
+
+    for (u32 i = 0; i < family_count; ++i) {
+        if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            family = i;
+            break;
+        }
+    }
+
+    if (family == UINT32_MAX) return false;
+
+    const float priority = 1.0f;
+
+    VkDeviceQueueCreateInfo queue_info{};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+
+    VkDeviceCreateInfo device_info{};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+
+    VK_CHECK(vkCreateDevice(ctx.physical_device, &device_info, nullptr, &ctx.device));
+    vkGetDeviceQueue(ctx.device, family, 0, &ctx.queue);
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = family;
+
+    VK_CHECK(vkCreateCommandPool(ctx.device, &pool_info, nullptr, &ctx.pool));
+
+    VkCommandBufferAllocateInfo cmd_info{};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = ctx.pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+
+    VK_CHECK(vkAllocateCommandBuffers(ctx.device, &cmd_info, &ctx.cmd));
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VK_CHECK(vkCreateFence(ctx.device, &fence_info, nullptr, &ctx.fence));
+
+    VmaAllocatorCreateInfo allocator_info{};
+    allocator_info.physicalDevice = ctx.physical_device;
+    allocator_info.device = ctx.device;
+    allocator_info.instance = ctx.instance;
+    allocator_info.pDeviceMemoryCallbacks = memory::DeviceCallbacks();
+    allocator_info.vulkanApiVersion = VK_API_VERSION_1_1;
+
+    VK_CHECK(vmaCreateAllocator(&allocator_info, &ctx.allocator));
+
+    // Barriers go through the original call, which every device has
+    sync::UseSynchronization2(false);
+
+    return true;
+}
+
+static void DestroyContext(Context& ctx)
+{
+    vmaDestroyAllocator(ctx.allocator);
+    vkDestroyFence(ctx.device, ctx.fence, nullptr);
+    vkDestroyCommandPool(ctx.device, ctx.pool, nullptr);
+    vkDestroyDevice(ctx.device, nullptr);
+    vkDestroyInstance(ctx.instance, nullptr);
+}
+
+// Known contents: red and blue ramp across, green ramps down
+static std::vector<u8> MakeChain()
+{
+    std::vector<u8> chain(mipmap::ChainSize(Size, mipmap::LevelCount(Size)));
+
+    for (u32 y = 0; y < Size.height; ++y) {
+        for (u32 x = 0; x < Size.width; ++x) {
+            u8 *texel = chain.data() + (size_t(y) * Size.width + x) * 4;
+            texel[0] = static_cast<u8>(x);
+            texel[1] = static_cast<u8>(y * 2);
+            texel[2] = static_cast<u8>(255 - x);
+            texel[3] = 255;
+        }
+    }
+
+    return chain;
+}
+
+// Uploads levels [0, staged_levels) of the chain, lets the image generate the rest and reads every level back
+static std::vector<u8> UploadAndReadBack(Context& ctx, const std::vector<u8>& chain, u32 staged_levels)
+{
+    const u32 mip_levels = mipmap::LevelCount(Size);
+    const size_t chain_size = mipmap::ChainSize(Size, mip_levels);
+
+    Buffer staging;
+    staging.Setup(ctx.allocator, chain_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+    std::memcpy(staging.Map(), chain.data(), chain_size);
+    staging.Unmap();
+
+    Buffer readback;
+    readback.Setup(ctx.allocator, chain_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+
+    std::vector<TextureData::Level> levels;
+
+    for (u32 level = 0; level < staged_levels; ++level) {
+        const VkExtent2D extent = mipmap::LevelExtent(Size, level);
+        levels.push_back({ mipmap::LevelOffset(Size, level), size_t(extent.width) * extent.height * 4 });
+    }
+
+    Image image;
+    image.Setup(ctx.device, ctx.allocator, Size, Format, mip_levels, false);
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(ctx.cmd, &begin_info));
+
+    image.RecordUpload(ctx.cmd, staging.Handle(), levels);
+
+    sync::ImageBarrier barrier{};
+    barrier.image = image.Handle();
+    barrier.level_count = mip_levels;
+    barrier.old_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.new_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.src_stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    barrier.src_access = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    barrier.dst_stage = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.dst_access = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+    sync::RecordImageBarrier(ctx.cmd, barrier);
+
+    for (u32 level = 0; level < mip_levels; ++level) {
+        const VkExtent2D extent = mipmap::LevelExtent(Size, level);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = mipmap::LevelOffset(Size, level);
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+        region.imageExtent = { extent.width, extent.height, 1 };
+
+        vkCmdCopyImageToBuffer(ctx.cmd, image.Handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.Handle(), 1, &region);
+    }
+
+    sync::RecordMemoryBarrier(ctx.cmd,
+        VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+
+    VK_CHECK(vkEndCommandBuffer(ctx.cmd));
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &ctx.cmd;
+
+    VK_CHECK(vkQueueSubmit(ctx.queue, 1, &submit_info, ctx.fence));
+    VK_CHECK(vkWaitForFences(ctx.device, 1, &ctx.fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK(vkResetFences(ctx.device, 1, &ctx.fence));
+    VK_CHECK(vkResetCommandBuffer(ctx.cmd, 0));
+
+    std::vector<u8> result(chain_size);
+    std::memcpy(result.data(), readback.Map(), chain_size);
+    readback.Unmap();
+
+    image.Destroy();
+    readback.Destroy();
+    staging.Destroy();
+
+    return result;
+}
+
+// Every texel of a generated level must be within tolerance of the 2x2 box filter of the level above
+static void CheckBoxFiltered(const char *path, const std::vector<u8>& chain, u32 tolerance)
+{
+    for (u32 level = 1; level < mipmap::LevelCount(Size); ++level) {
+        const VkExtent2D src_extent = mipmap::LevelExtent(Size, level - 1);
+        const VkExtent2D dst_extent = mipmap::LevelExtent(Size, level);
+
+        // Filtered from the level read back, so rounding differences do not add up down the chain
+        std::vector<u8> filtered(mipmap::ChainSize(src_extent, 2));
+        std::memcpy(filtered.data(), chain.data() + mipmap::LevelOffset(Size, level - 1), size_t(src_extent.width) * src_extent.height * 4);
+        mipmap::GenerateRGBA8(filtered.data(), src_extent, 2);
+
+        const u8 *actual = chain.data() + mipmap::LevelOffset(Size, level);
+        const u8 *reference = filtered.data() + mipmap::LevelOffset(src_extent, 1);
+        const size_t bytes = size_t(dst_extent.width) * dst_extent.height * 4;
+
+        for (size_t i = 0; i < bytes; ++i) {
+            if (static_cast<u32>(std::abs(actual[i] - reference[i])) > tolerance) {
+                Fail("{} level {} byte {} is {}, expected {}", path, level, i, actual[i], reference[i]);
+                break;
+            }
+        }
+    }
+}
+
+// The ramps average out to the centre of each block of texels, give or take the rounding of each level
+static void CheckRamps(const char *path, const std::vector<u8>& chain)
+{
+    for (u32 level = 0; level < mipmap::LevelCount(Size); ++level) {
+        const VkExtent2D extent = mipmap::LevelExtent(Size, level);
+        const u8 *texels = chain.data() + mipmap::LevelOffset(Size, level);
+
+        const float block_x = float(Size.width) / extent.width;
+        const float block_y = float(Size.height) / extent.height;
+        const float tolerance = level + 1.0f;
+
+        for (u32 y = 0; y < extent.height; ++y) {
+            for (u32 x = 0; x < extent.width; ++x) {
+                const u8 *texel = texels + (size_t(y) * extent.width + x) * 4;
+
+                const float red = x * block_x + (block_x - 1.0f) * 0.5f;
+                const float green = (y * block_y + (block_y - 1.0f) * 0.5f) * 2.0f;
+
+                if (std::abs(texel[0] - red) > tolerance || std::abs(texel[1] - green) > tolerance ||
+                    std::abs(texel[2] - (255.0f - red)) > tolerance || texel[3] != 255) {
+                    Fail("{} level {} texel ({}, {}) is ({}, {}, {}, {})", path, level, x, y, texel[0], texel[1], texel[2], texel[3]);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    Context ctx;
+
+    if (!CreateContext(ctx)) {
+        fmt::print("no Vulkan device, skipping\n");
+        return SkipCode;
+    }
+
+    const u32 mip_levels = mipmap::LevelCount(Size);
+    const size_t level0_size = size_t(Size.width) * Size.height * 4;
+
+    std::vector<u8> chain = MakeChain();
+
+    // CPU path: the whole chain is box filtered on the host, and must come back exactly as uploaded
+    {
+        std::vector<u8> cpu_chain = chain;
+        mipmap::GenerateRGBA8(cpu_chain.data(), Size, mip_levels);
+        CheckRamps("cpu", cpu_chain);
+
+        const std::vector<u8> result = UploadAndReadBack(ctx, cpu_chain, mip_levels);
+
+        for (u32 level = 0; level < mip_levels; ++level) {
+            const size_t offset = mipmap::LevelOffset(Size, level);
+            const size_t size = mipmap::LevelOffset(Size, level + 1) - offset;
+
+            if (std::memcmp(result.data() + offset, cpu_chain.data() + offset, size) != 0) Fail("cpu level {} does not match the upload", level);
+        }
+    }
+
+    // Blit path: only level 0 is uploaded, and linear blits generate the rest on the device
+    VkFormatProperties format_props;
+    vkGetPhysicalDeviceFormatProperties(ctx.physical_device, Format, &format_props);
+
+    const VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+    if ((format_props.optimalTilingFeatures & blit_features) == blit_features) {
+        const std::vector<u8> result = UploadAndReadBack(ctx, chain, 1);
+
+        if (std::memcmp(result.data(), chain.data(), level0_size) != 0) Fail("blit level 0 does not match the upload");
+
+        CheckBoxFiltered("blit", result, 1);
+        CheckRamps("blit", result);
+    } else {
+        fmt::print("device cannot blit {} with linear filtering, skipping the blit path\n", static_cast<u32>(Format));
+    }
+
+    DestroyContext(ctx);
+
+    if (s_failures != 0) {
+        fmt::print(stderr, "{} failures\n", s_failures);
+        return EXIT_FAILURE;
+    }
+
+    fmt::print("all {} levels match\n", mip_levels);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
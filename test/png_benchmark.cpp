@@ -0,0 +1,124 @@
+// Times the native PNG decoder against stb_image on the model texture and on larger generated
+// images. Pass the asset texture directory as the first argument to include viking_room.png
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <fmt/core.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "contrib/stb_image.h"
+
+#include "png.h"
+#include "png_encoder.h"
+#include "types.h"
+
+using namespace vker;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr u32 Runs = 5;
+
+// Photo-like content: smooth gradients with a little noise, so filters and matches both pay off
+static std::vector<u8> MakeSamples(u32 width, u32 height, std::mt19937& rng)
+{
+    std::vector<u8> samples(size_t(width) * height * 4);
+    std::uniform_int_distribution<int> noise{ -3, 3 };
+
+    for (u32 y = 0; y < height; ++y) {
+        for (u32 x = 0; x < width; ++x) {
+            u8 *texel = &samples[(size_t(y) * width + x) * 4];
+
+            texel[0] = static_cast<u8>(std::clamp<int>(x * 255 / width + noise(rng), 0, 255));
+            texel[1] = static_cast<u8>(std::clamp<int>(y * 255 / height + noise(rng), 0, 255));
+            texel[2] = static_cast<u8>(((x / 64) ^ (y / 64)) & 1 ? 200 : 40);
+            texel[3] = 255;
+        }
+    }
+
+    return samples;
+}
+
+// Best of several runs, in milliseconds
+template <typename F>
+static double Time(F&& decode)
+{
+    double best = 1e30;
+
+    for (u32 i = 0; i < Runs; ++i) {
+        const auto start = Clock::now();
+        if (!decode()) return -1.0;
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    return best;
+}
+
+static bool Benchmark(const std::string& name, std::span<const u8> file)
+{
+    VkExtent2D size;
+    if (!png::ReadInfo(file, size)) {
+        fmt::print(stderr, "{}: header not read\n", name);
+        return false;
+    }
+
+    std::vector<u8> out(size_t(size.width) * size.height * 4);
+
+    const double native = Time([&] { return png::DecodeRGBA8(file, out.data()); });
+
+    const double reference = Time([&] {
+        int width, height, channels;
+        u8 *pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &channels, 4);
+
+        stbi_image_free(pixels);
+        return pixels != nullptr;
+    });
+
+    if (native < 0.0 || reference < 0.0) {
+        fmt::print(stderr, "{}: decode failed\n", name);
+        return false;
+    }
+
+    fmt::print("{:<24} {:>5}x{:<5} native {:8.2f} ms  stb_image {:8.2f} ms  ({:.2f}x)\n",
+               name, size.width, size.height, native, reference, reference / native);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+
+    if (argc > 1) {
+        const std::filesystem::path path = std::filesystem::path{ argv[1] } / "viking_room.png";
+        std::ifstream stream{ path, std::ios::binary };
+
+        if (stream) {
+            const std::vector<u8> file{ std::istreambuf_iterator<char>{ stream }, {} };
+            ok &= Benchmark("viking_room.png", file);
+        } else {
+            fmt::print(stderr, "unable to open {}\n", path.string());
+            ok = false;
+        }
+    }
+
+    std::mt19937 rng{ 0x85ebca6b };
+
+    for (const u32 extent : { 2048u, 4096u }) {
+        const std::vector<u8> samples = MakeSamples(extent, extent, rng);
+
+        test::PngOptions options;
+        options.blocks = { test::Block::Dynamic };
+        options.block_size = 1 << 20;
+        options.max_idat = 1 << 16;
+
+        const std::vector<u8> file = test::EncodePng(samples, extent, extent, options, rng);
+        ok &= Benchmark(fmt::format("generated {}", extent), file);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
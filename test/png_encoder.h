@@ -0,0 +1,488 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "types.h"
+
+// Writes the PNGs the decoder tests and benchmarks read, with every feature the decoder has to
+// handle chosen at random: per row filters, stored, fixed and dynamic deflate blocks, and
+// streams split across IDAT chunks. Small and slow, and only meant for tests
+namespace vker::test {
+
+enum class Block {
+	Stored,
+	Fixed,
+	Dynamic,
+};
+
+struct PngOptions {
+	u8 colour_type = 6;
+
+	// -1 picks a random filter for each row
+	int filter = -1;
+
+	// Blocks are picked at random from the allowed types, each covering up to block_size bytes
+	std::vector<Block> blocks = { Block::Stored, Block::Fixed, Block::Dynamic };
+	size_t block_size = 16384;
+
+	// Zero keeps the stream in one IDAT chunk
+	size_t max_idat = 0;
+
+	// Palette entries for colour type 3, and tRNS contents if not empty
+	std::vector<u8> palette;
+	std::vector<u8> transparency;
+};
+
+namespace detail {
+
+inline u32 Crc32(const u8 *data, size_t size, u32 crc = 0)
+{
+	static const std::array<u32, 256> table = [] {
+		std::array<u32, 256> t{};
+
+		for (u32 i = 0; i < 256; ++i) {
+			u32 c = i;
+			for (u32 k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			t[i] = c;
+		}
+
+		return t;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+inline u32 Adler32(std::span<const u8> data)
+{
+	u32 a = 1, b = 0;
+
+	for (const u8 byte : data) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	return (b << 16) | a;
+}
+
+class BitWriter {
+public:
+	void Write(u32 bits, u32 count)
+	{
+		for (u32 i = 0; i < count; ++i) {
+			if (m_bit == 0) m_bytes.push_back(0);
+			m_bytes.back() |= ((bits >> i) & 1) << m_bit;
+			m_bit = (m_bit + 1) & 7;
+		}
+	}
+
+	// Huffman codes go most significant bit first
+	void WriteCode(u32 code, u32 length)
+	{
+		for (u32 i = length; i-- > 0;) Write((code >> i) & 1, 1);
+	}
+
+	void AlignToByte() { m_bit = 0; }
+
+	std::vector<u8>& Bytes() { return m_bytes; }
+
+private:
+	std::vector<u8> m_bytes;
+	u32 m_bit = 0;
+};
+
+// Literals below 256, end of block at 256, and matches as a length and distance
+struct Token {
+	u16 symbol;
+	u16 length;
+	u16 distance;
+};
+
+constexpr u16 LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr u8 LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+constexpr u16 DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr u8 DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+inline u32 LengthCode(u32 length)
+{
+	u32 code = 0;
+	while (code + 1 < 29 && LengthBase[code + 1] <= length) ++code;
+	return code;
+}
+
+inline u32 DistanceCode(u32 distance)
+{
+	u32 code = 0;
+	while (code + 1 < 30 && DistanceBase[code + 1] <= distance) ++code;
+	return code;
+}
+
+// Greedy matches against a hash of the last position each three byte prefix was seen at
+inline std::vector<Token> Tokenize(std::span<const u8> data, size_t begin, size_t end, std::vector<int>& last_seen)
+{
+	std::vector<Token> tokens;
+
+	const auto hash = [&](size_t i) { return ((data[i] << 16) | (data[i + 1] << 8) | data[i + 2]) * 2654435761u >> 16; };
+
+	for (size_t i = begin; i < end;) {
+		u32 length = 0;
+		size_t distance = 0;
+
+		if (i + 3 <= end) {
+			const u32 h = hash(i);
+			const int candidate = last_seen[h];
+			last_seen[h] = static_cast<int>(i);
+
+			if (candidate >= 0 && i - candidate <= 32768) {
+				while (length < 258 && i + length < end && data[candidate + length] == data[i + length]) ++length;
+				distance = i - candidate;
+			}
+		}
+
+		if (length >= 3) {
+			tokens.push_back({ u16(257 + LengthCode(length)), u16(length), u16(distance) });
+			i += length;
+		} else {
+			tokens.push_back({ data[i], 0, 0 });
+			++i;
+		}
+	}
+
+	tokens.push_back({ 256, 0, 0 });
+	return tokens;
+}
+
+// Code lengths no longer than max_length. Frequencies are flattened until the tree fits, and at
+// least two symbols are always given a code, so the code is complete
+inline std::vector<u8> CodeLengths(std::vector<u32> frequencies, u32 max_length)
+{
+	u32 used = 0;
+	for (const u32 f : frequencies) used += f != 0;
+
+	for (size_t i = 0; used < 2; ++i) {
+		if (frequencies[i] == 0) {
+			frequencies[i] = 1;
+			++used;
+		}
+	}
+
+	for (;;) {
+		struct Node {
+			u64 weight;
+			int left, right;
+		};
+
+		std::vector<Node> nodes;
+		using Entry = std::pair<u64, int>;
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+
+		for (size_t i = 0; i < frequencies.size(); ++i) {
+			nodes.push_back({ frequencies[i], -1, -1 });
+			if (frequencies[i] != 0) queue.push({ frequencies[i], static_cast<int>(i) });
+		}
+
+		while (queue.size() > 1) {
+			const auto a = queue.top();
+			queue.pop();
+			const auto b = queue.top();
+			queue.pop();
+
+			nodes.push_back({ a.first + b.first, a.second, b.second });
+			queue.push({ a.first + b.first, static_cast<int>(nodes.size() - 1) });
+		}
+
+		std::vector<u8> lengths(frequencies.size(), 0);
+		u32 longest = 0;
+
+		const std::function<void(int, u32)> walk = [&](int node, u32 depth) {
+			if (nodes[node].left < 0) {
+				lengths[node] = static_cast<u8>(depth);
+				longest = std::max(longest, depth);
+				return;
+			}
+
+			walk(nodes[node].left, depth + 1);
+			walk(nodes[node].right, depth + 1);
+		};
+
+		walk(queue.top().second, 0);
+		if (longest <= max_length) return lengths;
+
+		for (auto& f : frequencies) {
+			if (f != 0) f = (f >> 1) | 1;
+		}
+	}
+}
+
+inline std::vector<u32> CanonicalCodes(const std::vector<u8>& lengths)
+{
+	u32 count[16] = {};
+	for (const u8 length : lengths) ++count[length];
+	count[0] = 0;
+
+	u32 next[16] = {};
+	u32 code = 0;
+
+	for (u32 bits = 1; bits < 16; ++bits) {
+		code = (code + count[bits - 1]) << 1;
+		next[bits] = code;
+	}
+
+	std::vector<u32> codes(lengths.size(), 0);
+	for (size_t i = 0; i < lengths.size(); ++i) {
+		if (lengths[i] != 0) codes[i] = next[lengths[i]]++;
+	}
+
+	return codes;
+}
+
+inline void WriteTokens(BitWriter& writer, const std::vector<Token>& tokens,
+	const std::vector<u8>& literal_lengths, const std::vector<u32>& literal_codes,
+	const std::vector<u8>& distance_lengths, const std::vector<u32>& distance_codes)
+{
+	for (const Token& token : tokens) {
+		writer.WriteCode(literal_codes[token.symbol], literal_lengths[token.symbol]);
+		if (token.symbol <= 256) continue;
+
+		const u32 length_code = token.symbol - 257;
+		writer.Write(token.length - LengthBase[length_code], LengthExtra[length_code]);
+
+		const u32 distance_code = DistanceCode(token.distance);
+		writer.WriteCode(distance_codes[distance_code], distance_lengths[distance_code]);
+		writer.Write(token.distance - DistanceBase[distance_code], DistanceExtra[distance_code]);
+	}
+}
+
+inline void WriteFixedBlock(BitWriter& writer, const std::vector<Token>& tokens)
+{
+	std::vector<u8> literal_lengths(288);
+	for (u32 i = 0; i < 288; ++i) literal_lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+
+	const std::vector<u8> distance_lengths(30, 5);
+
+	WriteTokens(writer, tokens, literal_lengths, CanonicalCodes(literal_lengths), distance_lengths, CanonicalCodes(distance_lengths));
+}
+
+inline void WriteDynamicBlock(BitWriter& writer, const std::vector<Token>& tokens)
+{
+	std::vector<u32> literal_frequencies(286, 0);
+	std::vector<u32> distance_frequencies(30, 0);
+
+	for (const Token& token : tokens) {
+		++literal_frequencies[token.symbol];
+		if (token.symbol > 256) ++distance_frequencies[DistanceCode(token.distance)];
+	}
+
+	const std::vector<u8> literal_lengths = CodeLengths(literal_frequencies, 15);
+	const std::vector<u8> distance_lengths = CodeLengths(distance_frequencies, 15);
+
+	u32 hlit = 286;
+	while (hlit > 257 && literal_lengths[hlit - 1] == 0) --hlit;
+
+	u32 hdist = 30;
+	while (hdist > 1 && distance_lengths[hdist - 1] == 0) --hdist;
+
+	std::vector<u8> lengths(literal_lengths.begin(), literal_lengths.begin() + hlit);
+	lengths.insert(lengths.end(), distance_lengths.begin(), distance_lengths.begin() + hdist);
+
+	// Runs of zeros use codes 17 and 18, and repeats of the previous length use 16
+	struct Run {
+		u8 symbol;
+		u8 extra;
+	};
+
+	std::vector<Run> runs;
+
+	for (size_t i = 0; i < lengths.size();) {
+		size_t run = 1;
+		while (i + run < lengths.size() && lengths[i + run] == lengths[i]) ++run;
+
+		if (lengths[i] == 0 && run >= 3) {
+			run = std::min<size_t>(run, 138);
+			runs.push_back(run >= 11 ? Run{ 18, u8(run - 11) } : Run{ 17, u8(run - 3) });
+		} else if (lengths[i] != 0 && run >= 4) {
+			run = std::min<size_t>(run, 7);
+			runs.push_back({ lengths[i], 0 });
+			runs.push_back({ 16, u8(run - 4) });
+		} else {
+			run = 1;
+			runs.push_back({ lengths[i], 0 });
+		}
+
+		i += run;
+	}
+
+	std::vector<u32> code_length_frequencies(19, 0);
+	for (const Run& run : runs) ++code_length_frequencies[run.symbol];
+
+	const std::vector<u8> code_length_lengths = CodeLengths(code_length_frequencies, 7);
+	const std::vector<u32> code_length_codes = CanonicalCodes(code_length_lengths);
+
+	constexpr u8 Order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	u32 hclen = 19;
+	while (hclen > 4 && code_length_lengths[Order[hclen - 1]] == 0) --hclen;
+
+	writer.Write(hlit - 257, 5);
+	writer.Write(hdist - 1, 5);
+	writer.Write(hclen - 4, 4);
+
+	for (u32 i = 0; i < hclen; ++i) writer.Write(code_length_lengths[Order[i]], 3);
+
+	for (const Run& run : runs) {
+		writer.WriteCode(code_length_codes[run.symbol], code_length_lengths[run.symbol]);
+
+		if (run.symbol == 16) writer.Write(run.extra, 2);
+		if (run.symbol == 17) writer.Write(run.extra, 3);
+		if (run.symbol == 18) writer.Write(run.extra, 7);
+	}
+
+	WriteTokens(writer, tokens, literal_lengths, CanonicalCodes(literal_lengths), distance_lengths, CanonicalCodes(distance_lengths));
+}
+
+inline std::vector<u8> Zlib(std::span<const u8> data, const PngOptions& options, std::mt19937& rng)
+{
+	BitWriter writer;
+	writer.Write(0x78, 8);
+	writer.Write(0x01, 8);
+
+	std::vector<int> last_seen(1 << 16, -1);
+
+	for (size_t begin = 0; begin < data.size();) {
+		const Block block = options.blocks[std::uniform_int_distribution<size_t>{ 0, options.blocks.size() - 1 }(rng)];
+
+		size_t size = std::uniform_int_distribution<size_t>{ 1, options.block_size }(rng);
+		if (block == Block::Stored) size = std::min<size_t>(size, 65535);
+
+		const size_t end = std::min(begin + size, data.size());
+
+		writer.Write(end == data.size(), 1);
+
+		if (block == Block::Stored) {
+			writer.Write(0, 2);
+			writer.AlignToByte();
+			writer.Write(u32(end - begin), 16);
+			writer.Write(~u32(end - begin) & 0xffff, 16);
+
+			auto& bytes = writer.Bytes();
+			bytes.insert(bytes.end(), data.begin() + begin, data.begin() + end);
+		} else {
+			const std::vector<Token> tokens = Tokenize(data, begin, end, last_seen);
+
+			writer.Write(block == Block::Fixed ? 1 : 2, 2);
+			if (block == Block::Fixed) WriteFixedBlock(writer, tokens);
+			else WriteDynamicBlock(writer, tokens);
+		}
+
+		begin = end;
+	}
+
+	writer.AlignToByte();
+
+	const u32 adler = Adler32(data);
+	for (int shift = 24; shift >= 0; shift -= 8) writer.Write((adler >> shift) & 0xff, 8);
+
+	return std::move(writer.Bytes());
+}
+
+inline void WriteChunk(std::vector<u8>& png, const char *type, std::span<const u8> data)
+{
+	const u32 length = static_cast<u32>(data.size());
+	const u8 header[8] = { u8(length >> 24), u8(length >> 16), u8(length >> 8), u8(length), u8(type[0]), u8(type[1]), u8(type[2]), u8(type[3]) };
+
+	png.insert(png.end(), header, header + 8);
+	png.insert(png.end(), data.begin(), data.end());
+
+	const u32 crc = Crc32(data.data(), data.size(), Crc32(header + 4, 4));
+	const u8 trailer[4] = { u8(crc >> 24), u8(crc >> 16), u8(crc >> 8), u8(crc) };
+	png.insert(png.end(), trailer, trailer + 4);
+}
+
+inline u8 Paeth(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+
+	if (pa <= pb && pa <= pc) return static_cast<u8>(a);
+	return static_cast<u8>(pb <= pc ? b : c);
+}
+
+} // namespace detail
+
+inline u32 Channels(u8 colour_type)
+{
+	switch (colour_type) {
+	case 0: return 1;
+	case 2: return 3;
+	case 3: return 1;
+	case 4: return 2;
+	default: return 4;
+	}
+}
+
+// Samples are 8-bit, width * Channels(colour_type) bytes per row
+inline std::vector<u8> EncodePng(std::span<const u8> samples, u32 width, u32 height, const PngOptions& options, std::mt19937& rng)
+{
+	const u32 bpp = Channels(options.colour_type);
+	const size_t stride = size_t(width) * bpp;
+
+	std::vector<u8> filtered;
+	filtered.reserve((stride + 1) * height);
+
+	for (u32 y = 0; y < height; ++y) {
+		const u8 filter = options.filter >= 0 ? u8(options.filter) : u8(std::uniform_int_distribution<u32>{ 0, 4 }(rng));
+		const u8 *row = samples.data() + y * stride;
+		const u8 *prev = y > 0 ? row - stride : nullptr;
+
+		filtered.push_back(filter);
+
+		for (size_t x = 0; x < stride; ++x) {
+			const int a = x >= bpp ? row[x - bpp] : 0;
+			const int b = prev ? prev[x] : 0;
+			const int c = prev && x >= bpp ? prev[x - bpp] : 0;
+
+			int predicted = 0;
+
+			switch (filter) {
+			case 1: predicted = a; break;
+			case 2: predicted = b; break;
+			case 3: predicted = (a + b) / 2; break;
+			case 4: predicted = detail::Paeth(a, b, c); break;
+			}
+
+			filtered.push_back(static_cast<u8>(row[x] - predicted));
+		}
+	}
+
+	std::vector<u8> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	const u8 ihdr[13] = { u8(width >> 24), u8(width >> 16), u8(width >> 8), u8(width),
+		u8(height >> 24), u8(height >> 16), u8(height >> 8), u8(height), 8, options.colour_type, 0, 0, 0 };
+	detail::WriteChunk(png, "IHDR", ihdr);
+
+	if (!options.palette.empty()) detail::WriteChunk(png, "PLTE", options.palette);
+	if (!options.transparency.empty()) detail::WriteChunk(png, "tRNS", options.transparency);
+
+	const std::vector<u8> stream = detail::Zlib(filtered, options, rng);
+
+	for (size_t offset = 0; offset < stream.size();) {
+		size_t size = stream.size() - offset;
+		if (options.max_idat != 0) size = std::min(size, std::uniform_int_distribution<size_t>{ 1, options.max_idat }(rng));
+
+		detail::WriteChunk(png, "IDAT", std::span<const u8>{ stream }.subspan(offset, size));
+		offset += size;
+	}
+
+	detail::WriteChunk(png, "IEND", {});
+	return png;
+}
+
+} // namespace vker::test
\ No newline at end of file
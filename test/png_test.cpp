@@ -0,0 +1,175 @@
+// Decodes generated PNGs of every colour type with the native decoder and with stb_image, and
+// checks they agree byte for byte. Corrupted files must be rejected or decoded without faults
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <fmt/core.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "contrib/stb_image.h"
+
+#include "png.h"
+#include "png_encoder.h"
+#include "types.h"
+
+using namespace vker;
+
+constexpr u32 ImageCount = 100;
+constexpr u32 CorruptionCount = 1000;
+
+// Large enough for any image generated here, so corrupted headers cannot ask for huge buffers
+constexpr u64 MaxCorruptTexels = 1024 * 1024;
+
+static int s_failures = 0;
+
+template <typename... Args>
+static void Fail(fmt::format_string<Args...> format, Args&&... args)
+{
+    fmt::print(stderr, "FAIL: {}\n", fmt::format(format, std::forward<Args>(args)...));
+    ++s_failures;
+}
+
+// Noise, gradients and repeated patterns, so that both literals and matches turn up
+static std::vector<u8> MakeSamples(u32 width, u32 height, u32 channels, std::mt19937& rng)
+{
+    std::vector<u8> samples(size_t(width) * height * channels);
+    const u32 style = std::uniform_int_distribution<u32>{ 0, 2 }(rng);
+
+    for (u32 y = 0; y < height; ++y) {
+        for (u32 x = 0; x < width; ++x) {
+            for (u32 c = 0; c < channels; ++c) {
+                u8 value;
+
+                switch (style) {
+                case 0: value = static_cast<u8>(rng()); break;
+                case 1: value = static_cast<u8>(x * (c + 1) + y * 3); break;
+                default: value = static_cast<u8>(((x / 4) ^ (y / 4)) * 37 + c * 11); break;
+                }
+
+                samples[(size_t(y) * width + x) * channels + c] = value;
+            }
+        }
+    }
+
+    return samples;
+}
+
+static bool Compare(const char *name, std::span<const u8> file)
+{
+    VkExtent2D size;
+    if (!png::ReadInfo(file, size)) {
+        Fail("{}: header not read", name);
+        return false;
+    }
+
+    std::vector<u8> native(size_t(size.width) * size.height * 4);
+    if (!png::DecodeRGBA8(file, native.data())) {
+        Fail("{}: native decoder rejected it", name);
+        return false;
+    }
+
+    int width, height, channels;
+    u8 *reference = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &channels, 4);
+
+    if (!reference) {
+        Fail("{}: stb_image rejected it: {}", name, stbi_failure_reason());
+        return false;
+    }
+
+    const bool same = u32(width) == size.width && u32(height) == size.height && std::memcmp(native.data(), reference, native.size()) == 0;
+    stbi_image_free(reference);
+
+    if (!same) Fail("{}: decoded images differ", name);
+    return same;
+}
+
+int main(int argc, char **argv)
+{
+    std::mt19937 rng{ 0x9e3779b9 };
+
+    std::vector<std::vector<u8>> files;
+
+    constexpr u8 ColourTypes[] = { 0, 2, 3, 4, 6 };
+
+    for (u32 i = 0; i < ImageCount; ++i) {
+        test::PngOptions options;
+        options.colour_type = ColourTypes[i % std::size(ColourTypes)];
+
+        // Mostly small images, with a few large enough for long matches and many blocks
+        const u32 limit = i % 10 == 0 ? 1024 : 160;
+        const u32 width = std::uniform_int_distribution<u32>{ 1, limit }(rng);
+        const u32 height = std::uniform_int_distribution<u32>{ 1, limit }(rng);
+
+        options.block_size = std::uniform_int_distribution<size_t>{ 64, 70000 }(rng);
+        options.max_idat = i % 3 == 0 ? 0 : std::uniform_int_distribution<size_t>{ 1, 8192 }(rng);
+        if (i % 7 == 0) options.filter = static_cast<int>(i / 7 % 5);
+
+        const u32 channels = test::Channels(options.colour_type);
+        std::vector<u8> samples = MakeSamples(width, height, channels, rng);
+
+        if (options.colour_type == 3) {
+            const u32 entries = std::uniform_int_distribution<u32>{ 1, 256 }(rng);
+
+            options.palette.resize(entries * 3);
+            for (auto& value : options.palette) value = static_cast<u8>(rng());
+
+            for (auto& sample : samples) sample = static_cast<u8>(sample % entries);
+
+            if (i % 2 == 0) {
+                options.transparency.resize(std::uniform_int_distribution<u32>{ 1, entries }(rng));
+                for (auto& value : options.transparency) value = static_cast<u8>(rng());
+            }
+        } else if ((options.colour_type == 0 || options.colour_type == 2) && i % 2 == 0) {
+            // Keys are 16-bit samples, matched against the first texel so that some texels use it
+            for (u32 c = 0; c < channels; ++c) {
+                options.transparency.push_back(0);
+                options.transparency.push_back(samples[c]);
+            }
+        }
+
+        files.push_back(test::EncodePng(samples, width, height, options, rng));
+        Compare(fmt::format("image {} (type {}, {}x{})", i, options.colour_type, width, height).c_str(), files.back());
+    }
+
+    // The real asset, when the test is given the directory it is in
+    if (argc > 1) {
+        const std::filesystem::path path = std::filesystem::path{ argv[1] } / "viking_room.png";
+        std::ifstream stream{ path, std::ios::binary };
+
+        if (stream) {
+            const std::vector<u8> file{ std::istreambuf_iterator<char>{ stream }, {} };
+            Compare(path.string().c_str(), file);
+        } else {
+            Fail("unable to open {}", path.string());
+        }
+    }
+
+    // Flipped bytes anywhere after the signature, including the header and chunk lengths
+    for (u32 i = 0; i < CorruptionCount; ++i) {
+        std::vector<u8> file = files[i % files.size()];
+        const u32 flips = std::uniform_int_distribution<u32>{ 1, 8 }(rng);
+
+        for (u32 f = 0; f < flips; ++f) {
+            file[std::uniform_int_distribution<size_t>{ 8, file.size() - 1 }(rng)] ^= static_cast<u8>(1u << (rng() % 8));
+        }
+
+        VkExtent2D size;
+        if (!png::ReadInfo(file, size) || u64(size.width) * size.height > MaxCorruptTexels) continue;
+
+        std::vector<u8> out(size_t(size.width) * size.height * 4);
+        png::DecodeRGBA8(file, out.data());
+    }
+
+    if (s_failures != 0) {
+        fmt::print(stderr, "{} failures\n", s_failures);
+        return EXIT_FAILURE;
+    }
+
+    fmt::print("{} images match stb_image, {} corrupted files survived\n", ImageCount, CorruptionCount);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
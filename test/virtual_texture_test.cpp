@@ -0,0 +1,587 @@
+// Cooks a .vtex, draws it through shader/virtual.frag at a scale that wants one page of its
+// first level, and checks the page the feedback asked for is loaded and sampled. Prefers a
+// CPU device such as lavapipe, and skips when there is no device that can run the shader
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <vulkan/vulkan.h>
+
+#define VMA_IMPLEMENTATION
+#include "contrib/vk_mem_alloc.h"
+
+#include "buffer.h"
+#include "job_system.h"
+#include "memory.h"
+#include "pipeline.h"
+#include "shader.h"
+#include "sync.h"
+#include "types.h"
+#include "utils.h"
+#include "vertex.h"
+#include "virtual_texture.h"
+#include "vtex.h"
+
+using namespace vker;
+
+// ctest reports the test as skipped rather than failed
+constexpr int SkipCode = 77;
+
+// Four pages across and down the first level, and three levels
+constexpr VkExtent2D TextureSize{ 512, 512 };
+
+// One texel per pixel, so the shader picks the first level, all within page (2, 1)
+constexpr VkExtent2D TargetSize{ 128, 128 };
+constexpr u32 PageX = 2;
+constexpr u32 PageY = 1;
+
+constexpr VkFormat TargetFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+// Long enough for the last level to load, then the wanted page
+constexpr u32 MaxFrames = 200;
+
+static int s_failures = 0;
+
+template <typename... Args>
+static void Fail(fmt::format_string<Args...> format, Args&&... args)
+{
+    fmt::print(stderr, "FAIL: {}\n", fmt::format(format, std::forward<Args>(args)...));
+    ++s_failures;
+}
+
+struct Context {
+    VkInstance instance;
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool pool;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    VmaAllocator allocator;
+};
+
+static bool CreateContext(Context& ctx)
+{
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "vker_virtual_texture_test";
+    app_info.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instance_info{};
+    instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_info.pApplicationInfo = &app_info;
+
+    if (vkCreateInstance(&instance_info, nullptr, &ctx.instance) != VK_SUCCESS) return false;
+
+    u32 device_count = 0;
+    VK_CHECK(vkEnumeratePhysicalDevices(ctx.instance, &device_count, nullptr));
+    if (device_count == 0) return false;
+
+    std::vector<VkPhysicalDevice> devices(device_count);
+    VK_CHECK(vkEnumeratePhysicalDevices(ctx.instance, &device_count, devices.data()));
+
+    ctx.physical_device = devices[0];
+
+    for (const auto device : devices) {
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(device, &props);
+
+        if (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) ctx.physical_device = device;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx.physical_device, &props);
+    fmt::print("device: {}\n", props.deviceName);
+
+    // The shader writes its feedback from fragments
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(ctx.physical_device, &supported);
+
+    if (!supported.fragmentStoresAndAtomics) {
+        fmt::print("device cannot store from fragment shaders\n");
+        return false;
+    }
+
+    u32 family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, families.data());
+
+    u32 family = UINT32_MAX;
+
+    for (u32 i = 0; i < family_count; ++i) {
+        if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            family = i;
+            break;
+        }
+    }
+
+    if (family == UINT32_MAX) return false;
+
+    const float priority = 1.0f;
+
+    VkDeviceQueueCreateInfo queue_info{};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+
+    VkPhysicalDeviceFeatures features{};
+    features.fragmentStoresAndAtomics = VK_TRUE;
+
+    VkDeviceCreateInfo device_info{};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    device_info.pEnabledFeatures = &features;
+
+    VK_CHECK(vkCreateDevice(ctx.physical_device, &device_info, nullptr, &ctx.device));
+    vkGetDeviceQueue(ctx.device, family, 0, &ctx.queue);
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = family;
+
+    VK_CHECK(vkCreateCommandPool(ctx.device, &pool_info, nullptr, &ctx.pool));
+
+    VkCommandBufferAllocateInfo cmd_info{};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = ctx.pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+
+    VK_CHECK(vkAllocateCommandBuffers(ctx.device, &cmd_info, &ctx.cmd));
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VK_CHECK(vkCreateFence(ctx.device, &fence_info, nullptr, &ctx.fence));
+
+    VmaAllocatorCreateInfo allocator_info{};
+    allocator_info.physicalDevice = ctx.physical_device;
+    allocator_info.device = ctx.device;
+    allocator_info.instance = ctx.instance;
+    allocator_info.pDeviceMemoryCallbacks = memory::DeviceCallbacks();
+    allocator_info.vulkanApiVersion = VK_API_VERSION_1_1;
+
+    VK_CHECK(vmaCreateAllocator(&allocator_info, &ctx.allocator));
+
+    // Barriers go through the original call, which every device has
+    sync::UseSynchronization2(false);
+
+    return true;
+}
+
+static void DestroyContext(Context& ctx)
+{
+    vmaDestroyAllocator(ctx.allocator);
+    vkDestroyFence(ctx.device, ctx.fence, nullptr);
+    vkDestroyCommandPool(ctx.device, ctx.pool, nullptr);
+    vkDestroyDevice(ctx.device, nullptr);
+    vkDestroyInstance(ctx.instance, nullptr);
+}
+
+// Each page of the first level is a flat colour from its position, with a checkerboard in blue
+// that only the first level keeps. Coarser levels average it out to grey
+static std::vector<u8> MakeTexture()
+{
+    std::vector<u8> rgba(size_t(TextureSize.width) * TextureSize.height * 4);
+
+    for (u32 y = 0; y < TextureSize.height; ++y) {
+        for (u32 x = 0; x < TextureSize.width; ++x) {
+            u8 *texel = rgba.data() + (size_t(y) * TextureSize.width + x) * 4;
+            texel[0] = static_cast<u8>(40 + x / vtex::PageSize * 50);
+            texel[1] = static_cast<u8>(40 + y / vtex::PageSize * 50);
+            texel[2] = (x + y) % 2 ? 255 : 0;
+            texel[3] = 255;
+        }
+    }
+
+    return rgba;
+}
+
+// A render target that is copied out after every frame
+struct Target {
+    VkImage image;
+    VmaAllocation allocation;
+    VkImageView view;
+    VkRenderPass render_pass;
+    VkFramebuffer framebuffer;
+    Buffer readback;
+};
+
+static void CreateTarget(Context& ctx, Target& target)
+{
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = TargetFormat;
+    image_info.extent = { TargetSize.width, TargetSize.height, 1 };
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo alloc_info{};
+    alloc_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    VK_CHECK(vmaCreateImage(ctx.allocator, &image_info, &alloc_info, &target.image, &target.allocation, nullptr));
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = target.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = TargetFormat;
+    view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    VK_CHECK(vkCreateImageView(ctx.device, &view_info, nullptr, &target.view));
+
+    // Left ready to copy from, and the copy waits for the pass to finish writing
+    VkAttachmentDescription attachment{};
+    attachment.format = TargetFormat;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkAttachmentReference reference{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &reference;
+
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = 0;
+    dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo pass_info{};
+    pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    pass_info.attachmentCount = 1;
+    pass_info.pAttachments = &attachment;
+    pass_info.subpassCount = 1;
+    pass_info.pSubpasses = &subpass;
+    pass_info.dependencyCount = 1;
+    pass_info.pDependencies = &dependency;
+
+    VK_CHECK(vkCreateRenderPass(ctx.device, &pass_info, nullptr, &target.render_pass));
+
+    VkFramebufferCreateInfo framebuffer_info{};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = target.render_pass;
+    framebuffer_info.attachmentCount = 1;
+    framebuffer_info.pAttachments = &target.view;
+    framebuffer_info.width = TargetSize.width;
+    framebuffer_info.height = TargetSize.height;
+    framebuffer_info.layers = 1;
+
+    VK_CHECK(vkCreateFramebuffer(ctx.device, &framebuffer_info, nullptr, &target.framebuffer));
+
+    target.readback.Setup(ctx.allocator, size_t(TargetSize.width) * TargetSize.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Loader);
+}
+
+static void DestroyTarget(Context& ctx, Target& target)
+{
+    target.readback.Destroy();
+    vkDestroyFramebuffer(ctx.device, target.framebuffer, nullptr);
+    vkDestroyRenderPass(ctx.device, target.render_pass, nullptr);
+    vkDestroyImageView(ctx.device, target.view, nullptr);
+    vmaDestroyImage(ctx.allocator, target.image, target.allocation);
+}
+
+// The renderer's vertex shader and its layout: the matrix in set 0, and set 1 for plain textures,
+// which the virtual texture shader leaves unused
+struct Scene {
+    VkDescriptorSetLayout matrix_layout;
+    VkDescriptorSetLayout unused_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet matrix_set;
+
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipeline;
+
+    Buffer uniforms;
+    Buffer vertices;
+};
+
+static void CreateScene(Context& ctx, Scene& scene, VirtualTextureCache& cache, VkRenderPass render_pass)
+{
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &binding;
+
+    VK_CHECK(vkCreateDescriptorSetLayout(ctx.device, &layout_info, nullptr, &scene.matrix_layout));
+
+    layout_info.bindingCount = 0;
+    VK_CHECK(vkCreateDescriptorSetLayout(ctx.device, &layout_info, nullptr, &scene.unused_layout));
+
+    VkDescriptorPoolSize pool_size{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 };
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+
+    VK_CHECK(vkCreateDescriptorPool(ctx.device, &pool_info, nullptr, &scene.descriptor_pool));
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.descriptorPool = scene.descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &scene.matrix_layout;
+
+    VK_CHECK(vkAllocateDescriptorSets(ctx.device, &set_info, &scene.matrix_set));
+
+    // Identity, so the quad is given in clip space
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    scene.uniforms.Setup(ctx.allocator, sizeof(identity), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Renderer);
+    std::memcpy(scene.uniforms.Map(), identity, sizeof(identity));
+    scene.uniforms.Unmap();
+
+    VkDescriptorBufferInfo buffer_info{ scene.uniforms.Handle(), 0, VK_WHOLE_SIZE };
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = scene.matrix_set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    write.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(ctx.device, 1, &write, 0, nullptr);
+
+    // Covers the target, clockwise on screen, with texel centres at pixel centres
+    const float u0 = float(PageX * vtex::PageSize) / TextureSize.width;
+    const float v0 = float(PageY * vtex::PageSize) / TextureSize.height;
+    const float u1 = u0 + float(TargetSize.width) / TextureSize.width;
+    const float v1 = v0 + float(TargetSize.height) / TextureSize.height;
+
+    const Vertex quad[6] = {
+        { { -1.0f, -1.0f, 0.0f }, { u0, v0 } },
+        { { 1.0f, -1.0f, 0.0f }, { u1, v0 } },
+        { { 1.0f, 1.0f, 0.0f }, { u1, v1 } },
+        { { -1.0f, -1.0f, 0.0f }, { u0, v0 } },
+        { { 1.0f, 1.0f, 0.0f }, { u1, v1 } },
+        { { -1.0f, 1.0f, 0.0f }, { u0, v1 } },
+    };
+
+    scene.vertices.Setup(ctx.allocator, sizeof(quad), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory::Tag::Models);
+    std::memcpy(scene.vertices.Map(), quad, sizeof(quad));
+    scene.vertices.Unmap();
+
+    PipelineLayoutBuilder layout_builder;
+    layout_builder.AddDescriptor(scene.matrix_layout);
+    layout_builder.AddDescriptor(scene.unused_layout);
+    layout_builder.AddDescriptor(cache.Layout());
+    layout_builder.AddPushConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(u32));
+
+    scene.pipeline_layout = layout_builder.Build(ctx.device);
+
+    const std::filesystem::path shader_dir = std::filesystem::path{ VKER_BUILD_DIR } / "shader";
+
+    VkShaderModule vert;
+    VkShaderModule frag;
+
+    shader::Create(ctx.device, &vert, shader_dir / "triangle.vert.spv");
+    shader::Create(ctx.device, &frag, shader_dir / "virtual.frag.spv");
+
+    PipelineBuilder pipeline_builder;
+    pipeline_builder.AddShader(VK_SHADER_STAGE_VERTEX_BIT, vert);
+    pipeline_builder.AddShader(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
+
+    pipeline_builder.AddVertexBinding(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
+    pipeline_builder.AddVertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos));
+    pipeline_builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, tex));
+
+    pipeline_builder.SetInputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
+    pipeline_builder.AddViewport({ 0.0f, 0.0f, float(TargetSize.width), float(TargetSize.height), 0.0f, 1.0f });
+    pipeline_builder.AddScissor({ { 0, 0 }, TargetSize });
+
+    scene.pipeline = pipeline_builder.Build(ctx.device, scene.pipeline_layout, render_pass);
+
+    shader::Destroy(ctx.device, vert);
+    shader::Destroy(ctx.device, frag);
+}
+
+static void DestroyScene(Context& ctx, Scene& scene)
+{
+    vkDestroyPipeline(ctx.device, scene.pipeline, memory::HostCallbacks(memory::Tag::Pipelines));
+    vkDestroyPipelineLayout(ctx.device, scene.pipeline_layout, memory::HostCallbacks(memory::Tag::Pipelines));
+    vkDestroyDescriptorPool(ctx.device, scene.descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(ctx.device, scene.unused_layout, nullptr);
+    vkDestroyDescriptorSetLayout(ctx.device, scene.matrix_layout, nullptr);
+    scene.vertices.Destroy();
+    scene.uniforms.Destroy();
+}
+
+// Draws one frame with a single frame in flight, as the renderer would, and waits for it
+static void DrawFrame(Context& ctx, Target& target, Scene& scene, VirtualTextureCache& cache, u32 texture_index, std::vector<u8>& pixels)
+{
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(ctx.cmd, &begin_info));
+
+    cache.Update(0, ctx.cmd);
+
+    VkClearValue clear{};
+
+    VkRenderPassBeginInfo pass_begin{};
+    pass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    pass_begin.renderPass = target.render_pass;
+    pass_begin.framebuffer = target.framebuffer;
+    pass_begin.renderArea = { { 0, 0 }, TargetSize };
+    pass_begin.clearValueCount = 1;
+    pass_begin.pClearValues = &clear;
+
+    vkCmdBeginRenderPass(ctx.cmd, &pass_begin, VK_SUBPASS_CONTENTS_INLINE);
+
+    const VkDeviceSize offset = 0;
+    const VkBuffer vertex_buffer = scene.vertices.Handle();
+    const VkDescriptorSet virtual_set = cache.Set(0);
+
+    vkCmdBindPipeline(ctx.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipeline);
+    vkCmdBindDescriptorSets(ctx.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipeline_layout, 0, 1, &scene.matrix_set, 0, nullptr);
+    vkCmdBindDescriptorSets(ctx.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipeline_layout, 2, 1, &virtual_set, 0, nullptr);
+    vkCmdPushConstants(ctx.cmd, scene.pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(u32), &texture_index);
+    vkCmdBindVertexBuffers(ctx.cmd, 0, 1, &vertex_buffer, &offset);
+    vkCmdDraw(ctx.cmd, 6, 1, 0, 0);
+
+    vkCmdEndRenderPass(ctx.cmd);
+
+    cache.RecordFeedbackBarrier(ctx.cmd);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { TargetSize.width, TargetSize.height, 1 };
+
+    vkCmdCopyImageToBuffer(ctx.cmd, target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.readback.Handle(), 1, &region);
+
+    sync::RecordMemoryBarrier(ctx.cmd,
+        VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+
+    VK_CHECK(vkEndCommandBuffer(ctx.cmd));
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &ctx.cmd;
+
+    VK_CHECK(vkQueueSubmit(ctx.queue, 1, &submit_info, ctx.fence));
+    VK_CHECK(vkWaitForFences(ctx.device, 1, &ctx.fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK(vkResetFences(ctx.device, 1, &ctx.fence));
+    VK_CHECK(vkResetCommandBuffer(ctx.cmd, 0));
+
+    std::memcpy(pixels.data(), target.readback.Map(), pixels.size());
+    target.readback.Unmap();
+}
+
+// Whether every pixel shows the wanted page of the first level, checkerboard and all
+static bool ShowsPage(const std::vector<u8>& pixels)
+{
+    const u8 red = static_cast<u8>(40 + PageX * 50);
+    const u8 green = static_cast<u8>(40 + PageY * 50);
+
+    for (u32 y = 0; y < TargetSize.height; ++y) {
+        for (u32 x = 0; x < TargetSize.width; ++x) {
+            const u8 *pixel = pixels.data() + (size_t(y) * TargetSize.width + x) * 4;
+            const u8 blue = (x + y) % 2 ? 255 : 0;
+
+            if (std::abs(pixel[0] - red) > 2 || std::abs(pixel[1] - green) > 2 || std::abs(pixel[2] - blue) > 16) return false;
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    Context ctx;
+
+    if (!CreateContext(ctx)) {
+        fmt::print("no Vulkan device that can run the virtual texture shader, skipping\n");
+        return SkipCode;
+    }
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "vker_virtual_texture_test.vtex";
+
+    const std::vector<u8> texture = MakeTexture();
+    vtex::Write(path, texture.data(), TextureSize);
+
+    JobSystem jobs{ 2 };
+
+    VirtualTextureCache cache;
+    cache.Setup(ctx.device, ctx.allocator, jobs, 1);
+
+    const u32 texture_index = cache.Register(path);
+
+    Target target;
+    CreateTarget(ctx, target);
+
+    Scene scene;
+    CreateScene(ctx, scene, cache, target.render_pass);
+
+    std::vector<u8> pixels(size_t(TargetSize.width) * TargetSize.height * 4);
+    u32 frames = 0;
+    bool shown = false;
+
+    // The first frames draw grey, then the last level, until the feedback has brought the page in
+    while (frames < MaxFrames && !shown) {
+        DrawFrame(ctx, target, scene, cache, texture_index, pixels);
+        ++frames;
+
+        shown = ShowsPage(pixels);
+        if (!shown) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (!shown) {
+        const u8 *centre = pixels.data() + (size_t(TargetSize.height / 2) * TargetSize.width + TargetSize.width / 2) * 4;
+        Fail("page ({}, {}) of the first level was not drawn after {} frames, the centre is ({}, {}, {}, {})",
+            PageX, PageY, frames, centre[0], centre[1], centre[2], centre[3]);
+    }
+
+    DestroyScene(ctx, scene);
+    DestroyTarget(ctx, target);
+    cache.Destroy();
+    DestroyContext(ctx);
+
+    std::filesystem::remove(path);
+
+    if (s_failures != 0) {
+        fmt::print(stderr, "{} failures\n", s_failures);
+        return EXIT_FAILURE;
+    }
+
+    fmt::print("page ({}, {}) loaded from feedback after {} frames\n", PageX, PageY, frames);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file